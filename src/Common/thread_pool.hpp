@@ -0,0 +1,72 @@
+#pragma once
+
+#include "common.hpp"
+#include <condition_variable>
+#include <future>
+
+namespace stm {
+
+// Fixed-size pool of worker threads, for CPU-bound work such as file decoding that is dispatched in bulk and joined through futures
+class thread_pool {
+private:
+	vector<thread> mThreads;
+	queue<function<void()>> mTasks;
+	mutex mMutex;
+	condition_variable mCondition;
+	bool mStop = false;
+
+	inline void worker() {
+		while (true) {
+			function<void()> task;
+			{
+				unique_lock l(mMutex);
+				mCondition.wait(l, [&]{ return mStop || !mTasks.empty(); });
+				if (mStop && mTasks.empty()) return;
+				task = move(mTasks.front());
+				mTasks.pop();
+			}
+			task();
+		}
+	}
+
+public:
+	inline thread_pool(uint32_t threadCount = max(thread::hardware_concurrency(), 2u) - 1) {
+		mThreads.reserve(threadCount);
+		for (uint32_t i = 0; i < threadCount; i++)
+			mThreads.emplace_back(&thread_pool::worker, this);
+	}
+	thread_pool(const thread_pool&) = delete;
+	thread_pool(thread_pool&&) = delete;
+	inline ~thread_pool() {
+		{
+			scoped_lock l(mMutex);
+			mStop = true;
+		}
+		mCondition.notify_all();
+		for (thread& t : mThreads)
+			if (t.joinable()) t.join();
+	}
+
+	inline size_t size() const { return mThreads.size(); }
+
+	// Exceptions thrown by fn are rethrown from future::get()
+	template<invocable F>
+	inline future<invoke_result_t<F>> push(F&& fn) {
+		auto task = make_shared<packaged_task<invoke_result_t<F>()>>(forward<F>(fn));
+		future<invoke_result_t<F>> result = task->get_future();
+		{
+			scoped_lock l(mMutex);
+			mTasks.emplace([task]{ (*task)(); });
+		}
+		mCondition.notify_one();
+		return result;
+	}
+
+	// Process-wide pool shared by the scene loaders
+	inline static thread_pool& global() {
+		static thread_pool pool;
+		return pool;
+	}
+};
+
+}
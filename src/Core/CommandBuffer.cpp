@@ -1,34 +1,50 @@
 #include "CommandBuffer.hpp"
 
+#include <atomic>
+
 using namespace stm;
 
-CommandBuffer::CommandBuffer(Device::QueueFamily& queueFamily, const string& name, vk::CommandBufferLevel level)
-	: DeviceResource(queueFamily.mDevice, name), mQueueFamily(queueFamily) {
-	mFence = make_shared<Fence>(mDevice, name + "/fence");
-	mCommandPool = mQueueFamily.mCommandBuffers.at(this_thread::get_id()).first;
+static atomic<uint64_t> gRecordingCount = 0;
+
+CommandBuffer::CommandBuffer(Device::QueueFamily& queueFamily, Device::CommandPool& commandPool, const string& name, vk::CommandBufferLevel level)
+	: DeviceResource(queueFamily.mDevice, name), mQueueFamily(queueFamily), mCommandPool(commandPool), mLevel(level) {
+	mCompletion = make_shared<TimelinePoint>(mQueueFamily);
 
 	vk::CommandBufferAllocateInfo allocInfo;
-	allocInfo.commandPool = mCommandPool;
+	allocInfo.commandPool = mCommandPool.mCommandPool;
 	allocInfo.level = level;
 	allocInfo.commandBufferCount = 1;
-	mCommandBuffer = mDevice->allocateCommandBuffers({ allocInfo })[0];
+	{
+		scoped_lock l(mCommandPool.mMutex);
+		mCommandBuffer = mDevice->allocateCommandBuffers({ allocInfo })[0];
+	}
 	mDevice.set_debug_name(mCommandBuffer, name);
 
 	clear();
-	mCommandBuffer.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
-	mState = CommandBufferState::eRecording;
+	begin();
 }
 CommandBuffer::~CommandBuffer() {
 	if (mState == CommandBufferState::eInFlight)
 		fprintf_color(ConsoleColor::eYellow, stderr, "Warning: Destroying CommandBuffer [%s] that is in-flight!\n", name().c_str());
 	clear();
-	mDevice->freeCommandBuffers(mCommandPool, { mCommandBuffer });
+	// the last reference may be released on any thread, so freeing is synchronized with the owning thread's allocations
+	scoped_lock l(mCommandPool.mMutex);
+	mDevice->freeCommandBuffers(mCommandPool.mCommandPool, { mCommandBuffer });
 }
 
 void CommandBuffer::clear() {
-	for (const auto& resource : mHeldResources)
-		resource->mTracking.erase(this);
+	for (const auto& resource : mHeldResources) {
+		scoped_lock l(resource->mTrackingMutex);
+		if (auto it = ranges::find(resource->mTracking, this); it != resource->mTracking.end()) {
+			*it = resource->mTracking.back();
+			resource->mTracking.pop_back();
+		}
+	}
 	mHeldResources.clear();
+	// resources held so far no longer match, so the next hold_resource re-registers them
+	mRecordingId = ++gRecordingCount;
+	mCompletionHandlers.clear();
+	mTransitionedImages.clear();
 	mBoundFramebuffer.reset();
 	mSubpassIndex = 0;
 	mBoundPipeline.reset();
@@ -43,13 +59,44 @@ void CommandBuffer::reset(const string& name) {
 
 	mCommandBuffer.reset({});
 
-	mFence = make_shared<Fence>(mDevice, name + "/fence");
+	// the completion point is only replaced if someone else may still be waiting on it
+	if (mCompletion.use_count() == 1)
+		mCompletion->mValue = 0;
+	else
+		mCompletion = make_shared<TimelinePoint>(mQueueFamily);
 	mDevice.set_debug_name(mCommandBuffer, name);
 
-	mCommandBuffer.begin({ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+	begin();
+}
+void CommandBuffer::begin() {
+	// secondary command buffers don't continue a render pass, so they inherit nothing
+	const vk::CommandBufferInheritanceInfo inheritanceInfo = {};
+	mCommandBuffer.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit, mLevel == vk::CommandBufferLevel::eSecondary ? &inheritanceInfo : nullptr));
 	mState = CommandBufferState::eRecording;
 }
 
+void CommandBuffer::execute(const shared_ptr<CommandBuffer>& secondary) {
+	if (mLevel != vk::CommandBufferLevel::ePrimary) throw logic_error("only primary command buffers can execute secondary command buffers");
+	if (secondary->mLevel != vk::CommandBufferLevel::eSecondary) throw invalid_argument("only secondary command buffers can be executed");
+	if (&secondary->mQueueFamily != &mQueueFamily) throw invalid_argument("secondary command buffer must belong to the same queue family");
+	if (secondary->mState != CommandBufferState::eRecording) throw logic_error("secondary command buffer was already executed");
+
+	(*secondary)->end();
+	mCommandBuffer.executeCommands(**secondary);
+
+	// bindings don't carry over from a secondary command buffer
+	mBoundPipeline.reset();
+	mBoundVertexBuffers.clear();
+	mBoundIndexBuffer = {};
+	mBoundDescriptorSets.clear();
+
+	// the secondary finishes with this command buffer, and its resources are released by whichever thread polls it first
+	secondary->mCompletion = mCompletion;
+	secondary->mState = CommandBufferState::eInFlight;
+	scoped_lock l(secondary->mCommandPool.mMutex);
+	secondary->mCommandPool.mInFlight.emplace_back(secondary);
+}
+
 void CommandBuffer::bind_descriptor_set(uint32_t index, const shared_ptr<DescriptorSet>& descriptorSet, const vk::ArrayProxy<const uint32_t>& dynamicOffsets) {
 	if (!mBoundPipeline) throw logic_error("attempt to bind descriptor sets without a pipeline bound\n");
 	hold_resource(descriptorSet);
@@ -81,14 +128,7 @@ void CommandBuffer::next_subpass(vk::SubpassContents contents) {
 		const string& attachmentName = mBoundFramebuffer->render_pass().attachments()[i].second;
 		auto layout = get<vk::AttachmentDescription>(mBoundFramebuffer->render_pass().subpasses()[mSubpassIndex].at(attachmentName)).initialLayout;
 		auto& attachment = (*mBoundFramebuffer)[i];
-		uint32_t aspectMask = (uint32_t)attachment.subresource_range().aspectMask;
-		while (aspectMask) {
-			uint32_t aspect = 1 << countr_zero(aspectMask);
-			aspectMask &= ~aspect;
-			for (uint32_t layer = attachment.subresource_range().baseArrayLayer; layer < attachment.subresource_range().baseArrayLayer+attachment.subresource_range().layerCount; layer++)
-				for (uint32_t level = attachment.subresource_range().baseMipLevel; level < attachment.subresource_range().baseMipLevel+attachment.subresource_range().levelCount; level++)
-					attachment.image()->tracked_state((vk::ImageAspectFlags)aspect, layer, level) = make_tuple(layout, guess_stage(layout), guess_access_flags(layout));
-		}
+		attachment.image()->set_tracked_state(attachment.subresource_range(), { layout, guess_stage(layout), guess_access_flags(layout) });
 	}
 }
 void CommandBuffer::end_render_pass() {
@@ -98,14 +138,7 @@ void CommandBuffer::end_render_pass() {
 	for (uint32_t i = 0; i < mBoundFramebuffer->render_pass().attachments().size(); i++) {
 		auto layout = get<vk::AttachmentDescription>(mBoundFramebuffer->render_pass().attachments()[i]).finalLayout;
 		auto& attachment = (*mBoundFramebuffer)[i];
-		uint32_t aspectMask = (uint32_t)attachment.subresource_range().aspectMask;
-		while (aspectMask) {
-			uint32_t aspect = 1 << countr_zero(aspectMask);
-			aspectMask &= ~aspect;
-			for (uint32_t layer = attachment.subresource_range().baseArrayLayer; layer < attachment.subresource_range().baseArrayLayer+attachment.subresource_range().layerCount; layer++)
-				for (uint32_t level = attachment.subresource_range().baseMipLevel; level < attachment.subresource_range().baseMipLevel+attachment.subresource_range().levelCount; level++)
-					attachment.image()->tracked_state((vk::ImageAspectFlags)aspect, layer, level) = make_tuple(layout, guess_stage(layout), guess_access_flags(layout));
-		}
+		attachment.image()->set_tracked_state(attachment.subresource_range(), { layout, guess_stage(layout), guess_access_flags(layout) });
 	}
 
 	mBoundFramebuffer = nullptr;
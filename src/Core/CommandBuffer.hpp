@@ -9,8 +9,8 @@ namespace stm {
 
 class CommandBuffer : public DeviceResource {
 public:
-	// assumes a CommandPool has been created for this_thread in queueFamily
-	STRATUM_API CommandBuffer(Device::QueueFamily& queueFamily, const string& name, vk::CommandBufferLevel level = vk::CommandBufferLevel::ePrimary);
+	// commandPool must belong to queueFamily. Use Device::get_command_buffer, which recycles command buffers
+	STRATUM_API CommandBuffer(Device::QueueFamily& queueFamily, Device::CommandPool& commandPool, const string& name, vk::CommandBufferLevel level = vk::CommandBufferLevel::ePrimary);
 	STRATUM_API ~CommandBuffer();
 
 	inline vk::CommandBuffer& operator*() { return mCommandBuffer; }
@@ -20,16 +20,24 @@ public:
 
 	inline void wait_for(const shared_ptr<Semaphore>& semaphore, vk::PipelineStageFlags stage) { hold_resource(semaphore); mWaitSemaphores.emplace(semaphore, stage); }
 	inline void signal_when_done(const shared_ptr<Semaphore>& semaphore) { hold_resource(semaphore); mSignalSemaphores.emplace(semaphore); }
-	inline const shared_ptr<Fence>& fence() const { return mFence; }
+	// Reached once this command buffer has finished executing
+	inline const shared_ptr<TimelinePoint>& completion() const { return mCompletion; }
 	inline Device::QueueFamily& queue_family() const { return mQueueFamily; }
+	inline vk::CommandBufferLevel level() const { return mLevel; }
 
 	inline const shared_ptr<Framebuffer>& bound_framebuffer() const { return mBoundFramebuffer; }
 	inline uint32_t subpass_index() const { return mSubpassIndex; }
 	inline const shared_ptr<Pipeline>& bound_pipeline() const { return mBoundPipeline; }
 	inline const shared_ptr<DescriptorSet>& bound_descriptor_set(uint32_t index) const { return mBoundDescriptorSets[index]; }
+	// Images this secondary command buffer recorded layout transitions for, in no particular order
+	inline const unordered_set<const Image*>& transitioned_images() const { return mTransitionedImages; }
 
 	STRATUM_API void reset(const string& name = "Command Buffer");
 
+	// Ends secondary and records its commands into this primary command buffer. secondary may have been recorded on any thread,
+	// from the same queue family, and is recycled once this command buffer is done. Secondary command buffers are recorded outside of render passes
+	STRATUM_API void execute(const shared_ptr<CommandBuffer>& secondary);
+
 	// Label a region for a tool such as RenderDoc
 	inline void begin_label(const string& label, const float4& color = { 1,1,1,0 }) const {
 		vk::DebugUtilsLabelEXT info = {};
@@ -40,8 +48,9 @@ public:
 	inline void end_label() const {
 		mCommandBuffer.endDebugUtilsLabelEXT();
 	}
+	// Only primary command buffers write timestamps, since they are recorded on the thread that owns the query pool
 	inline void write_timestamp(vk::PipelineStageFlagBits stage, const string& label) const {
-		if (!mDevice.use_timestamps()) return;
+		if (!mDevice.use_timestamps() || mLevel != vk::CommandBufferLevel::ePrimary) return;
 		auto&[pool,count,labels] = mDevice.query_pool();
 		const uint32_t num = labels.size();
 		labels.emplace_back(label);
@@ -49,21 +58,41 @@ public:
 			mCommandBuffer.writeTimestamp(stage, pool, num);
 	}
 
-	inline bool clear_if_done() {
-		if (mState == CommandBufferState::eInFlight)
-			if (mFence->status() == vk::Result::eSuccess) {
-				mState = CommandBufferState::eDone;
-				clear();
-				return true;
-			}
+	// If deferredHandlers is not null, the completion handlers are appended to it instead of being called, so that a caller holding a lock can call them after releasing it
+	inline bool clear_if_done(vector<function<void()>>* deferredHandlers = nullptr) {
+		CommandBufferState state = CommandBufferState::eInFlight;
+		// only the thread that moves the state out of eInFlight clears; other threads see eClearing and treat it as not yet done
+		if (mState == CommandBufferState::eInFlight && mCompletion->done() && mState.compare_exchange_strong(state, CommandBufferState::eClearing)) {
+			vector<function<void()>> handlers = move(mCompletionHandlers);
+			clear();
+			mState = CommandBufferState::eDone;
+			if (deferredHandlers)
+				ranges::move(handlers, back_inserter(*deferredHandlers));
+			else
+				for (const function<void()>& fn : handlers)
+					fn();
+			return true;
+		}
 		return mState == CommandBufferState::eDone;
 	}
 
+	// fn is called once this command buffer is found to be done, by whichever thread polls it first (Device::get_command_buffer, Device::flush, DeviceResource::in_use).
+	// fn must not record commands. Handlers are discarded if the command buffer is never submitted
+	inline void on_complete(function<void()>&& fn) { mCompletionHandlers.emplace_back(move(fn)); }
+
 	// Add a resource to the device's resource pool after this commandbuffer finishes executing
 	template<derived_from<DeviceResource> T>
 	inline T& hold_resource(const shared_ptr<T>& r) {
-		r->mTracking.emplace(this);
-		return *static_cast<T*>(mHeldResources.emplace( static_pointer_cast<DeviceResource>(r) ).first->get());
+		// a resource is usually touched many times by the same recording, so it remembers the last recording that held it
+		if (r->mLastRecording.exchange(mRecordingId, memory_order_relaxed) != mRecordingId) {
+			{
+				scoped_lock l(r->mTrackingMutex);
+				if (ranges::find(r->mTracking, this) == r->mTracking.end())
+					r->mTracking.emplace_back(this);
+			}
+			mHeldResources.emplace_back(r);
+		}
+		return *r;
 	}
 	template<typename T>
 	inline const Buffer::View<T>& hold_resource(const Buffer::View<T>& v) {
@@ -128,6 +157,25 @@ public:
 		return dst;
 	}
 
+	// Copies src into a host-visible buffer, which is passed to callback once this command buffer is done (see on_complete)
+	template<typename T>
+	inline void readback(const Buffer::View<T>& src, function<void(const Buffer::View<T>&)>&& callback) {
+		Buffer::View<T> dst = make_shared<Buffer>(mDevice, src.buffer()->name() + "/Readback", src.size_bytes(), vk::BufferUsageFlagBits::eTransferDst, VMA_MEMORY_USAGE_GPU_TO_CPU);
+		copy_buffer(src, dst);
+		barrier({ dst }, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite, vk::PipelineStageFlagBits::eHost, vk::AccessFlagBits::eHostRead);
+		on_complete([dst, callback = move(callback)]() { callback(dst); });
+	}
+	// Copies the first level and layer of src into a tightly packed host-visible buffer, which is passed to callback once this command buffer is done (see on_complete)
+	inline void readback(const Image::View& src, function<void(const Buffer::TexelView&, const vk::Extent3D&)>&& callback) {
+		const vk::Extent3D extent = src.extent();
+		const vk::Format format = src.image()->format();
+		Buffer::TexelView dst(make_shared<Buffer>(mDevice, src.image()->name() + "/Readback", extent.width*extent.height*extent.depth*texel_size(format), vk::BufferUsageFlagBits::eTransferDst, VMA_MEMORY_USAGE_GPU_TO_CPU), format);
+		const vk::ImageSubresourceRange& r = src.subresource_range();
+		copy_image_to_buffer(Image::View(src.image(), vk::ImageSubresourceRange(r.aspectMask, r.baseMipLevel, 1, r.baseArrayLayer, 1)), dst);
+		barrier({ dst }, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite, vk::PipelineStageFlagBits::eHost, vk::AccessFlagBits::eHostRead);
+		on_complete([dst, extent, callback = move(callback)]() { callback(dst, extent); });
+	}
+
 	inline const Image::View& clear_color_image(const Image::View& img, const vk::ClearColorValue& clear) {
 		img.transition_barrier(*this, vk::ImageLayout::eTransferDstOptimal);
 		mCommandBuffer.clearColorImage(*hold_resource(img.image()), vk::ImageLayout::eTransferDstOptimal, clear, img.subresource_range());
@@ -195,6 +243,9 @@ public:
 			(dim.depth + cp->workgroup_size().depth - 1) / cp->workgroup_size().depth);
 	}
 	inline void dispatch_over(uint32_t x, uint32_t y = 1, uint32_t z = 1) { return dispatch_over(vk::Extent3D(x,y,z)); }
+	// dispatch with the group count in args, which must be a buffer with eIndirectBuffer usage
+	template<typename T>
+	inline void dispatch_indirect(const Buffer::View<T>& args) { mCommandBuffer.dispatchIndirect(**hold_resource(args).buffer(), args.offset()); }
 
 	STRATUM_API void begin_render_pass(const shared_ptr<RenderPass>& renderPass, const shared_ptr<Framebuffer>& framebuffer, const vk::Rect2D& renderArea, const vector<vk::ClearValue>& clearValues, vk::SubpassContents contents = vk::SubpassContents::eInline);
 	STRATUM_API void next_subpass(vk::SubpassContents contents = vk::SubpassContents::eInline);
@@ -278,22 +329,28 @@ public:
 
 private:
 	friend class Device;
+	friend class Image;
 
-	enum class CommandBufferState { eRecording, eInFlight, eDone };
+	enum class CommandBufferState { eRecording, eInFlight, eClearing, eDone };
 
 	STRATUM_API void clear();
+	void begin();
 
 	vk::CommandBuffer mCommandBuffer;
 
 	Device::QueueFamily& mQueueFamily;
-	vk::CommandPool mCommandPool;
-	CommandBufferState mState;
+	Device::CommandPool& mCommandPool;
+	vk::CommandBufferLevel mLevel;
+	atomic<CommandBufferState> mState; // polled by whichever thread checks a resource or recycles the pool
 
-	shared_ptr<Fence> mFence;
+	shared_ptr<TimelinePoint> mCompletion;
 	unordered_set<shared_ptr<Semaphore>> mSignalSemaphores;
 	unordered_map<shared_ptr<Semaphore>, vk::PipelineStageFlags> mWaitSemaphores;
 
-	unordered_set<shared_ptr<DeviceResource>> mHeldResources;
+	uint64_t mRecordingId; // unique across command buffers, and renewed whenever mHeldResources is cleared
+	vector<shared_ptr<DeviceResource>> mHeldResources; // may contain duplicates if another recording touched a resource in between
+	vector<function<void()>> mCompletionHandlers;
+	unordered_set<const Image*> mTransitionedImages; // only tracked for secondary command buffers
 
 	// Currently bound objects
 	shared_ptr<Framebuffer> mBoundFramebuffer;
@@ -305,11 +362,17 @@ private:
 };
 
 inline bool DeviceResource::in_use() {
-	while (!mTracking.empty()) {
-		if (!(*mTracking.begin())->clear_if_done())
+	while (true) {
+		CommandBuffer* commandBuffer;
+		{
+			// clear_if_done removes the command buffer from mTracking, so it is called without the lock
+			scoped_lock l(mTrackingMutex);
+			if (mTracking.empty()) return false;
+			commandBuffer = mTracking.front();
+		}
+		if (!commandBuffer->clear_if_done())
 			return true;
 	}
-	return !mTracking.empty();
 }
 
 class ProfilerRegion {
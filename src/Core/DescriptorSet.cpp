@@ -4,6 +4,7 @@
 using namespace stm;
 
 void DescriptorSet::flush_writes() {
+  scoped_lock l(mWriteMutex);
   if (mPendingWrites.empty()) return;
 
   vector<variant<vk::DescriptorImageInfo, vk::DescriptorBufferInfo, vk::WriteDescriptorSetInlineUniformBlockEXT, vk::WriteDescriptorSetAccelerationStructureKHR>> infos;
@@ -72,6 +73,7 @@ void DescriptorSet::flush_writes() {
 }
 
 void DescriptorSet::transition_images(CommandBuffer& commandBuffer, const vk::PipelineStageFlags& dstStage) const {
+  scoped_lock l(mWriteMutex);
   for (auto& [arrayIndex, d] : mDescriptors)
     if (d.index() == 0) {
       const Image::View img = get<Image::View>(d);
@@ -89,6 +89,7 @@ private:
 	
 	unordered_map<uint64_t/*{binding,arrayIndex}*/, Descriptor> mDescriptors;
 	unordered_set<uint64_t> mPendingWrites;
+	mutable mutex mWriteMutex; // guards writes, so that a set can be updated and bound from command buffers recorded on different threads
 
 public:
 	inline DescriptorSet(shared_ptr<const DescriptorSetLayout> layout, const string& name) : DeviceResource(layout->mDevice, name), mLayout(layout) {
@@ -133,10 +134,18 @@ public:
 	inline const Descriptor& at(uint32_t binding, uint32_t arrayIndex = 0) const { return mDescriptors.at((uint64_t(binding)<<32)|arrayIndex); }
 	inline const Descriptor& operator[](uint32_t binding) const { return at(binding); }
 
+	// Descriptors identical to the one already written are skipped, so persistent sets can be re-assigned every frame
 	inline void insert_or_assign(uint32_t binding, uint32_t arrayIndex, const Descriptor& entry) {
 		uint64_t key = (uint64_t(binding)<<32)|arrayIndex;
+		scoped_lock l(mWriteMutex);
+		auto it = mDescriptors.find(key);
+		if (it == mDescriptors.end())
+			mDescriptors.emplace(key, entry);
+		else if (it->second == entry)
+			return;
+		else
+			it->second = entry;
 		mPendingWrites.emplace(key);
-		mDescriptors[key] = entry;
 	}
 	inline void insert_or_assign(uint32_t binding, const Descriptor& entry) { insert_or_assign(binding, 0, entry); }
 
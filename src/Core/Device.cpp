@@ -8,8 +8,28 @@
 
 using namespace stm;
 
+static atomic<uint64_t> gDeviceCount = 0;
+
+// Picks the family that supports every flag in queueFlags with the fewest other capabilities.
+// Graphics and compute families support transfers whether or not they report it
+static Device::QueueFamily* select_queue_family(unordered_map<uint32_t, Device::QueueFamily>& queueFamilies, vk::QueueFlags queueFlags) {
+	Device::QueueFamily* best = nullptr;
+	int bestCount = numeric_limits<int>::max();
+	for (auto& [queueFamilyIndex, family] : queueFamilies) {
+		vk::QueueFlags flags = family.mProperties.queueFlags;
+		if (flags & (vk::QueueFlagBits::eGraphics|vk::QueueFlagBits::eCompute)) flags |= vk::QueueFlagBits::eTransfer;
+		if ((flags & queueFlags) != queueFlags) continue;
+		const int count = popcount((VkQueueFlags)flags);
+		if (count < bestCount) {
+			best = &family;
+			bestCount = count;
+		}
+	}
+	return best;
+}
+
 Device::Device(stm::Instance& instance, vk::PhysicalDevice physicalDevice, const unordered_set<string>& deviceExtensions, const vector<const char*>& validationLayers)
-	: mPhysicalDevice(physicalDevice), mInstance(instance) {
+	: mPhysicalDevice(physicalDevice), mInstance(instance), mId(gDeviceCount++) {
 
 	vk::PhysicalDeviceProperties properties = mPhysicalDevice.getProperties();
 	mLimits = properties.limits;
@@ -39,6 +59,7 @@ Device::Device(stm::Instance& instance, vk::PhysicalDevice physicalDevice, const
 	mFeatures.samplerAnisotropy = true;
 	mFeatures.shaderImageGatherExtended = true;
 	mFeatures.shaderStorageImageExtendedFormats = true;
+	mFeatures.shaderStorageImageWriteWithoutFormat = mPhysicalDevice.getFeatures().shaderStorageImageWriteWithoutFormat; // typed storage formats are used otherwise
 	mFeatures.wideLines = true;
 	mFeatures.largePoints = true;
 	mFeatures.sampleRateShading = true;
@@ -56,13 +77,31 @@ Device::Device(stm::Instance& instance, vk::PhysicalDevice physicalDevice, const
 	difeatures.shaderUniformTexelBufferArrayNonUniformIndexing = true;
 	difeatures.shaderStorageTexelBufferArrayNonUniformIndexing = true;
 	difeatures.descriptorBindingPartiallyBound = true;
+	// unbounded, update-after-bind tables are enabled where supported. Users of unbounded tables check runtimeDescriptorArray
+	{
+		auto supported = mPhysicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceDescriptorIndexingFeatures>().get<vk::PhysicalDeviceDescriptorIndexingFeatures>();
+		difeatures.runtimeDescriptorArray = supported.runtimeDescriptorArray;
+		difeatures.descriptorBindingSampledImageUpdateAfterBind = supported.descriptorBindingSampledImageUpdateAfterBind;
+		difeatures.descriptorBindingStorageBufferUpdateAfterBind = supported.descriptorBindingStorageBufferUpdateAfterBind;
+		difeatures.descriptorBindingUpdateUnusedWhilePending = supported.descriptorBindingUpdateUnusedWhilePending;
+	}
 	get<vk::PhysicalDeviceBufferDeviceAddressFeatures>(mFeatureChain).bufferDeviceAddress = deviceExtensions.contains(VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME);
 	get<vk::PhysicalDeviceAccelerationStructureFeaturesKHR>(mFeatureChain).accelerationStructure = deviceExtensions.contains(VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME);
 	auto& rtfeatures = get<vk::PhysicalDeviceRayTracingPipelineFeaturesKHR>(mFeatureChain);
 	rtfeatures.rayTracingPipeline = deviceExtensions.contains(VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME);
 	rtfeatures.rayTraversalPrimitiveCulling = rtfeatures.rayTracingPipeline;
+	get<vk::PhysicalDeviceTimelineSemaphoreFeatures>(mFeatureChain).timelineSemaphore = true;
 	get<vk::PhysicalDeviceRayQueryFeaturesKHR>(mFeatureChain).rayQuery = deviceExtensions.contains(VK_KHR_RAY_QUERY_EXTENSION_NAME);
-	//get<vk::PhysicalDeviceShaderAtomicFloatFeaturesEXT>(mFeatureChain).shaderBufferFloat32AtomicAdd = deviceExtensions.contains(VK_EXT_SHADER_ATOMIC_FLOAT_EXTENSION_NAME);
+	// buffer atomics are enabled where supported, and their users fall back to narrower atomics otherwise
+	{
+		auto supported = mPhysicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceShaderAtomicInt64Features>();
+		mFeatures.shaderInt64 = supported.get<vk::PhysicalDeviceFeatures2>().features.shaderInt64;
+		get<vk::PhysicalDeviceShaderAtomicInt64Features>(mFeatureChain).shaderBufferInt64Atomics = mFeatures.shaderInt64 && supported.get<vk::PhysicalDeviceShaderAtomicInt64Features>().shaderBufferInt64Atomics;
+	}
+	if (deviceExtensions.contains(VK_EXT_SHADER_ATOMIC_FLOAT_EXTENSION_NAME)) {
+		auto supported = mPhysicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceShaderAtomicFloatFeaturesEXT>();
+		get<vk::PhysicalDeviceShaderAtomicFloatFeaturesEXT>(mFeatureChain).shaderBufferFloat32AtomicAdd = supported.get<vk::PhysicalDeviceShaderAtomicFloatFeaturesEXT>().shaderBufferFloat32AtomicAdd;
+	}
 
 	auto& createInfo = get<vk::DeviceCreateInfo>(mFeatureChain);
 	createInfo.setQueueCreateInfos(queueCreateInfos);
@@ -111,14 +150,17 @@ Device::Device(stm::Instance& instance, vk::PhysicalDevice physicalDevice, const
     vk::DescriptorPoolSize(vk::DescriptorType::eStorageBufferDynamic, 	min(16384u, mLimits.maxDescriptorSetStorageBuffersDynamic))
 	};
 	{
+		vk::DescriptorPoolCreateFlags poolFlags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet;
+		if (difeatures.descriptorBindingSampledImageUpdateAfterBind || difeatures.descriptorBindingStorageBufferUpdateAfterBind)
+			poolFlags |= vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind;
 		auto descriptorPool = mDescriptorPool.lock();
-		*descriptorPool = mDevice.createDescriptorPool(vk::DescriptorPoolCreateInfo(vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet, 8192, poolSizes));
+		*descriptorPool = mDevice.createDescriptorPool(vk::DescriptorPoolCreateInfo(poolFlags, 8192, poolSizes));
 		set_debug_name(*descriptorPool, name);
 	}
 	#pragma endregion
 
 	for (const vk::DeviceQueueCreateInfo& info : queueCreateInfos) {
-		QueueFamily q = { *this };
+		QueueFamily& q = mQueueFamilies.lock()->try_emplace(info.queueFamilyIndex, *this).first->second;
 		q.mFamilyIndex = info.queueFamilyIndex;
 		q.mProperties = queueFamilyProperties[info.queueFamilyIndex];
 		q.mSurfaceSupport = mPhysicalDevice.getSurfaceSupportKHR(info.queueFamilyIndex, mInstance.window().surface());
@@ -127,7 +169,14 @@ Device::Device(stm::Instance& instance, vk::PhysicalDevice physicalDevice, const
 			q.mQueues.emplace_back(mDevice.getQueue(info.queueFamilyIndex, i));
 			set_debug_name(q.mQueues[i], "DeviceQueue"+to_string(i));
 		}
-		mQueueFamilies.lock()->emplace(q.mFamilyIndex, q);
+		vk::SemaphoreTypeCreateInfo timelineInfo(vk::SemaphoreType::eTimeline, 0);
+		q.mTimeline = mDevice.createSemaphore(vk::SemaphoreCreateInfo({}, &timelineInfo));
+		set_debug_name(q.mTimeline, "Timeline"+to_string(info.queueFamilyIndex));
+	}
+	{
+		auto queueFamilies = mQueueFamilies.lock();
+		for (uint32_t i = 0; i < mQueueFamilyLookup.size(); i++)
+			mQueueFamilyLookup[i] = select_queue_family(*queueFamilies, (vk::QueueFlags)i);
 	}
 
 	VmaAllocatorCreateInfo allocatorInfo = {};
@@ -145,15 +194,20 @@ Device::Device(stm::Instance& instance, vk::PhysicalDevice physicalDevice, const
 Device::~Device() {
 	flush();
 
+	mMipGenerationPipelines.lock()->clear();
+
 	for (auto[qp,count,labels] : mTimestamps)
 		mDevice.destroyQueryPool(qp);
 
 	auto queueFamilies = mQueueFamilies.lock();
 	for (auto& [idx, queueFamily] : *queueFamilies) {
-		for (auto&[tid, p] : queueFamily.mCommandBuffers) {
-			p.second.clear();
-			mDevice.destroyCommandPool(p.first);
+		for (auto&[tid, pool] : queueFamily.mCommandPools) {
+			pool->mInFlight.clear();
+			for (auto& idle : pool->mIdle)
+				idle.clear();
+			mDevice.destroyCommandPool(pool->mCommandPool);
 		}
+		mDevice.destroySemaphore(queueFamily.mTimeline);
 	}
 	queueFamilies->clear();
 
@@ -187,42 +241,64 @@ void Device::create_query_pools(uint32_t queryCount) {
 }
 tuple<vk::QueryPool,uint32_t,vector<string>>& Device::query_pool() { return mTimestamps[mInstance.window().back_buffer_index()]; }
 
-shared_ptr<CommandBuffer> Device::get_command_buffer(const string& name, vk::QueueFlags queueFlags, vk::CommandBufferLevel level) {
-	ProfilerRegion ps("CommandBuffer::get_command_buffer");
-	// find most specific queue family
-	QueueFamily* queueFamily = nullptr;
+Device::CommandPool& Device::command_pool(QueueFamily& queueFamily) {
+	// each thread remembers the pools it has used, so that the queue family lock is only taken the first time
+	static thread_local vector<tuple<uint64_t, uint32_t, CommandPool*>> tCommandPools;
+	for (const auto&[deviceId, familyIndex, pool] : tCommandPools)
+		if (deviceId == mId && familyIndex == queueFamily.mFamilyIndex)
+			return *pool;
+
 	auto queueFamilies = mQueueFamilies.lock();
-	for (auto& [queueFamilyIndex, family] : *queueFamilies)
-		if (family.mProperties.queueFlags & queueFlags)
-			queueFamily = &family;
+	unique_ptr<CommandPool>& pool = queueFamily.mCommandPools[this_thread::get_id()];
+	if (!pool) {
+		pool = make_unique<CommandPool>();
+		pool->mCommandPool = mDevice.createCommandPool(vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eResetCommandBuffer, queueFamily.mFamilyIndex));
+		set_debug_name(pool->mCommandPool, "CommandPool");
+	}
+	tCommandPools.emplace_back(mId, queueFamily.mFamilyIndex, pool.get());
+	return *pool;
+}
 
+shared_ptr<CommandBuffer> Device::get_command_buffer(const string& name, vk::QueueFlags queueFlags, vk::CommandBufferLevel level) {
+	ProfilerRegion ps("CommandBuffer::get_command_buffer");
+	QueueFamily* queueFamily = (VkQueueFlags)queueFlags < mQueueFamilyLookup.size() ? mQueueFamilyLookup[(VkQueueFlags)queueFlags] : nullptr;
 	if (queueFamily == nullptr) throw invalid_argument("invalid queueFlags " + to_string(queueFlags));
 
-	auto& [commandPool,commandBuffers] = queueFamily->mCommandBuffers[this_thread::get_id()];
-	if (!commandPool) {
-		commandPool = mDevice.createCommandPool(vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eResetCommandBuffer, queueFamily->mFamilyIndex));
-		set_debug_name(commandPool, "CommandPool");
-	}
+	CommandPool& pool = command_pool(*queueFamily);
 
 	shared_ptr<CommandBuffer> commandBuffer;
-	if (level == vk::CommandBufferLevel::ePrimary) {
-		for (auto it = commandBuffers.begin(); it != commandBuffers.end();) {
-			if ((*it)->clear_if_done() && it->use_count() == 1) {
-				commandBuffer = *it;
-				commandBuffers.erase(it);
-				break;
-			} else
-				it++;
+	// references dropped from mInFlight are released after the lock, since releasing the last one locks pool.mMutex in ~CommandBuffer.
+	// completion handlers are also called after the lock, so that a slow one only delays this thread
+	vector<shared_ptr<CommandBuffer>> released;
+	vector<function<void()>> handlers;
+	{
+		scoped_lock l(pool.mMutex);
+		// the timeline is reached in submission order, so only the oldest command buffers need to be polled
+		while (!pool.mInFlight.empty() && pool.mInFlight.front()->clear_if_done(&handlers)) {
+			// command buffers that are still referenced elsewhere are left to their owners
+			if (pool.mInFlight.front().use_count() == 1)
+				pool.mIdle[(uint32_t)pool.mInFlight.front()->level()].emplace_back(move(pool.mInFlight.front()));
+			else
+				released.emplace_back(move(pool.mInFlight.front()));
+			pool.mInFlight.pop_front();
+		}
+		vector<shared_ptr<CommandBuffer>>& idle = pool.mIdle[(uint32_t)level];
+		if (!idle.empty()) {
+			commandBuffer = move(idle.back());
+			idle.pop_back();
 		}
 	}
+	for (const function<void()>& fn : handlers)
+		fn();
 	if (commandBuffer)
 		commandBuffer->reset(name);
 	else
-		commandBuffer = make_shared<CommandBuffer>(*queueFamily, name, level);
+		commandBuffer = make_shared<CommandBuffer>(*queueFamily, pool, name, level);
 	return commandBuffer;
 }
 void Device::submit(const shared_ptr<CommandBuffer>& commandBuffer) {
 	ProfilerRegion ps("CommandBuffer::submit");
+	if (commandBuffer->level() != vk::CommandBufferLevel::ePrimary) throw invalid_argument("secondary command buffers must be executed by a primary command buffer");
 
 	(*commandBuffer)->end();
 
@@ -235,20 +311,42 @@ void Device::submit(const shared_ptr<CommandBuffer>& commandBuffer) {
 		waitStages.push_back(stage);
 	}
 
-	vector<vk::Semaphore> signalSemaphores(commandBuffer->mSignalSemaphores.size());
+	QueueFamily& queueFamily = commandBuffer->mQueueFamily;
+
+	// the family's timeline is signaled last; binary semaphores ignore their values
+	vector<vk::Semaphore> signalSemaphores(commandBuffer->mSignalSemaphores.size() + 1);
 	ranges::transform(commandBuffer->mSignalSemaphores, signalSemaphores.begin(), [](const shared_ptr<Semaphore>& s) { return **s; });
+	signalSemaphores.back() = queueFamily.mTimeline;
+	vector<uint64_t> signalValues(signalSemaphores.size(), 0);
+	const vector<uint64_t> waitValues(waitSemaphores.size(), 0);
 
-	commandBuffer->mQueueFamily.mQueues[0].submit(vk::SubmitInfo(waitSemaphores, waitStages, **commandBuffer, signalSemaphores), **commandBuffer->mFence);
+	{
+		// timeline values must be submitted in increasing order
+		scoped_lock l(queueFamily.mSubmitMutex);
+		signalValues.back() = ++queueFamily.mSubmittedValue;
+		vk::TimelineSemaphoreSubmitInfo timelineInfo(waitValues, signalValues);
+		vk::SubmitInfo submitInfo(waitSemaphores, waitStages, **commandBuffer, signalSemaphores);
+		submitInfo.pNext = &timelineInfo;
+		queueFamily.mQueues[0].submit(submitInfo);
+	}
+	commandBuffer->mCompletion->mValue = signalValues.back();
 	commandBuffer->mState = CommandBuffer::CommandBufferState::eInFlight;
 
-	scoped_lock l(mQueueFamilies.m());
-	commandBuffer->mQueueFamily.mCommandBuffers.at(this_thread::get_id()).second.emplace_back(commandBuffer);
+	scoped_lock l(commandBuffer->mCommandPool.mMutex);
+	commandBuffer->mCommandPool.mInFlight.emplace_back(commandBuffer);
 }
 void Device::flush() {
 	mDevice.waitIdle();
-	auto queueFamilies = mQueueFamilies.lock();
-	for (auto& [idx,queueFamily] : *queueFamilies)
-		for (auto& [tid,p] : queueFamily.mCommandBuffers)
-			for (auto& commandBuffer : p.second)
-				commandBuffer->clear_if_done();
+	vector<function<void()>> handlers;
+	{
+		auto queueFamilies = mQueueFamilies.lock();
+		for (auto& [idx,queueFamily] : *queueFamilies)
+			for (auto& [tid,pool] : queueFamily.mCommandPools) {
+				scoped_lock l(pool->mMutex);
+				for (auto& commandBuffer : pool->mInFlight)
+					commandBuffer->clear_if_done(&handlers);
+			}
+	}
+	for (const function<void()>& fn : handlers)
+		fn();
 }
\ No newline at end of file
@@ -3,17 +3,21 @@
 #include "Instance.hpp"
 #include <Common/locked_object.hpp>
 #include <vk_mem_alloc.h>
+#include <atomic>
 
 namespace stm {
 
 class CommandBuffer;
 class Semaphore;
+class ComputePipelineState;
 
 class DeviceResource {
 private:
 	friend class CommandBuffer;
 	string mName;
-	unordered_set<CommandBuffer*> mTracking;
+	vector<CommandBuffer*> mTracking; // command buffers that hold this resource; rarely more than a few
+	mutex mTrackingMutex; // command buffers recorded on different threads may hold the same resource
+	atomic<uint64_t> mLastRecording = 0; // CommandBuffer::mRecordingId of the last command buffer that held this resource
 public:
 	Device& mDevice;
 	inline DeviceResource(Device& device, const string& name) : mDevice(device), mName(name) {}
@@ -62,14 +66,49 @@ public:
 		inline vk::MemoryRequirements requirements() const { return mRequirements; }
 	};
 
+	// Command buffers allocated by one thread from one queue family. Only the owning thread acquires command buffers from it,
+	// so mMutex is only contended by submits, flush() and command buffers released on other threads
+	struct CommandPool {
+		vk::CommandPool mCommandPool;
+		mutex mMutex;
+		// in submission order, which is the order the timeline reaches them in. Secondary command buffers are added when a primary executes them,
+		// and complete with that primary
+		deque<shared_ptr<CommandBuffer>> mInFlight;
+		array<vector<shared_ptr<CommandBuffer>>, 2> mIdle; // indexed by vk::CommandBufferLevel
+	};
+
 	struct QueueFamily {
 		Device& mDevice;
 		uint32_t mFamilyIndex = 0;
 		vector<vk::Queue> mQueues;
 		vk::QueueFamilyProperties mProperties;
 		bool mSurfaceSupport;
-		// CommandBuffers may be in-flight or idle
-		unordered_map<thread::id, pair<vk::CommandPool, list<shared_ptr<CommandBuffer>>>> mCommandBuffers;
+		unordered_map<thread::id, unique_ptr<CommandPool>> mCommandPools;
+
+		// Every submission to this family signals the next value of mTimeline, so a single counter tells which submissions are done
+		vk::Semaphore mTimeline;
+		uint64_t mSubmittedValue = 0; // guarded by mSubmitMutex
+		mutex mSubmitMutex;
+		atomic<uint64_t> mCompletedValue = 0; // last value read from mTimeline
+
+		inline QueueFamily(Device& device) : mDevice(device) {}
+
+		// The timeline is only queried when the cached value is behind
+		inline bool reached(uint64_t value) {
+			if (mCompletedValue.load(memory_order_relaxed) >= value) return true;
+			const uint64_t completed = mDevice->getSemaphoreCounterValue(mTimeline);
+			uint64_t cached = mCompletedValue.load(memory_order_relaxed);
+			while (cached < completed && !mCompletedValue.compare_exchange_weak(cached, completed, memory_order_relaxed)) {}
+			return completed >= value;
+		}
+		inline void wait(uint64_t value) {
+			if (reached(value)) return;
+			vk::SemaphoreWaitInfo info;
+			info.semaphoreCount = 1;
+			info.pSemaphores = &mTimeline;
+			info.pValues = &value;
+			(void)mDevice->waitSemaphores(info, numeric_limits<uint64_t>::max());
+		}
 	};
 
 	stm::Instance& mInstance;
@@ -96,6 +135,7 @@ public:
 	inline const vk::PhysicalDeviceRayTracingPipelineFeaturesKHR& ray_tracing_pipeline_features() const  { return get<vk::PhysicalDeviceRayTracingPipelineFeaturesKHR>(mFeatureChain); }
 	inline const vk::PhysicalDeviceRayQueryFeaturesKHR& ray_query_features() const  { return get<vk::PhysicalDeviceRayQueryFeaturesKHR>(mFeatureChain); }
 	inline const vk::PhysicalDeviceShaderAtomicFloatFeaturesEXT& shader_atomic_float_features() const  { return get<vk::PhysicalDeviceShaderAtomicFloatFeaturesEXT>(mFeatureChain); }
+	inline const vk::PhysicalDeviceShaderAtomicInt64Features& shader_atomic_int64_features() const  { return get<vk::PhysicalDeviceShaderAtomicInt64Features>(mFeatureChain); }
 
 	template<typename T> inline vk::DeviceSize min_uniform_buffer_offset_alignment() {
 		return (sizeof(T) + mLimits.minUniformBufferOffsetAlignment - 1) & ~(mLimits.minUniformBufferOffsetAlignment - 1);
@@ -129,11 +169,14 @@ public:
 	STRATUM_API void flush();
 
 private:
+	CommandPool& command_pool(QueueFamily& queueFamily);
+
 	friend class Instance;
 	friend class DescriptorSet;
 	friend class CommandBuffer;
 	friend class DescriptorSetLayout;
 	friend class Pipeline;
+	friend class Image;
 	vk::Device mDevice;
  	vk::PhysicalDevice mPhysicalDevice;
 	VmaAllocator mAllocator;
@@ -147,16 +190,23 @@ private:
 		vk::PhysicalDeviceAccelerationStructureFeaturesKHR,
 		vk::PhysicalDeviceRayTracingPipelineFeaturesKHR,
 		vk::PhysicalDeviceRayQueryFeaturesKHR,
-		vk::PhysicalDeviceShaderAtomicFloatFeaturesEXT
+		vk::PhysicalDeviceShaderAtomicFloatFeaturesEXT,
+		vk::PhysicalDeviceShaderAtomicInt64Features,
+		vk::PhysicalDeviceTimelineSemaphoreFeatures
 	> mFeatureChain;
 	vk::PhysicalDeviceLimits mLimits;
 
+	uint64_t mId; // unique across devices, so that per-thread caches never match a destroyed device
 	locked_object<unordered_map<uint32_t, QueueFamily>> mQueueFamilies;
+	array<QueueFamily*, 32> mQueueFamilyLookup; // most specific queue family for each combination of the graphics, compute, transfer, sparse and protected bits
 	locked_object<vk::DescriptorPool> mDescriptorPool;
 	uint32_t mDescriptorSetCount = 0;
 
 	vector<tuple<vk::QueryPool,uint32_t,vector<string>>> mTimestamps;
 	bool mEnableTimestamps = false;
+
+	// created by the first Image::generate_mip_maps that uses them, keyed on the storage format of the typed variants (eUndefined for the untyped one)
+	locked_object<unordered_map<vk::Format, shared_ptr<ComputePipelineState>>> mMipGenerationPipelines;
 };
 
 }
\ No newline at end of file
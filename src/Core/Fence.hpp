@@ -26,6 +26,24 @@ public:
 	}
 };
 
+// A value on a queue family's timeline semaphore. The command buffer that hands it out assigns mValue when it is submitted,
+// and the value is reached once that command buffer finishes executing
+struct TimelinePoint {
+	Device::QueueFamily& mQueueFamily;
+	atomic<uint64_t> mValue = 0; // polled from other threads by secondary command buffers that complete with this point
+
+	inline TimelinePoint(Device::QueueFamily& queueFamily) : mQueueFamily(queueFamily) {}
+
+	// false until the command buffer is submitted
+	inline bool done() const {
+		const uint64_t value = mValue;
+		return value && mQueueFamily.reached(value);
+	}
+	inline void wait() const {
+		if (const uint64_t value = mValue) mQueueFamily.wait(value);
+	}
+};
+
 class Semaphore : public DeviceResource {
 private:
 	vk::Semaphore mSemaphore;
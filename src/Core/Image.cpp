@@ -2,7 +2,9 @@
 
 #include "Buffer.hpp"
 #include "CommandBuffer.hpp"
-#include "Pipeline.hpp"
+#include "PipelineState.hpp"
+
+#include <Common/thread_pool.hpp>
 
 #define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_WRITE_IMPLEMENTATION
@@ -57,8 +59,239 @@ inline vk::Format dxgi_to_vulkan(tinyddsloader::DDSFile::DXGIFormat format, cons
 	}
 }
 
+// Decoded pixels are cached alongside the uploaded images, so concurrent loads of the same file only decode it once
+struct CachedImageData {
+	weak_ptr<Buffer> mBuffer;
+	vk::Format mFormat;
+	vk::Extent3D mExtent;
+
+	inline CachedImageData(const ImageData& data) : mBuffer(data.pixels.buffer()), mFormat(data.pixels.format()), mExtent(data.extent) {}
+	inline optional<ImageData> lock() const {
+		if (shared_ptr<Buffer> buf = mBuffer.lock())
+			return ImageData{Buffer::TexelView(buf, mFormat), mExtent};
+		return nullopt;
+	}
+};
+
+// Entries are futures, so that a request for a key that is still being created waits for it instead of creating it again
+template<typename Weak>
+using cache_map_t = unordered_map<ImageCache::Key, shared_future<Weak>>;
+static locked_object<cache_map_t<CachedImageData>> gImageDataCache;
+static locked_object<cache_map_t<weak_ptr<Image>>> gImageCache;
+
+template<typename Weak>
+inline bool expired(const shared_future<Weak>& f) {
+	return f.wait_for(chrono::seconds(0)) == future_status::ready && !f.get().lock();
+}
+
+// Returns the live value cached for key, or calls create and caches the result. The cache is only locked for the lookup and the insert
+template<typename Weak, typename F>
+static auto find_or_create_cached(locked_object<cache_map_t<Weak>>& cache, const ImageCache::Key& key, F&& create) {
+	using Value = decltype(declval<const Weak&>().lock());
+	promise<Weak> result;
+	for (;;) {
+		shared_future<Weak> f;
+		{
+			auto c = cache.lock();
+			if (auto it = c->find(key); it != c->end() && !expired(it->second))
+				f = it->second;
+			else {
+				erase_if(*c, [](const auto& p) { return expired(p.second); });
+				c->insert_or_assign(key, result.get_future().share());
+				break;
+			}
+		}
+		// the value may have been released since it was created, in which case the entry is replaced on the next pass
+		if (Value v = f.get().lock())
+			return v;
+	}
+	try {
+		auto v = create();
+		result.set_value(Weak(v));
+		return Value(move(v));
+	} catch (...) {
+		cache.lock()->erase(key);
+		result.set_exception(current_exception());
+		throw;
+	}
+}
+
+ImageCache::Key ImageCache::make_key(Device& device, const fs::path& filename, bool srgb, int desiredChannels, uint32_t levelCount, vk::ImageUsageFlags usage, const string& subresource) {
+	const fs::path path = fs::canonical(filename);
+	Key key;
+	key.mDevice = &device;
+	key.mPath = path.string() + subresource;
+	key.mWriteTime = fs::last_write_time(path).time_since_epoch().count();
+	key.mSrgb = srgb;
+	key.mDesiredChannels = desiredChannels;
+	key.mLevelCount = levelCount;
+	key.mUsage = (VkImageUsageFlags)usage;
+	return key;
+}
+
+shared_ptr<Image> ImageCache::find(const Key& key) {
+	auto cache = gImageCache.lock();
+	if (auto it = cache->find(key); it != cache->end() && it->second.wait_for(chrono::seconds(0)) == future_status::ready)
+		return it->second.get().lock();
+	return nullptr;
+}
+shared_ptr<Image> ImageCache::find_or_create(const Key& key, const function<shared_ptr<Image>()>& create) {
+	return find_or_create_cached(gImageCache, key, create);
+}
+
+Image::View load_image(CommandBuffer& commandBuffer, const fs::path& filename, bool srgb, int desiredChannels, uint32_t levelCount, vk::ImageUsageFlags usage) {
+	if (!fs::exists(filename)) throw invalid_argument("File does not exist: " + filename.string());
+	return ImageCache::find_or_create(ImageCache::make_key(commandBuffer.mDevice, filename, srgb, desiredChannels, levelCount, usage), [&]() {
+		return make_shared<Image>(commandBuffer, filename.filename().string(), load_image_data(commandBuffer.mDevice, filename, srgb, desiredChannels), levelCount, usage);
+	});
+}
+
+static ImageData decode_image_data(Device& device, const fs::path& filename, bool srgb, int desiredChannels);
+
 ImageData load_image_data(Device& device, const fs::path& filename, bool srgb, int desiredChannels) {
 	if (!fs::exists(filename)) throw invalid_argument("File does not exist: " + filename.string());
+	return *find_or_create_cached(gImageDataCache, ImageCache::make_key(device, filename, srgb, desiredChannels), [&]() {
+		return decode_image_data(device, filename, srgb, desiredChannels);
+	});
+}
+
+// Estimates the size of the pixels decode_image_data produces for filename from the file's header, without decoding it
+static size_t decoded_size_estimate(const fs::path& filename, int desiredChannels) {
+	error_code ec;
+	const size_t fileSize = fs::file_size(filename, ec);
+	if (ec) return 0;
+	const string path = filename.string();
+	if (filename.extension() == ".exr") {
+		EXRVersion version;
+		EXRHeader header;
+		InitEXRHeader(&header);
+		const char* err = nullptr;
+		if (ParseEXRVersionFromFile(&version, path.c_str()) != TINYEXR_SUCCESS) return fileSize;
+		if (ParseEXRHeaderFromFile(&header, &version, path.c_str(), &err) != TINYEXR_SUCCESS) {
+			if (err) FreeEXRErrorMessage(err);
+			return fileSize;
+		}
+		const size_t size = (size_t)(header.data_window.max_x - header.data_window.min_x + 1) * (header.data_window.max_y - header.data_window.min_y + 1) * sizeof(float)*4;
+		FreeEXRHeader(&header);
+		return size;
+	} else if (filename.extension() == ".dds")
+		return fileSize;
+	int x, y, channels;
+	if (!stbi_info(path.c_str(), &x, &y, &channels)) return fileSize;
+	if (desiredChannels) channels = desiredChannels;
+	if (channels == 3) channels = 4;
+	const size_t channelSize = stbi_is_hdr(path.c_str()) ? sizeof(float) : stbi_is_16_bit(path.c_str()) ? sizeof(uint16_t) : 1;
+	return (size_t)x*y*channels*channelSize;
+}
+
+ImageDecoder::ImageDecoder(Device& device, size_t stagingBudget) : mDevice(device), mStagingBudget(stagingBudget) {
+	if (mStagingBudget == 0) {
+		mStagingBudget = 1024;
+		if (auto arg = mDevice.mInstance.find_argument("stagingBudget"); arg) mStagingBudget = max(atoll(arg->c_str()), 1ll);
+		mStagingBudget *= 1024*1024;
+	}
+}
+ImageDecoder::~ImageDecoder() {
+	// decodes that were never collected still reference mDevice
+	for (auto&[key, r] : mRequests)
+		if (r.mResult.valid()) r.mResult.wait();
+	if (mUploadCommands) mDevice.submit(mUploadCommands);
+}
+
+void ImageDecoder::request(const fs::path& filename, bool srgb, int desiredChannels) {
+	const RequestKey key(filename, srgb, desiredChannels);
+	if (mRequests.contains(key) || !fs::exists(filename)) return;
+	mRequests.emplace(key, Request{ decoded_size_estimate(filename, desiredChannels), {} });
+	mPending.emplace_back(key);
+	start_pending();
+}
+
+void ImageDecoder::reserve(const size_t size) {
+	if (mReserved > 0 && mReserved + size > mStagingBudget && mUploadSize > 0)
+		flush_uploads();
+}
+
+void ImageDecoder::flush_uploads() {
+	ProfilerRegion ps("ImageDecoder::flush_uploads");
+	mDevice.submit(mUploadCommands);
+	mUploadCommands->completion()->wait();
+	// frees the staged pixels now, rather than whenever the device polls it next
+	mUploadCommands->clear_if_done();
+	mUploadCommands.reset();
+	mReserved -= mUploadSize;
+	mUploadSize = 0;
+}
+
+void ImageDecoder::start_pending() {
+	while (!mPending.empty()) {
+		Request& r = mRequests.at(mPending.front());
+		reserve(r.mSize);
+		// always allow one decode in flight, so that an image larger than the budget still gets decoded
+		if (mReserved > 0 && mReserved + r.mSize > mStagingBudget) break;
+		mReserved += r.mSize;
+		const auto&[filename, srgb, desiredChannels] = mPending.front();
+		r.mResult = thread_pool::global().push([&device = mDevice, filename, srgb, desiredChannels]() {
+			return load_image_data(device, filename, srgb, desiredChannels);
+		}).share();
+		mPending.pop_front();
+	}
+}
+
+ImageData ImageDecoder::get(const fs::path& filename, bool srgb, int desiredChannels, size_t& size) {
+	auto it = mRequests.find(RequestKey(filename, srgb, desiredChannels));
+	if (it == mRequests.end()) {
+		size = decoded_size_estimate(filename, desiredChannels);
+		reserve(size);
+		mReserved += size;
+		return load_image_data(mDevice, filename, srgb, desiredChannels);
+	}
+
+	size = it->second.mSize;
+	shared_future<ImageData> result = it->second.mResult;
+	if (!result.valid()) {
+		mPending.erase(ranges::find(mPending, it->first));
+		reserve(size);
+		mReserved += size;
+	}
+	mRequests.erase(it);
+	try {
+		const ImageData data = result.valid() ? result.get() : load_image_data(mDevice, filename, srgb, desiredChannels);
+		start_pending();
+		return data;
+	} catch (...) {
+		mReserved -= size;
+		start_pending();
+		throw;
+	}
+}
+
+Image::View ImageDecoder::load_image(CommandBuffer& commandBuffer, const fs::path& filename, bool srgb, int desiredChannels, uint32_t levelCount, vk::ImageUsageFlags usage) {
+	if (!fs::exists(filename)) throw invalid_argument("File does not exist: " + filename.string());
+	const ImageCache::Key key = ImageCache::make_key(commandBuffer.mDevice, filename, srgb, desiredChannels, levelCount, usage);
+	if (shared_ptr<Image> img = ImageCache::find(key)) {
+		// the image was uploaded by someone else; drop the request, waiting for its decode if it started, so its budget is released
+		if (auto it = mRequests.find(RequestKey(filename, srgb, desiredChannels)); it != mRequests.end()) {
+			if (it->second.mResult.valid()) {
+				it->second.mResult.wait();
+				mReserved -= it->second.mSize;
+			} else
+				mPending.erase(ranges::find(mPending, it->first));
+			mRequests.erase(it);
+			start_pending();
+		}
+		return img;
+	}
+	return ImageCache::find_or_create(key, [&]() {
+		size_t size;
+		const ImageData pixels = get(filename, srgb, desiredChannels, size);
+		if (!mUploadCommands) mUploadCommands = mDevice.get_command_buffer("ImageDecoder", commandBuffer.queue_family().mProperties.queueFlags);
+		// the pixels stay alive, and reserved, until mUploadCommands is done
+		mUploadSize += size;
+		return make_shared<Image>(*mUploadCommands, filename.filename().string(), pixels, levelCount, usage);
+	});
+}
+
+static ImageData decode_image_data(Device& device, const fs::path& filename, bool srgb, int desiredChannels) {
 	if (filename.extension() == ".exr") {
 		float* data = nullptr;
 		int width;
@@ -132,10 +365,46 @@ ImageData load_image_data(Device& device, const fs::path& filename, bool srgb, i
 	}
 }
 
+void write_image_data(const fs::path& filename, const vk::Extent2D& extent, const float* pixels) {
+	const string path = filename.string();
+	const string ext = filename.extension().string();
+	int ret;
+	if (ext == ".exr") {
+		const char* err = nullptr;
+		ret = SaveEXR(pixels, extent.width, extent.height, 4, 0, path.c_str(), &err);
+		if (ret != TINYEXR_SUCCESS) {
+			std::cerr << "OpenEXR error: " << err << std::endl;
+			FreeEXRErrorMessage(err);
+		}
+		ret = ret == TINYEXR_SUCCESS;
+	} else if (ext == ".hdr")
+		ret = stbi_write_hdr(path.c_str(), extent.width, extent.height, 4, pixels);
+	else if (ext == ".png" || ext == ".jpg") {
+		vector<uint8_t> ldr((size_t)extent.width*extent.height*4);
+		for (size_t i = 0; i < ldr.size(); i++) {
+			float c = clamp(pixels[i], 0.f, 1.f);
+			if (i % 4 != 3) c = c <= 0.0031308f ? c * 12.92f : 1.055f * pow(c, 1/2.4f) - 0.055f;
+			ldr[i] = (uint8_t)(c * 255 + 0.5f);
+		}
+		if (ext == ".png")
+			ret = stbi_write_png(path.c_str(), extent.width, extent.height, 4, ldr.data(), extent.width*4);
+		else
+			ret = stbi_write_jpg(path.c_str(), extent.width, extent.height, 4, ldr.data(), 95);
+	} else
+		throw invalid_argument("Unsupported image format: " + ext);
+	if (!ret) throw runtime_error("Failure when writing image: " + path);
+	cout << "Wrote " << filename << " (" << extent.width << "x" << extent.height << ")" << endl;
+}
+
 // If mipLevels = 0, will auto-determine according to extent
 Image::Image(CommandBuffer& commandBuffer, const string& name, const ImageData& pixels, uint32_t mipCount, vk::ImageUsageFlags usage, VmaMemoryUsage memoryUsage, vk::ImageTiling tiling)
 		: DeviceResource(commandBuffer.mDevice, name), mExtent(pixels.extent), mFormat(pixels.pixels.format()), mLayerCount(1), mSampleCount(vk::SampleCountFlagBits::e1), mUsage(vk::ImageUsageFlagBits::eTransferDst|vk::ImageUsageFlagBits::eTransferSrc|usage), 
 		mLevelCount(mipCount?mipCount:max_mips(pixels.extent)), mType(vk::ImageType::e2D), mTiling(tiling) {
+	if (mLevelCount > 1) {
+		const auto[mipUsage, mipCreateFlags] = compute_mip_flags(mDevice, mFormat);
+		mUsage |= mipUsage;
+		mCreateFlags |= mipCreateFlags;
+	}
 	init_state();
 	create();
 	mMemory = make_shared<Device::MemoryAllocation>(mDevice, mDevice->getImageMemoryRequirements(mImage), memoryUsage);
@@ -170,13 +439,9 @@ void Image::init_state() {
 		break;
 	}
 
-	uint32_t aspectMask = (uint32_t)mAspect;
-	while (aspectMask) {
-		uint32_t aspect = 1 << countr_zero(aspectMask);
-		aspectMask &= ~aspect;
-		for (uint32_t layer = 0; layer < mLayerCount; layer++)	
-			for (uint32_t level = 0; level < mLevelCount; level++)	
-				tracked_state((vk::ImageAspectFlags)aspect, layer, level) = make_tuple(vk::ImageLayout::eUndefined, vk::PipelineStageFlagBits::eTopOfPipe, vk::AccessFlags{});
+	for (AspectState& s : mTrackedState) {
+		s.mUniformState = TrackedState{ vk::ImageLayout::eUndefined, vk::PipelineStageFlagBits::eTopOfPipe, vk::AccessFlags{} };
+		s.mSubresources.clear();
 	}
 }
 void Image::create() {
@@ -196,39 +461,229 @@ void Image::create() {
 	mDevice.set_debug_name(mImage, name());
 }
 
-void Image::transition_barrier(CommandBuffer& commandBuffer, vk::PipelineStageFlags dstStage, vk::ImageLayout newLayout, vk::AccessFlags accessFlags, vk::ImageSubresourceRange subresourceRange) {
+Image::AspectState& Image::tracked_state(uint32_t aspect) {
+	const uint32_t i = countr_zero(aspect);
+	if (i >= mTrackedState.size()) throw invalid_argument("Image " + name() + ": transitions of aspect " + to_string((vk::ImageAspectFlagBits)aspect) + " are not supported");
+	return mTrackedState[i];
+}
+
+void Image::update_tracked_state(vk::ImageSubresourceRange subresourceRange, const TrackedState& state) {
 	if (subresourceRange.levelCount == 0) subresourceRange.levelCount = mLevelCount - subresourceRange.baseMipLevel;
 	if (subresourceRange.layerCount == 0) subresourceRange.layerCount = mLayerCount - subresourceRange.baseArrayLayer;
+	const bool wholeImage = subresourceRange.baseMipLevel == 0 && subresourceRange.levelCount == mLevelCount && subresourceRange.baseArrayLayer == 0 && subresourceRange.layerCount == mLayerCount;
 	uint32_t aspectMask = (subresourceRange.aspectMask == vk::ImageAspectFlags{0}) ? (uint32_t)mAspect : (uint32_t)subresourceRange.aspectMask;
 	while (aspectMask) {
 		uint32_t aspect = 1 << countr_zero(aspectMask);
 		aspectMask &= ~aspect;
+		AspectState& tracked = tracked_state(aspect);
+		if (wholeImage) {
+			tracked.mUniformState = state;
+			tracked.mSubresources.clear();
+			continue;
+		}
+		if (tracked.mSubresources.empty()) {
+			if (tracked.mUniformState == state) continue;
+			tracked.mSubresources.assign(mLayerCount*mLevelCount, tracked.mUniformState);
+		}
+		for (uint32_t layer = subresourceRange.baseArrayLayer; layer < subresourceRange.baseArrayLayer+subresourceRange.layerCount; layer++)
+			ranges::fill_n(tracked.mSubresources.begin() + layer*mLevelCount + subresourceRange.baseMipLevel, subresourceRange.levelCount, state);
+		// back to a single state once every subresource agrees again
+		if (ranges::all_of(tracked.mSubresources, [&](const TrackedState& s) { return s == state; })) {
+			tracked.mUniformState = state;
+			tracked.mSubresources.clear();
+		}
+	}
+}
+
+uint32_t Image::transition_barrier(CommandBuffer& commandBuffer, vk::PipelineStageFlags dstStage, vk::ImageLayout newLayout, vk::AccessFlags accessFlags, vk::ImageSubresourceRange subresourceRange) {
+	if (subresourceRange.levelCount == 0) subresourceRange.levelCount = mLevelCount - subresourceRange.baseMipLevel;
+	if (subresourceRange.layerCount == 0) subresourceRange.layerCount = mLayerCount - subresourceRange.baseArrayLayer;
+	if (subresourceRange.aspectMask == vk::ImageAspectFlags{0}) subresourceRange.aspectMask = mAspect;
+
+	// the barrier is recorded under the lock too, so that concurrent transitions of one image each see the state the other left
+	scoped_lock l(mTrackedStateMutex);
+
+	auto needs_barrier = [&](const TrackedState& s) {
+		return s.mLayout != newLayout || s.mAccess != accessFlags || (s.mAccess & vk::AccessFlagBits::eShaderWrite) || (accessFlags & vk::AccessFlagBits::eShaderWrite);
+	};
+
+	// subresources in the same state are coalesced into one barrier: runs of levels within a layer first,
+	// then consecutive layers whose runs are identical
+	vector<vk::ImageMemoryBarrier> barriers;
+	vk::PipelineStageFlags srcStage;
+	auto add_barrier = [&](const TrackedState& s, uint32_t aspect, uint32_t layer, uint32_t layerCount, uint32_t level, uint32_t levelCount) {
+		barriers.emplace_back(s.mAccess, accessFlags, s.mLayout, newLayout, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, mImage,
+			vk::ImageSubresourceRange((vk::ImageAspectFlags)aspect, level, levelCount, layer, layerCount));
+		srcStage |= s.mStage;
+	};
+
+	uint32_t aspectMask = (uint32_t)subresourceRange.aspectMask;
+	while (aspectMask) {
+		uint32_t aspect = 1 << countr_zero(aspectMask);
+		aspectMask &= ~aspect;
+		const AspectState& tracked = tracked_state(aspect);
+
+		if (tracked.mSubresources.empty()) {
+			if (needs_barrier(tracked.mUniformState))
+				add_barrier(tracked.mUniformState, aspect, subresourceRange.baseArrayLayer, subresourceRange.layerCount, subresourceRange.baseMipLevel, subresourceRange.levelCount);
+			continue;
+		}
+
+		size_t prevLayerBegin = barriers.size();
+		size_t prevLayerEnd = barriers.size();
 		for (uint32_t layer = subresourceRange.baseArrayLayer; layer < subresourceRange.baseArrayLayer+subresourceRange.layerCount; layer++) {
-			for (uint32_t level = subresourceRange.baseMipLevel; level < subresourceRange.baseMipLevel+subresourceRange.levelCount; level++) {
-				auto& state = tracked_state((vk::ImageAspectFlags)aspect, layer, level);
-				if (get<vk::ImageLayout>(state) != newLayout || get<vk::AccessFlags>(state) != accessFlags || (get<vk::AccessFlags>(state) & vk::AccessFlagBits::eShaderWrite) || (accessFlags & vk::AccessFlagBits::eShaderWrite)) {
-					vk::ImageMemoryBarrier b;
-					b.image = mImage;
-					b.newLayout = newLayout;
-					b.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-					b.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-					b.dstAccessMask = accessFlags;
-					b.oldLayout = get<vk::ImageLayout>(state);
-					b.subresourceRange.aspectMask = (vk::ImageAspectFlags)aspect;
-					b.subresourceRange.baseArrayLayer = layer;
-					b.subresourceRange.layerCount = 1;
-					b.subresourceRange.baseMipLevel = level;
-					b.subresourceRange.levelCount = 1;
-					b.srcAccessMask = get<vk::AccessFlags>(state);
-					commandBuffer.barrier(b, get<vk::PipelineStageFlags>(state), dstStage);
-				}
-				state = make_tuple(newLayout, dstStage, accessFlags);
+			const size_t layerBegin = barriers.size();
+			const uint32_t levelEnd = subresourceRange.baseMipLevel + subresourceRange.levelCount;
+			for (uint32_t level = subresourceRange.baseMipLevel; level < levelEnd;) {
+				const TrackedState& s = tracked.mSubresources[layer*mLevelCount + level];
+				uint32_t count = 1;
+				while (level + count < levelEnd && tracked.mSubresources[layer*mLevelCount + level + count] == s) count++;
+				if (needs_barrier(s)) add_barrier(s, aspect, layer, 1, level, count);
+				level += count;
+			}
+
+			const size_t n = barriers.size() - layerBegin;
+			const bool sameAsPrevLayer = n > 0 && n == prevLayerEnd - prevLayerBegin && ranges::equal(
+				ranges::subrange(barriers.begin() + layerBegin, barriers.end()),
+				ranges::subrange(barriers.begin() + prevLayerBegin, barriers.begin() + prevLayerEnd),
+				[](const vk::ImageMemoryBarrier& a, const vk::ImageMemoryBarrier& b) {
+					return a.oldLayout == b.oldLayout && a.srcAccessMask == b.srcAccessMask &&
+						a.subresourceRange.baseMipLevel == b.subresourceRange.baseMipLevel && a.subresourceRange.levelCount == b.subresourceRange.levelCount;
+				});
+			if (sameAsPrevLayer) {
+				for (size_t i = prevLayerBegin; i < prevLayerEnd; i++)
+					barriers[i].subresourceRange.layerCount++;
+				barriers.resize(layerBegin);
+			} else {
+				prevLayerBegin = layerBegin;
+				prevLayerEnd = barriers.size();
 			}
 		}
 	}
+
+	if (!barriers.empty())
+		commandBuffer.barrier(barriers, srcStage, dstStage);
+
+	update_tracked_state(subresourceRange, TrackedState{ newLayout, dstStage, accessFlags });
+	// secondaries may be recorded concurrently, and their barriers are only valid if no other secondary of the batch transitions this image
+	if (commandBuffer.level() == vk::CommandBufferLevel::eSecondary) commandBuffer.mTransitionedImages.emplace(this);
+	return (uint32_t)barriers.size();
+}
+
+// sRGB formats are written through a UNORM view by the compute mip generator
+static vk::Format mip_storage_format(vk::Format format) {
+	switch (format) {
+	default: return format;
+	case vk::Format::eR8Srgb: return vk::Format::eR8Unorm;
+	case vk::Format::eR8G8Srgb: return vk::Format::eR8G8Unorm;
+	case vk::Format::eR8G8B8Srgb: return vk::Format::eR8G8B8Unorm;
+	case vk::Format::eB8G8R8Srgb: return vk::Format::eB8G8R8Unorm;
+	case vk::Format::eR8G8B8A8Srgb: return vk::Format::eR8G8B8A8Unorm;
+	case vk::Format::eB8G8R8A8Srgb: return vk::Format::eB8G8R8A8Unorm;
+	case vk::Format::eA8B8G8R8SrgbPack32: return vk::Format::eA8B8G8R8UnormPack32;
+	}
 }
 
-void Image::generate_mip_maps(CommandBuffer& commandBuffer) {
+// Shader variant of the compute mip generator for storageFormat: eUndefined for the untyped variant, which needs shaderStorageImageWriteWithoutFormat,
+// or the storage format of a typed variant. Returns nullopt if there is no variant the device can use
+static optional<vk::Format> mip_shader_format(Device& device, vk::Format storageFormat) {
+	if (device.features().shaderStorageImageWriteWithoutFormat) return vk::Format::eUndefined;
+	switch (storageFormat) {
+	default: return nullopt;
+	case vk::Format::eR8G8B8A8Unorm:
+	case vk::Format::eR16G16B16A16Sfloat:
+	case vk::Format::eR32G32B32A32Sfloat:
+		return storageFormat;
+	}
+}
+
+pair<vk::ImageUsageFlags, vk::ImageCreateFlags> Image::compute_mip_flags(Device& device, vk::Format format) {
+	const vk::Format storageFormat = mip_storage_format(format);
+	if (!mip_shader_format(device, storageFormat) ||
+		  !(device.physical().getFormatProperties(format).optimalTilingFeatures & vk::FormatFeatureFlagBits::eSampledImage) ||
+		  !(device.physical().getFormatProperties(storageFormat).optimalTilingFeatures & vk::FormatFeatureFlagBits::eStorageImage))
+		return {};
+	if (storageFormat == format)
+		return { vk::ImageUsageFlagBits::eStorage, {} };
+	else
+		return { vk::ImageUsageFlagBits::eStorage, vk::ImageCreateFlagBits::eMutableFormat|vk::ImageCreateFlagBits::eExtendedUsage };
+}
+
+void Image::generate_mip_maps(CommandBuffer& commandBuffer, float alphaCutoff) {
+	if (mLevelCount <= 1) return;
+
+	const auto[mipUsage, mipCreateFlags] = compute_mip_flags(mDevice, mFormat);
+	if (mipUsage && (mUsage & mipUsage) == mipUsage && (mCreateFlags & mipCreateFlags) == mipCreateFlags && (mUsage & vk::ImageUsageFlagBits::eSampled) &&
+		mType == vk::ImageType::e2D && mSampleCount == vk::SampleCountFlagBits::e1 && !(mCreateFlags & vk::ImageCreateFlagBits::eCubeCompatible)) {
+		ProfilerRegion ps("Image::generate_mip_maps", commandBuffer);
+
+		const vk::Format storageFormat = mip_storage_format(mFormat);
+		const vk::Format shaderFormat = *mip_shader_format(mDevice, storageFormat);
+
+		// the pipeline states are shared by the device, so they stay locked while their descriptors are in flux
+		auto pipelines = mDevice.mMipGenerationPipelines.lock();
+		shared_ptr<ComputePipelineState>& p = (*pipelines)[shaderFormat];
+		if (!p) {
+			string shader = "Shaders/generate_mips.spv";
+			switch (shaderFormat) {
+			default: break;
+			case vk::Format::eR8G8B8A8Unorm:       shader = "Shaders/generate_mips_main_rgba8.spv"; break;
+			case vk::Format::eR16G16B16A16Sfloat:  shader = "Shaders/generate_mips_main_rgba16f.spv"; break;
+			case vk::Format::eR32G32B32A32Sfloat:  shader = "Shaders/generate_mips_main_rgba32f.spv"; break;
+			}
+			p = make_shared<ComputePipelineState>("generate_mips", make_shared<Shader>(mDevice, shader));
+		}
+		ComputePipelineState& pipeline = *p;
+
+		const uint32_t maxMips = pipeline.descriptor_count("gMips");
+		pipeline.specialization_constant<uint32_t>("gSrgb") = storageFormat != mFormat;
+		pipeline.specialization_constant<uint32_t>("gPreserveAlphaCoverage") = alphaCutoff > 0;
+		pipeline.push_constant<float>("gAlphaCutoff") = alphaCutoff;
+		commandBuffer.bind_pipeline(pipeline.get_pipeline());
+
+		// a dispatch reduces its base level in 64x64 tiles, and only the last group continues past the sixth level, so it covers 12 levels if its base is at most 4096x4096
+		vector<pair<uint32_t, uint32_t>> dispatches; // base level, level count
+		for (uint32_t base = 0; base + 1 < mLevelCount;) {
+			const uint32_t s = 1 << base;
+			const uint32_t count = min(max(mExtent.width/s, mExtent.height/s) > 4096 ? maxMips/2 : maxMips, mLevelCount - 1 - base);
+			dispatches.emplace_back(base, count);
+			base += count;
+		}
+
+		Buffer::View<float4> intermediate = make_shared<Buffer>(mDevice, "generate_mips/Intermediate", 64*64*sizeof(float4), vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_GPU_ONLY);
+		vector<Buffer::View<uint32_t>> counters(dispatches.size()*mLayerCount);
+		for (Buffer::View<uint32_t>& c : counters) {
+			c = make_shared<Buffer>(mDevice, "generate_mips/Counters", 2*sizeof(uint32_t), vk::BufferUsageFlagBits::eStorageBuffer|vk::BufferUsageFlagBits::eTransferDst, VMA_MEMORY_USAGE_GPU_ONLY);
+			commandBuffer->fillBuffer(**commandBuffer.hold_resource(c).buffer(), c.offset(), c.size_bytes(), 0);
+		}
+		commandBuffer.hold_resource(intermediate);
+		commandBuffer.barrier<uint32_t>(counters, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderRead|vk::AccessFlagBits::eShaderWrite);
+
+		const shared_ptr<Image> self = shared_from_this();
+		for (uint32_t layer = 0; layer < mLayerCount; layer++)
+			for (uint32_t i = 0; i < dispatches.size(); i++) {
+				const auto[base, count] = dispatches[i];
+				if (layer > 0 || i > 0)
+					commandBuffer.barrier({intermediate}, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderRead|vk::AccessFlagBits::eShaderWrite, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderRead|vk::AccessFlagBits::eShaderWrite);
+
+				const Image::View src(self, base, 1, layer, 1, {}, {}, vk::ImageViewType::e2D);
+				pipeline.descriptor("gSource") = image_descriptor(src, vk::ImageLayout::eShaderReadOnlyOptimal, vk::AccessFlagBits::eShaderRead);
+				for (uint32_t level = 0; level < maxMips; level++) {
+					// unused levels are never written, but must still be bound
+					const Image::View dst(self, vk::ImageSubresourceRange(mAspect, base + 1 + min(level, count - 1), 1, layer, 1), {}, vk::ImageViewType::e2D, storageFormat);
+					pipeline.descriptor("gMips", level) = image_descriptor(dst, vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderWrite);
+				}
+				pipeline.descriptor("gCounters") = counters[layer*dispatches.size() + i];
+				pipeline.descriptor("gIntermediate") = intermediate;
+				pipeline.push_constant<uint2>("gExtent") = uint2(src.extent().width, src.extent().height);
+				pipeline.push_constant<uint32_t>("gMipCount") = count;
+				pipeline.bind_descriptor_sets(commandBuffer);
+				pipeline.push_constants(commandBuffer);
+				commandBuffer->dispatch((src.extent().width + 63)/64, (src.extent().height + 63)/64, 1);
+			}
+		return;
+	}
+
 	transition_barrier(commandBuffer, vk::ImageLayout::eTransferDstOptimal);
 	vk::ImageBlit blit = {};
 	blit.srcOffsets[0] = blit.dstOffsets[0] = vk::Offset3D(0, 0, 0);
@@ -252,18 +707,18 @@ void Image::generate_mip_maps(CommandBuffer& commandBuffer) {
 	}
 }
 
-Image::View::View(const shared_ptr<Image>& image, const vk::ImageSubresourceRange& subresource, const vk::ComponentMapping& components, vk::ImageViewType type)
-	: mImage(image), mSubresource(subresource), mComponents(components) {
+Image::View::View(const shared_ptr<Image>& image, const vk::ImageSubresourceRange& subresource, const vk::ComponentMapping& components, vk::ImageViewType type, vk::Format format)
+	: mImage(image), mSubresource(subresource), mComponents(components), mFormat(format == vk::Format::eUndefined ? image->format() : format) {
 	if (mSubresource.aspectMask == (vk::ImageAspectFlags)0) mSubresource.aspectMask = image->aspect();
 	if (mSubresource.levelCount == 0) mSubresource.levelCount = image->level_count();
 	if (mSubresource.layerCount == 0) mSubresource.layerCount = image->layer_count();
-	auto key = make_pair(mSubresource, mComponents);
+	auto key = make_tuple(mSubresource, mComponents, mFormat);
 	if (auto it = image->mViews.find(key); it != image->mViews.end())
 		mView = it->second;
 	else {
 		vk::ImageViewCreateInfo info = {};
 		info.image = **mImage;
-		info.format = mImage->format();
+		info.format = mFormat;
 		info.subresourceRange = mSubresource;
 		info.components = components;
 		if (type == (vk::ImageViewType)VK_IMAGE_VIEW_TYPE_MAX_ENUM) {
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Buffer.hpp"
+#include <future>
 
 namespace stm {
 
@@ -30,9 +31,12 @@ struct ImageData {
 	Buffer::TexelView pixels;
 	vk::Extent3D extent;
 };
+// Decoded pixels are cached and shared between callers, so they must not be written to
 STRATUM_API ImageData load_image_data(Device& device, const fs::path& filename, bool srgb = true, int desiredChannels = 0);
+// Encodes RGBA32F pixels to filename, in the format given by its extension (.exr, .hdr, .png or .jpg). PNG and JPG are clamped and sRGB encoded
+STRATUM_API void write_image_data(const fs::path& filename, const vk::Extent2D& extent, const float* pixels);
 
-class Image : public DeviceResource {
+class Image : public DeviceResource, public enable_shared_from_this<Image> {
 public:
 	static constexpr uint32_t max_mips(const vk::Extent3D& extent) {
 		return 32 - (uint32_t)countl_zero(max(max(extent.width, extent.height), extent.depth));
@@ -107,12 +111,17 @@ public:
 	inline const vk::ImageCreateFlags& create_flags() const { return mCreateFlags; }
 	inline const vk::ImageType& type() const { return mType; }
 
-	// Image must support vk::ImageLayout::eTransferSrcOptimal and vk::ImageLayout::eTransferDstOptimal
-	STRATUM_API void generate_mip_maps(CommandBuffer& commandBuffer);
+	// Generates every level from level 0 in a single compute dispatch when the image has eStorage usage and its format (or, for sRGB formats
+	// created with eMutableFormat, its UNORM equivalent) supports storage. Otherwise falls back to blits, which require eTransferSrc and eTransferDst usage.
+	// If alphaCutoff > 0, the alpha of each level is scaled so the fraction of texels passing an alpha test against alphaCutoff matches level 0 (compute path only)
+	STRATUM_API void generate_mip_maps(CommandBuffer& commandBuffer, float alphaCutoff = 0);
+	// Usage and create flags that let generate_mip_maps use the compute path for an image of the given format, or empty flags if it can't
+	STRATUM_API static pair<vk::ImageUsageFlags, vk::ImageCreateFlags> compute_mip_flags(Device& device, vk::Format format);
 	
-	STRATUM_API void transition_barrier(CommandBuffer& commandBuffer, vk::PipelineStageFlags dstStage, vk::ImageLayout newLayout, vk::AccessFlags accessFlag, vk::ImageSubresourceRange subresourceRange = {});
-	inline void transition_barrier(CommandBuffer& commandBuffer, vk::ImageLayout newLayout, vk::ImageSubresourceRange subresourceRange = {}) {
-		transition_barrier(commandBuffer, guess_stage(newLayout), newLayout, guess_access_flags(newLayout), subresourceRange);
+	// Returns the number of barriers recorded
+	STRATUM_API uint32_t transition_barrier(CommandBuffer& commandBuffer, vk::PipelineStageFlags dstStage, vk::ImageLayout newLayout, vk::AccessFlags accessFlag, vk::ImageSubresourceRange subresourceRange = {});
+	inline uint32_t transition_barrier(CommandBuffer& commandBuffer, vk::ImageLayout newLayout, vk::ImageSubresourceRange subresourceRange = {}) {
+		return transition_barrier(commandBuffer, guess_stage(newLayout), newLayout, guess_access_flags(newLayout), subresourceRange);
 	}
 	
 	class View {
@@ -121,11 +130,13 @@ public:
 		shared_ptr<Image> mImage;
 		vk::ImageSubresourceRange mSubresource;
 		vk::ComponentMapping mComponents;
+		vk::Format mFormat = vk::Format::eUndefined;
 
 	public:
 		View() = default;
 		View(const View&) = default;
-		STRATUM_API View(const shared_ptr<Image>& image, const vk::ImageSubresourceRange& subresource, const vk::ComponentMapping& components = {}, vk::ImageViewType type = (vk::ImageViewType)VK_IMAGE_VIEW_TYPE_MAX_ENUM);
+		// If format is eUndefined, uses the image's format. Other formats require the image to be created with eMutableFormat
+		STRATUM_API View(const shared_ptr<Image>& image, const vk::ImageSubresourceRange& subresource, const vk::ComponentMapping& components = {}, vk::ImageViewType type = (vk::ImageViewType)VK_IMAGE_VIEW_TYPE_MAX_ENUM, vk::Format format = vk::Format::eUndefined);
 		inline View(const shared_ptr<Image>& image, uint32_t baseMip=0, uint32_t mipCount=0, uint32_t baseLayer=0, uint32_t layerCount=0, vk::ImageAspectFlags aspect=(vk::ImageAspectFlags)0, const vk::ComponentMapping& components={}, vk::ImageViewType type = (vk::ImageViewType)VK_IMAGE_VIEW_TYPE_MAX_ENUM)
 			: View(image, vk::ImageSubresourceRange(aspect, baseMip, mipCount, baseLayer, layerCount), components, type) {};
 
@@ -140,6 +151,7 @@ public:
 		inline const auto& image() const { return mImage; }
 		inline const vk::ImageSubresourceRange& subresource_range() const { return mSubresource; }
 		inline const vk::ComponentMapping& components() const { return mComponents; }
+		inline const vk::Format& format() const { return mFormat; }
 		inline vk::ImageSubresourceLayers subresource(uint32_t level) const {
 			return vk::ImageSubresourceLayers(mSubresource.aspectMask, mSubresource.baseMipLevel + level, mSubresource.baseArrayLayer, mSubresource.layerCount);
 		}
@@ -179,18 +191,116 @@ private:
 	vk::ImageType mType;
 	vk::ImageTiling mTiling;
 	
-	unordered_map<pair<vk::ImageSubresourceRange, vk::ComponentMapping>, vk::ImageView> mViews;
+	unordered_map<tuple<vk::ImageSubresourceRange, vk::ComponentMapping, vk::Format>, vk::ImageView> mViews;
 	
-	unordered_map<size_t, tuple<vk::ImageLayout, vk::PipelineStageFlags, vk::AccessFlags>> mTrackedState;
-	inline tuple<vk::ImageLayout, vk::PipelineStageFlags, vk::AccessFlags>& tracked_state(vk::ImageAspectFlags aspect, uint32_t layer, uint32_t level) {
-		return mTrackedState[hash_args(aspect, layer, level)];
+	struct TrackedState {
+		vk::ImageLayout mLayout;
+		vk::PipelineStageFlags mStage;
+		vk::AccessFlags mAccess;
+		bool operator==(const TrackedState&) const = default;
+	};
+	// Tracked state of each aspect bit up to plane 2 (color, depth, stencil, metadata, planes 0-2). mSubresources is empty while every layer and level
+	// of the aspect shares mUniformState, otherwise it holds one state per layer*mLevelCount + level
+	struct AspectState {
+		TrackedState mUniformState;
+		vector<TrackedState> mSubresources;
+	};
+	array<AspectState, 7> mTrackedState;
+	mutex mTrackedStateMutex; // images may be transitioned by command buffers recorded on different threads
+	inline void set_tracked_state(const vk::ImageSubresourceRange& subresourceRange, const TrackedState& state) {
+		scoped_lock l(mTrackedStateMutex);
+		update_tracked_state(subresourceRange, state);
 	}
+	STRATUM_API void update_tracked_state(vk::ImageSubresourceRange subresourceRange, const TrackedState& state); // mTrackedStateMutex must be held
+	STRATUM_API AspectState& tracked_state(uint32_t aspect);
+};
+
+}
+
+namespace stm {
+
+// Process-wide cache of images created from files, keyed on the file's canonical path and write time plus the parameters used to load it.
+// Entries are weak references, so an image is only shared for as long as something else holds on to it.
+class ImageCache {
+public:
+	struct Key {
+		Device* mDevice;
+		string mPath; // canonical path, optionally followed by a subresource name
+		int64_t mWriteTime;
+		bool mSrgb;
+		int mDesiredChannels;
+		uint32_t mLevelCount;
+		VkImageUsageFlags mUsage;
+		bool operator==(const Key&) const = default;
+	};
+
+	STRATUM_API static Key make_key(Device& device, const fs::path& filename, bool srgb, int desiredChannels = 0, uint32_t levelCount = 0, vk::ImageUsageFlags usage = {}, const string& subresource = "");
+
+	// Returns the live image for key, or nullptr if there is none or it is still being created
+	STRATUM_API static shared_ptr<Image> find(const Key& key);
+	// Returns the live image for key, or calls create and caches the result. Concurrent calls for a key that is being created wait for it
+	STRATUM_API static shared_ptr<Image> find_or_create(const Key& key, const function<shared_ptr<Image>()>& create);
+};
+
+// Loads and uploads an image file through ImageCache. If mipLevels = 0, will auto-determine according to extent
+STRATUM_API Image::View load_image(CommandBuffer& commandBuffer, const fs::path& filename, bool srgb = true, int desiredChannels = 0, uint32_t levelCount = 0, vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eSampled);
+
+// Decodes image files on thread_pool::global() ahead of their upload. Decodes start in request order for as long as the estimated size
+// of the pixels that are decoding, decoded, or waiting on their upload stays within the staging budget. Uploads are recorded into
+// command buffers of the decoder's own, and once the budget is spent the current one is submitted and waited on so that its pixels are freed.
+// A scene with many large textures therefore never holds more than the budget (or the largest image) in host memory at once.
+// Not thread-safe: requests and uploads are meant to be issued by a single loader thread
+class ImageDecoder {
+public:
+	// stagingBudget is in bytes. If 0, the stagingBudget argument (in MiB) is used, or 1 GiB if it is absent
+	STRATUM_API ImageDecoder(Device& device, size_t stagingBudget = 0);
+	// Submits the uploads that are still recorded, so the decoder must be destroyed before command buffers that use its images are submitted
+	STRATUM_API ~ImageDecoder();
+	ImageDecoder(const ImageDecoder&) = delete;
+	ImageDecoder(ImageDecoder&&) = delete;
+
+	// Queues filename for decoding. Repeated requests are ignored
+	STRATUM_API void request(const fs::path& filename, bool srgb = true, int desiredChannels = 0);
+	// Same as stm::load_image, but takes the pixels from a requested decode, and records the upload on commandBuffer's queue family in a command buffer of the decoder's own
+	STRATUM_API Image::View load_image(CommandBuffer& commandBuffer, const fs::path& filename, bool srgb = true, int desiredChannels = 0, uint32_t levelCount = 0, vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eSampled);
+
+	inline size_t staging_budget() const { return mStagingBudget; }
+
+private:
+	using RequestKey = tuple<fs::path, bool, int>;
+	struct Request {
+		size_t mSize; // estimated size of the decoded pixels
+		shared_future<ImageData> mResult; // invalid until the decode is started
+	};
+
+	Device& mDevice;
+	size_t mStagingBudget;
+	size_t mReserved = 0;
+	map<RequestKey, Request> mRequests;
+	deque<RequestKey> mPending;
+
+	shared_ptr<CommandBuffer> mUploadCommands;
+	size_t mUploadSize = 0; // the part of mReserved held by mUploadCommands
+
+	// Makes room for size bytes by submitting the recorded uploads, if that frees anything
+	void reserve(size_t size);
+	void flush_uploads();
+	void start_pending();
+	// Waits for a requested decode, or decodes filename on the calling thread if it was never requested. Its size stays reserved until the upload is done
+	ImageData get(const fs::path& filename, bool srgb, int desiredChannels, size_t& size);
 };
 
 }
 
 namespace std {
 
+template<>
+struct hash<stm::ImageCache::Key> {
+	inline size_t operator()(const stm::ImageCache::Key& k) const {
+		return stm::hash_args(k.mDevice, k.mPath, k.mWriteTime, k.mSrgb, k.mDesiredChannels, k.mLevelCount, k.mUsage);
+	}
+};
+
 template<>
 struct hash<stm::Image::View> {
 	inline size_t operator()(const stm::Image::View& v) const {
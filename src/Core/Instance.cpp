@@ -234,6 +234,10 @@ void Instance::create_device(vk::PhysicalDevice physicalDevice) {
 	}
 	if (deviceExtensions.contains(VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME))
 		deviceExtensions.emplace(VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME);
+	// float atomics are optional, so they are enabled whenever the device has them
+	for (const vk::ExtensionProperties& e : physicalDevice.enumerateDeviceExtensionProperties())
+		if (strcmp(e.extensionName.data(), VK_EXT_SHADER_ATOMIC_FLOAT_EXTENSION_NAME) == 0)
+			deviceExtensions.emplace(VK_EXT_SHADER_ATOMIC_FLOAT_EXTENSION_NAME);
 	vector<const char*> deviceExts;
 	for (const string& s : deviceExtensions) deviceExts.push_back(s.c_str());
 
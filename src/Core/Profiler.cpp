@@ -4,6 +4,7 @@
 
 using namespace stm;
 
+thread::id Profiler::mMainThread = this_thread::get_id();
 shared_ptr<Profiler::sample_t> Profiler::mCurrentSample;
 vector<pair<chrono::steady_clock::time_point, vector<pair<string,chrono::nanoseconds>>>> Profiler::mTimestamps;
 vector<shared_ptr<Profiler::sample_t>> Profiler::mSampleHistory;
@@ -20,7 +20,9 @@ public:
 			: mParent(parent), mColor(color), mLabel(label), mStartTime(chrono::high_resolution_clock::now()), mDuration(chrono::nanoseconds::zero()) {}
 	};
 
+	// Samples are only recorded on the thread that loaded the library, since the sample tree isn't synchronized
 	inline static void begin_sample(const string& label, const float4& color = float4::Ones()) {
+		if (this_thread::get_id() != mMainThread) return;
 		auto s = make_shared<sample_t>(mCurrentSample, label, color);
 		if (mCurrentSample)
 			mCurrentSample = mCurrentSample->mChildren.emplace_back(s);
@@ -28,6 +30,7 @@ public:
 			mCurrentSample = s;
 	}
 	inline static void end_sample() {
+		if (this_thread::get_id() != mMainThread) return;
 		if (!mCurrentSample) throw logic_error("cannot call end_sample without first calling begin_sample");
 		mCurrentSample->mDuration += chrono::high_resolution_clock::now() - mCurrentSample->mStartTime;
 		if (!mCurrentSample->mParent && mSampleHistory.size() < mSampleHistoryCount)
@@ -61,6 +64,7 @@ public:
 	STRATUM_API static void gpu_timestamp_gui();
 
 private:
+	STRATUM_API static thread::id mMainThread;
 	STRATUM_API static shared_ptr<sample_t> mCurrentSample;
 	STRATUM_API static vector<pair<chrono::steady_clock::time_point, vector<pair<string,chrono::nanoseconds>>>> mTimestamps;
 	STRATUM_API static vector<shared_ptr<sample_t>> mSampleHistory;
@@ -1,6 +1,7 @@
 #include "Application.hpp"
 #include "Scene.hpp"
 #include "Gui.hpp"
+#include <Common/thread_pool.hpp>
 
 namespace stm {
 
@@ -9,11 +10,25 @@ void Application::run() {
 
 	vector<chrono::steady_clock::time_point> submitTimes(mWindow.back_buffer_count());
 
+	// frames are paced on the queue's timeline, by waiting for the frame framesInFlight frames ago before starting a new one
+	uint32_t framesInFlight = 2;
+	if (auto arg = instance->find_argument("framesInFlight"); arg) framesInFlight = max(atoi(arg->c_str()), 1);
+	deque<shared_ptr<TimelinePoint>> pendingFrames;
+	// render-finished semaphores are reused per swapchain image, since an image is only acquired again once its last present is done with them
+	vector<shared_ptr<Semaphore>> renderFinishedSemaphores;
+
 	auto t0 = chrono::high_resolution_clock::now();
 	while (true) {
 		instance->poll_events();
-		if (!mWindow.handle()) break;
+		if (!mWindow.handle() || mQuit) break;
 		if (!mWindow.wants_repaint()) continue;
+
+		while (pendingFrames.size() >= framesInFlight) {
+			ProfilerRegion ps("Application::wait_for_frame");
+			pendingFrames.front()->wait();
+			pendingFrames.pop_front();
+		}
+
 		if (!mWindow.acquire_image()) continue;
 
 		Profiler::begin_frame();
@@ -64,6 +79,32 @@ void Application::run() {
 			OnUpdate(*commandBuffer, deltaTime);
 		}
 
+		if (!OnRecordParallel.empty()) {
+			ProfilerRegion ps("Application::OnRecordParallel");
+			const vector<Node::Event<CommandBuffer&, float>::function_t> listeners = OnRecordParallel.listeners();
+			vector<shared_ptr<CommandBuffer>> secondaries(listeners.size());
+			auto record = [&](size_t i) {
+				secondaries[i] = instance->device().get_command_buffer("OnRecordParallel", vk::QueueFlagBits::eGraphics, vk::CommandBufferLevel::eSecondary);
+				listeners[i](*secondaries[i], deltaTime);
+			};
+			// the first listener records on this thread while the rest run on the pool
+			vector<future<void>> recorded(listeners.size());
+			for (size_t i = 1; i < listeners.size(); i++)
+				recorded[i] = thread_pool::global().push([&record, i]() { record(i); });
+			if (!listeners.empty()) recorded[0] = async(launch::deferred, record, 0);
+			// every listener returns before an exception is rethrown, since they write to secondaries
+			for (future<void>& f : recorded) f.wait();
+			for (future<void>& f : recorded) f.get();
+			// image state is tracked in recording order, while the secondaries execute in listener order, so they only agree if no image is shared
+			unordered_map<const Image*, size_t> transitionedBy;
+			for (size_t i = 0; i < listeners.size(); i++)
+				for (const Image* image : secondaries[i]->transitioned_images())
+					if (const auto[it, inserted] = transitionedBy.emplace(image, i); !inserted)
+						throw logic_error("OnRecordParallel: image " + image->name() + " was transitioned by listeners " + to_string(it->second) + " and " + to_string(i));
+			for (const shared_ptr<CommandBuffer>& secondary : secondaries)
+				commandBuffer->execute(secondary);
+		}
+
 		{
 			ProfilerRegion ps("Application::OnRenderWindow");
 			OnRenderWindow(*commandBuffer);
@@ -74,11 +115,14 @@ void Application::run() {
 
 		commandBuffer->write_timestamp(vk::PipelineStageFlagBits::eBottomOfPipe, "");
 
-		auto cmd_semaphore = make_shared<Semaphore>(commandBuffer->mDevice, "cmd semaphore");
-		commandBuffer->signal_when_done(cmd_semaphore);
+		if (renderFinishedSemaphores.size() < mWindow.back_buffer_count()) renderFinishedSemaphores.resize(mWindow.back_buffer_count());
+		shared_ptr<Semaphore>& renderFinished = renderFinishedSemaphores[mWindow.back_buffer_index()];
+		if (!renderFinished) renderFinished = make_shared<Semaphore>(commandBuffer->mDevice, "RenderFinished" + to_string(mWindow.back_buffer_index()));
+		commandBuffer->signal_when_done(renderFinished);
 		commandBuffer->mDevice.submit(commandBuffer);
+		pendingFrames.emplace_back(commandBuffer->completion());
 		submitTimes[mWindow.back_buffer_index()] = chrono::high_resolution_clock::now();
-		mWindow.present(**cmd_semaphore);
+		mWindow.present(**renderFinished);
 
 		{
 			ProfilerRegion ps("Application::PostFrame");
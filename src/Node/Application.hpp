@@ -12,6 +12,10 @@ class Application {
 public:
 	Node::Event<> PreFrame;
 	Node::Event<CommandBuffer&, float> OnUpdate;
+	// Called after OnUpdate. Listeners run concurrently on worker threads, each recording into its own secondary command buffer,
+	// which the frame executes in listener order. Listeners must not share a PipelineState, and an image transitioned by more than one listener
+	// in a frame throws, since each listener's barriers are recorded against the state the others left, in whatever order they ran
+	Node::Event<CommandBuffer&, float> OnRecordParallel;
 	Node::Event<CommandBuffer&> OnRenderWindow;
 	Node::Event<> PostFrame;
 
@@ -23,9 +27,13 @@ public:
 	inline Node& node() const { return mNode; }
 	inline Window& window() const { return mWindow; }
 
+	// Ends run() before the next frame starts
+	inline void quit() { mQuit = true; }
+
 private:
 	Node& mNode;
 	Window& mWindow;
+	bool mQuit = false;
 };
 
 }
\ No newline at end of file
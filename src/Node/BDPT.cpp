@@ -2,7 +2,7 @@
 #include "Application.hpp"
 #include "Inspector.hpp"
 
-#include <stb_image_write.h>
+#include <Common/thread_pool.hpp>
 
 #include <random>
 
@@ -40,6 +40,14 @@ BDPT::BDPT(Node& node) : mNode(node) {
 	create_pipelines();
 }
 
+// layouts with update-after-bind bindings must be created with eUpdateAfterBindPool
+inline vk::DescriptorSetLayoutCreateFlags update_after_bind_flags(const unordered_map<uint32_t, DescriptorSetLayout::Binding>& bindings) {
+	for (const auto&[i, b] : bindings)
+		if (b.mBindingFlags & vk::DescriptorBindingFlagBits::eUpdateAfterBind)
+			return vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool;
+	return {};
+}
+
 void BDPT::create_pipelines() {
 	auto instance = mNode.find_in_ancestor<Instance>();
 
@@ -74,6 +82,11 @@ void BDPT::create_pipelines() {
 		mPushConstants.gHashGridBucketCount = 200000;
 		mPushConstants.gHashGridMinBucketRadius = 0.1f;
 		mPushConstants.gHashGridBucketPixelRadius = 6;
+		mPushConstants.gAdaptiveMaxSamples = 4;
+		mPushConstants.gAdaptiveThreshold = 1e-3f;
+		mPushConstants.gAdaptiveStopConverged = 0;
+		mPushConstants.gAdaptiveMinSamples = 16;
+		mPushConstants.gAdaptivePass = 0;
 
 		if (auto arg = instance->find_argument("minPathVertices"); arg)              mPushConstants.gMinPathVertices = atoi(arg->c_str());
 		if (auto arg = instance->find_argument("maxPathVertices"); arg)              mPushConstants.gMaxPathVertices = atoi(arg->c_str());
@@ -91,9 +104,22 @@ void BDPT::create_pipelines() {
 		if (auto arg = instance->find_argument("hashGridBucketPixelRadius"); arg)    mPushConstants.gHashGridBucketPixelRadius = atoi(arg->c_str());
 		if (auto arg = instance->find_argument("minPathVertices"); arg)              mPushConstants.gMinPathVertices = atoi(arg->c_str());
 		if (auto arg = instance->find_argument("maxPathVertices"); arg)              mPushConstants.gMaxPathVertices = atoi(arg->c_str());
+		if (auto arg = instance->find_argument("sampler"); arg)                      mSampler = min<uint32_t>(atoi(arg->c_str()), BDPT_SAMPLER_COUNT - 1);
+		if (auto arg = instance->find_argument("adaptiveSampling"); arg)             mAdaptiveSampling = *arg != "0" && *arg != "false";
+		if (auto arg = instance->find_argument("adaptiveMaxSamples"); arg)           mPushConstants.gAdaptiveMaxSamples = atoi(arg->c_str());
+		if (auto arg = instance->find_argument("adaptiveThreshold"); arg)            mPushConstants.gAdaptiveThreshold = max(1e-6f, (float)atof(arg->c_str()));
+		if (auto arg = instance->find_argument("adaptiveStopConverged"); arg)        mPushConstants.gAdaptiveStopConverged = atoi(arg->c_str());
+		if (auto arg = instance->find_argument("adaptiveMinSamples"); arg)           mPushConstants.gAdaptiveMinSamples = max(1, atoi(arg->c_str()));
+		if (auto arg = instance->find_argument("performanceCounters"); arg && *arg != "0" && *arg != "false") BDPT_SET_FLAG(mSamplingFlags, BDPTFlagBits::ePerformanceCounters);
 		if (auto arg = instance->find_argument("exposure"); arg) exposure = atof(arg->c_str());
 		if (auto arg = instance->find_argument("exposureAlpha"); arg) exposure_alpha = atof(arg->c_str());
 
+		// light trace samples are splatted with the widest atomics the device has
+		if (instance->device().shader_atomic_float_features().shaderBufferFloat32AtomicAdd)
+			mLightTraceAtomics = BDPT_LIGHT_TRACE_FLOAT;
+		else if (instance->device().shader_atomic_int64_features().shaderBufferInt64Atomics)
+			mLightTraceAtomics = BDPT_LIGHT_TRACE_FIXED_POINT_64;
+
 		for (string arg : instance->find_arguments("bdptFlag")) {
 			if (arg.empty()) continue;
 
@@ -155,14 +181,27 @@ void BDPT::create_pipelines() {
 		process_shader(mRenderPipelines[eSampleVisibility]      , src_path, "sample_visibility"       , args_rt);
 		process_shader(mRenderPipelines[eTraceShadows]          , src_path, "trace_shadows"           , args_rt);
 		process_shader(mRenderPipelines[ePresampleLights]       , src_path, "presample_lights"        , args);
+		process_shader(mRenderPipelines[eHashGridScanBuckets]   , src_path, "hashgrid_scan_buckets"   , args);
+		process_shader(mRenderPipelines[eHashGridScanGroups]    , src_path, "hashgrid_scan_groups"    , args);
 		process_shader(mRenderPipelines[eHashGridComputeIndices], src_path, "hashgrid_compute_indices", args);
 		process_shader(mRenderPipelines[eHashGridSwizzle]       , src_path, "hashgrid_swizzle"        , args);
 		process_shader(mRenderPipelines[eAddLightTrace]         , src_path, "add_light_trace"         , args);
+		process_shader(mRenderPipelines[eAdaptiveSampleCounts]  , src_path, "adaptive_sample_counts"  , args);
+		process_shader(mRenderPipelines[eAdaptiveDispatchArgs]  , src_path, "adaptive_dispatch_args"  , args);
+		process_shader(mRenderPipelines[eAdaptiveCompact]       , src_path, "adaptive_compact"        , args);
+		process_shader(mRenderPipelines[eSampleAdaptive]        , src_path, "sample_adaptive"         , args_rt);
+		process_shader(mRenderPipelines[eAdaptiveResolve]       , src_path, "adaptive_resolve"        , args);
 
 		for (thread& t : threads)
 			if (t.joinable())
 				t.join();
 
+		// bindless tables start empty, and are grown to fit the scene by resize_resource_tables
+		mImageTableSize = mVolumeTableSize = 1;
+		const auto& difeatures = instance->device().descriptor_indexing_features();
+		if (!difeatures.runtimeDescriptorArray)
+			throw runtime_error("BDPT requires the runtimeDescriptorArray feature (VK_EXT_descriptor_indexing) for its unbounded image and volume tables");
+
 		unordered_map<uint32_t, DescriptorSetLayout::Binding> bindings[2];
 		for (auto&[shader, name, pipeline] : shaders) {
 			*pipeline = make_shared<ComputePipelineState>(name, shader);
@@ -177,14 +216,22 @@ void BDPT::create_pipelines() {
 						printf_color(ConsoleColor::eYellow, "Warning: variable descriptor set size not supported yet\n");
 				}
 				if (name.ends_with("gStaticSampler") || name.ends_with("gStaticSampler1")) b.mImmutableSamplers = { samplerRepeat };
-				if (name.ends_with("gVolumes") || name.ends_with("gImages") || name.ends_with("gImage1s")) b.mBindingFlags = vk::DescriptorBindingFlagBits::ePartiallyBound;
+				if (name.ends_with("gVolumes")) {
+					b.mDescriptorCount = mVolumeTableSize;
+					b.mBindingFlags = vk::DescriptorBindingFlagBits::ePartiallyBound;
+					if (difeatures.descriptorBindingStorageBufferUpdateAfterBind) b.mBindingFlags |= vk::DescriptorBindingFlagBits::eUpdateAfterBind;
+				} else if (name.ends_with("gImages") || name.ends_with("gImage1s")) {
+					b.mDescriptorCount = mImageTableSize;
+					b.mBindingFlags = vk::DescriptorBindingFlagBits::ePartiallyBound;
+					if (difeatures.descriptorBindingSampledImageUpdateAfterBind) b.mBindingFlags |= vk::DescriptorBindingFlagBits::eUpdateAfterBind;
+				}
 				b.mStageFlags = vk::ShaderStageFlagBits::eCompute;
 				bindings[binding.mSet].emplace(binding.mBinding, b);
 				mDescriptorMap[binding.mSet].emplace(name, binding.mBinding);
 			}
 		}
 		for (uint32_t i = 0; i < 2; i++)
-			mDescriptorSetLayouts[i] = make_shared<DescriptorSetLayout>(instance->device(), "bdpt_descriptor_set_layout" + to_string(i), bindings[i]);
+			mDescriptorSetLayouts[i] = make_shared<DescriptorSetLayout>(instance->device(), "bdpt_descriptor_set_layout" + to_string(i), bindings[i], update_after_bind_flags(bindings[i]));
 	}
 
 	mTonemapPipeline = make_shared<ComputePipelineState>("tonemap", make_shared<Shader>(instance->device(), "Shaders/tonemap.spv"));
@@ -202,6 +249,22 @@ void BDPT::create_pipelines() {
 	mRayCountTimer = 0;
 }
 
+// Grows the bindless tables in the scene descriptor set layout to hold at least imageCount images and volumeCount volumes.
+// Tables grow to the next power of two, so the layout (and the descriptor sets and pipelines built from it) is rarely recreated
+void BDPT::resize_resource_tables(const uint32_t imageCount, const uint32_t volumeCount) {
+	if (imageCount <= mImageTableSize && volumeCount <= mVolumeTableSize) return;
+	mImageTableSize  = max(mImageTableSize , bit_ceil(imageCount));
+	mVolumeTableSize = max(mVolumeTableSize, bit_ceil(volumeCount));
+	auto bindings = mDescriptorSetLayouts[0]->bindings();
+	for (const auto&[name, binding] : mDescriptorMap[0]) {
+		if (name.ends_with("gImages") || name.ends_with("gImage1s"))
+			bindings.at(binding).mDescriptorCount = mImageTableSize;
+		else if (name.ends_with("gVolumes"))
+			bindings.at(binding).mDescriptorCount = mVolumeTableSize;
+	}
+	mDescriptorSetLayouts[0] = make_shared<DescriptorSetLayout>(mDescriptorSetLayouts[0]->mDevice, "bdpt_descriptor_set_layout0", bindings, update_after_bind_flags(bindings));
+}
+
 void BDPT::on_inspector_gui() {
 	if (mTonemapPipeline && ImGui::Button("Reload BDPT shaders")) {
 		mTonemapPipeline->stage(vk::ShaderStageFlagBits::eCompute)->mDevice->waitIdle();
@@ -228,6 +291,14 @@ void BDPT::on_inspector_gui() {
 
 	if (ImGui::CollapsingHeader("Configuration")) {
 		ImGui::Checkbox("Random frame seed", &mRandomPerFrame);
+		Gui::enum_dropdown("Sampler", mSampler, BDPT_SAMPLER_COUNT, [](uint32_t i) {
+			switch (i) {
+				default:
+				case BDPT_SAMPLER_INDEPENDENT: return string("Independent");
+				case BDPT_SAMPLER_SOBOL:       return string("Sobol");
+				case BDPT_SAMPLER_LATTICE:     return string("Rank-1 lattice");
+			}
+		});
 		ImGui::Checkbox("Half precision", &mHalfColorPrecision);
 		ImGui::Checkbox("Force lambertian", &mForceLambertian);
 		for (uint i = 0; i < BDPTFlagBits::eBDPTFlagCount; i++)
@@ -241,7 +312,18 @@ void BDPT::on_inspector_gui() {
 		ImGui::DragScalar("Max diffuse vertices", ImGuiDataType_U32, &mPushConstants.gMaxDiffuseVertices);
 		ImGui::DragScalar("Max null collisions", ImGuiDataType_U32, &mPushConstants.gMaxNullCollisions);
 
-		if (BDPT_CHECK_FLAG(mSamplingFlags, BDPTFlagBits::eConnectToViews))
+		ImGui::Checkbox("Adaptive sampling", &mAdaptiveSampling);
+		if (mAdaptiveSampling) {
+			ImGui::Indent();
+			if (!mDenoise) ImGui::TextColored(ImVec4(1, 1, 0, 1), "Needs the denoiser");
+			ImGui::DragScalar("Max extra paths", ImGuiDataType_U32, &mPushConstants.gAdaptiveMaxSamples);
+			ImGui::DragFloat("Relative variance threshold", &mPushConstants.gAdaptiveThreshold, 1e-4f, 1e-6f, 1, "%.6f");
+			ImGui::DragScalar("Min samples to converge", ImGuiDataType_U32, &mPushConstants.gAdaptiveMinSamples);
+			ImGui::CheckboxFlags("Stop converged pixels", &mPushConstants.gAdaptiveStopConverged, 1);
+			ImGui::Unindent();
+		}
+
+		if (BDPT_CHECK_FLAG(mSamplingFlags, BDPTFlagBits::eConnectToViews) && mLightTraceAtomics != BDPT_LIGHT_TRACE_FLOAT)
 			ImGui::InputScalar("Light trace quantization", ImGuiDataType_U32, &mLightTraceQuantization);
 
 		if (BDPT_CHECK_FLAG(mSamplingFlags, BDPTFlagBits::eLVC)) {
@@ -276,14 +358,16 @@ void BDPT::on_inspector_gui() {
 				mPushConstants.gHashGridBucketCount = max(mPushConstants.gHashGridBucketCount, 1u);
 				if (BDPT_CHECK_FLAG(mSamplingFlags, BDPTFlagBits::ePerformanceCounters)) {
 					for (auto it = mFrameResourcePool.begin(); it != mFrameResourcePool.end(); it++) {
-						if (*it && (*it)->mFence->status() == vk::Result::eSuccess && (*it)->mPathData.contains("gLVCHashGrid.mStats")) {
+						if (*it && (*it)->mCompletion->done() && (*it)->mPathData.contains("gLVCHashGrid.mStats")) {
 							if (BDPT_CHECK_FLAG(mSamplingFlags, BDPTFlagBits::eNEEReservoirReuse)) {
 								Buffer::View<uint32_t> data = (*it)->mPathData.at("gNEEHashGrid.mStats").cast<uint32_t>();
-								ImGui::Text("NEE: %u failed inserts, %u%% buckets used", data[0], (100*data[1])/mPushConstants.gHashGridBucketCount);
+								ImGui::Text("NEE: %u failed inserts, %u displaced inserts", data[0], data[1]);
+								ImGui::Text("NEE: %u%% buckets occupied, largest bucket %u", data[2]*100/mPushConstants.gHashGridBucketCount, data[3]);
 							}
 							if (BDPT_CHECK_FLAG(mSamplingFlags, BDPTFlagBits::eLVCReservoirReuse)) {
 								Buffer::View<uint32_t> data = (*it)->mPathData.at("gLVCHashGrid.mStats").cast<uint32_t>();
-								ImGui::Text("LVC: %u failed inserts, %u%% buckets used", data[0], (100*data[1])/mPushConstants.gHashGridBucketCount);
+								ImGui::Text("LVC: %u failed inserts, %u displaced inserts", data[0], data[1]);
+								ImGui::Text("LVC: %u%% buckets occupied, largest bucket %u", data[2]*100/mPushConstants.gHashGridBucketCount, data[3]);
 							}
 							break;
 						}
@@ -314,27 +398,9 @@ void BDPT::on_inspector_gui() {
 		ImGui::Indent();
 		static char path[256]{ 'i', 'm', 'a', 'g', 'e', '.', 'h', 'd', 'r', '\0' };
 		ImGui::InputText("", path, sizeof(path));
-		if (ImGui::Button("Save")) {
-			Device& d = mPrevFrame->mRadiance.image()->mDevice;
-			auto cb = d.get_command_buffer("image copy");
-
-			Image::View src = mDenoise ? mPrevFrame->mDenoiseResult : mPrevFrame->mRadiance;
-			if (src.image()->format() != vk::Format::eR32G32B32A32Sfloat) {
-				Image::View tmp = make_shared<Image>(cb->mDevice, "gRadiance", src.extent(), vk::Format::eR32G32B32A32Sfloat, 1, 1, vk::SampleCountFlagBits::e1, vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eStorage);
-				cb->blit_image(src, tmp);
-				src = tmp;
-			}
-
-			Buffer::View<float> pixels = make_shared<Buffer>(d, "image copy tmp", src.extent().width * src.extent().height * sizeof(float) * 4, vk::BufferUsageFlagBits::eTransferDst, VMA_MEMORY_USAGE_GPU_TO_CPU);
-			cb->copy_image_to_buffer(src, pixels);
-
-			d->waitIdle();
-			d.submit(cb);
-			cb->fence()->wait();
-
-			stbi_write_hdr(path, src.extent().width, src.extent().height, 4, pixels.data());
-			ImGui::Unindent();
-		}
+		if (ImGui::Button("Save"))
+			mExportPath = path;
+		ImGui::Unindent();
 	}
 }
 
@@ -351,7 +417,7 @@ void BDPT::update(CommandBuffer& commandBuffer, const float deltaTime) {
 		mCurFrame.reset();
 
 		for (auto it = mFrameResourcePool.begin(); it != mFrameResourcePool.end(); it++) {
-			if (*it != mPrevFrame && (*it)->mFence->status() == vk::Result::eSuccess) {
+			if (*it != mPrevFrame && (*it)->mCompletion->done()) {
 				mCurFrame = *it;
 				mFrameResourcePool.erase(it);
 				break;
@@ -376,7 +442,28 @@ void BDPT::update(CommandBuffer& commandBuffer, const float deltaTime) {
 		else
 			mCurFrame->mFrameNumber = 0;
 
-		mCurFrame->mFence = commandBuffer.fence();
+		mCurFrame->mCompletion = commandBuffer.completion();
+	}
+
+	if (!mExportPath.empty() && mPrevFrame) {
+		Image::View src = mDenoise ? mPrevFrame->mDenoiseResult : mPrevFrame->mRadiance;
+		if (src.image()->format() != vk::Format::eR32G32B32A32Sfloat) {
+			Image::View tmp = make_shared<Image>(commandBuffer.mDevice, "gRadiance", src.extent(), vk::Format::eR32G32B32A32Sfloat, 1, 1, vk::SampleCountFlagBits::e1, vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst);
+			commandBuffer.blit_image(src, tmp);
+			src = tmp;
+		}
+		commandBuffer.readback(src, [path = mExportPath](const Buffer::TexelView& pixels, const vk::Extent3D& extent) {
+			// runs on whichever thread polls the command buffer, so the pixels are encoded straight from the staging buffer on a worker thread,
+			// which releases the staging buffer when it is done
+			thread_pool::global().push([=]() {
+				try {
+					write_image_data(path, vk::Extent2D(extent.width, extent.height), (const float*)pixels.data());
+				} catch (exception& e) {
+					fprintf_color(ConsoleColor::eRed, stderr, "Failed to export %s: %s\n", path.string().c_str(), e.what());
+				}
+			});
+		});
+		mExportPath.clear();
 	}
 
 	mCurFrame->mSceneData = mNode.find_in_ancestor<Scene>()->data();
@@ -395,9 +482,13 @@ void BDPT::update(CommandBuffer& commandBuffer, const float deltaTime) {
 	mPushConstants.gLightDistributionPDF = mCurFrame->mSceneData->mLightDistributionPDF;
 	mPushConstants.gLightDistributionCDF = mCurFrame->mSceneData->mLightDistributionCDF;
 
+	resize_resource_tables(
+		(uint32_t)max(mCurFrame->mSceneData->mResources.image4s.size(), mCurFrame->mSceneData->mResources.image1s.size()),
+		(uint32_t)mCurFrame->mSceneData->mResources.volume_data_map.size());
+
 	{
 		ProfilerRegion ps("Assign/write descriptors", commandBuffer);
-		if (!mCurFrame->mSceneDescriptors) mCurFrame->mSceneDescriptors = make_shared<DescriptorSet>(mDescriptorSetLayouts[0], "path_tracer_scene_descriptors");
+		if (!mCurFrame->mSceneDescriptors || mCurFrame->mSceneDescriptors->layout() != mDescriptorSetLayouts[0]) mCurFrame->mSceneDescriptors = make_shared<DescriptorSet>(mDescriptorSetLayouts[0], "path_tracer_scene_descriptors");
 		mCurFrame->mSceneDescriptors->insert_or_assign(mDescriptorMap[0].at("gSceneParams.gAccelerationStructure"), **mCurFrame->mSceneData->mScene);
 		mCurFrame->mSceneDescriptors->insert_or_assign(mDescriptorMap[0].at("gSceneParams.gVertices"), mCurFrame->mSceneData->mVertices);
 		mCurFrame->mSceneDescriptors->insert_or_assign(mDescriptorMap[0].at("gSceneParams.gIndices"), mCurFrame->mSceneData->mIndices);
@@ -443,18 +534,41 @@ void BDPT::render(CommandBuffer& commandBuffer, const Image::View& renderTarget,
 	// upload views, compute gViewMediumInstances
 	{
 		ProfilerRegion ps("Upload views", commandBuffer);
-		// upload viewdata
-		mCurFrame->mViews = make_shared<Buffer>(commandBuffer.mDevice, "gViews", views.size() * sizeof(ViewData), vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
-		mCurFrame->mViewTransforms = make_shared<Buffer>(commandBuffer.mDevice, "gViewTransforms", views.size() * sizeof(TransformData), vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
-		mCurFrame->mViewInverseTransforms = make_shared<Buffer>(commandBuffer.mDevice, "gViewInverseTransforms", views.size() * sizeof(TransformData), vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
+		// upload viewdata. the buffers persist with the frame resources and are written in place,
+		// which is safe since frame resources are only reused once their fence has signalled
+		if (!mCurFrame->mViews || mCurFrame->mViews.size() != views.size()) {
+			mCurFrame->mViews = make_shared<Buffer>(commandBuffer.mDevice, "gViews", views.size() * sizeof(ViewData), vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
+			mCurFrame->mViewTransforms = make_shared<Buffer>(commandBuffer.mDevice, "gViewTransforms", views.size() * sizeof(TransformData), vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
+			mCurFrame->mViewInverseTransforms = make_shared<Buffer>(commandBuffer.mDevice, "gViewInverseTransforms", views.size() * sizeof(TransformData), vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
+			mCurFrame->mViewMediumIndices = make_shared<Buffer>(commandBuffer.mDevice, "gViewMediumInstances", views.size() * sizeof(uint32_t), vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
+		}
 		for (uint32_t i = 0; i < views.size(); i++) {
 			mCurFrame->mViews[i] = views[i].first;
 			mCurFrame->mViewTransforms[i] = views[i].second;
 			mCurFrame->mViewInverseTransforms[i] = views[i].second.inverse();
 		}
 
+		// per-pixel view lookup, shared with the previous frame unless the extent or the view rects changed
+		if (views.size() >= INVALID_VIEW_INDEX) throw runtime_error("Too many views (" + to_string(views.size()) + ")");
+		bool view_rects_changed = !mPrevFrame || !mPrevFrame->mViewIndices || mPrevFrame->mViewIndices.extent() != extent || mPrevFrame->mViews.size() != views.size();
+		for (uint32_t i = 0; i < views.size() && !view_rects_changed; i++)
+			view_rects_changed = (mPrevFrame->mViews[i].image_min != views[i].first.image_min).any() || (mPrevFrame->mViews[i].image_max != views[i].first.image_max).any();
+		if (view_rects_changed) {
+			Buffer::View<uint8_t> staging = make_shared<Buffer>(commandBuffer.mDevice, "gViewIndices/Staging", extent.width*extent.height, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_ONLY);
+			ranges::fill(staging, (uint8_t)INVALID_VIEW_INDEX);
+			// written in reverse so that the first view wins where views overlap
+			for (int32_t i = (int32_t)views.size() - 1; i >= 0; i--) {
+				const int2 image_min = views[i].first.image_min.max(0);
+				const int2 image_max = views[i].first.image_max.min(int2((int32_t)extent.width, (int32_t)extent.height));
+				for (int32_t y = image_min[1]; y < image_max[1]; y++)
+					for (int32_t x = image_min[0]; x < image_max[0]; x++)
+						staging[y*extent.width + x] = (uint8_t)i;
+			}
+			mCurFrame->mViewIndices = commandBuffer.copy_buffer_to_image(staging, make_shared<Image>(commandBuffer.mDevice, "gViewIndices", extent, vk::Format::eR8Uint, 1, 1, vk::SampleCountFlagBits::e1, vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst));
+		} else
+			mCurFrame->mViewIndices = mPrevFrame->mViewIndices;
+
 		// find if views are inside a volume
-		mCurFrame->mViewMediumIndices = make_shared<Buffer>(commandBuffer.mDevice, "gViewMediumInstances", views.size() * sizeof(uint32_t), vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
 		ranges::fill(mCurFrame->mViewMediumIndices, INVALID_INSTANCE);
 		mNode.for_each_descendant<Medium>([&](const component_ptr<Medium>& vol) {
 			has_volumes = true;
@@ -496,6 +610,9 @@ void BDPT::render(CommandBuffer& commandBuffer, const Image::View& renderTarget,
 		else
 			push_constants.gEnvironmentSampleProbability = 1;
 
+		if (mCurFrame->mSceneData->mCompactVertices)
+			scene_flags |= BDPT_FLAG_COMPACT_VERTICES;
+
 		if (has_volumes)
 			scene_flags |= BDPT_FLAG_HAS_MEDIA;
 		else
@@ -523,11 +640,28 @@ void BDPT::render(CommandBuffer& commandBuffer, const Image::View& renderTarget,
 			BDPT_UNSET_FLAG(sampling_flags, BDPTFlagBits::eDeferShadowRays);
 
 	}
+
+	// adaptive sampling reads the denoiser's accumulation from the previous frame, so it is skipped until there is one
+	Image::View accum_color, accum_moments;
+	if (mAdaptiveSampling && mDenoise && denoiser && mDebugMode == BDPTDebugMode::eNone && push_constants.gAdaptiveMaxSamples > 0) {
+		accum_color = denoiser->accumulated_color();
+		accum_moments = denoiser->accumulated_moments();
+		if (!accum_color || accum_color.extent() != extent) accum_color = accum_moments = Image::View();
+	}
+	const bool adaptive = (bool)accum_color;
+	if (adaptive) {
+		scene_flags |= BDPT_FLAG_ADAPTIVE_SAMPLING;
+		// pixels that stop would keep a history that might not be theirs after the view moves
+		if (changed) push_constants.gAdaptiveStopConverged = 0;
+	}
+
 	for (auto& p : mRenderPipelines) {
 		p->specialization_constant<uint32_t>("gSceneFlags") = scene_flags;
 		p->specialization_constant<uint32_t>("gSpecializationFlags") = sampling_flags;
 		p->specialization_constant<uint32_t>("gDebugMode") = (uint32_t)mDebugMode;
 		p->specialization_constant<uint32_t>("gLightTraceQuantization") = mLightTraceQuantization;
+		p->specialization_constant<uint32_t>("gLightTraceAtomics") = mLightTraceAtomics;
+		p->specialization_constant<uint32_t>("gSampler") = mSampler;
 		if (mForceLambertian)
 			p->specialization_constant<uint32_t>("FORCE_LAMBERTIAN") = 1;
 		else
@@ -539,6 +673,12 @@ void BDPT::render(CommandBuffer& commandBuffer, const Image::View& renderTarget,
 	mRenderPipelines[ePresampleLights]->specialization_constant<uint32_t>("gSpecializationFlags") = tmp;
 	mRenderPipelines[eSamplePhotons]->specialization_constant<uint32_t>("gSpecializationFlags") = tmp;
 	mRenderPipelines[eSamplePhotons]->specialization_constant<uint32_t>("gSceneFlags") = scene_flags | BDPT_FLAG_TRACE_LIGHT;
+	// extra view paths can't use the per-pixel shadow ray and hash grid storage, which belongs to each pixel's first path
+	tmp = sampling_flags;
+	BDPT_UNSET_FLAG(tmp, BDPTFlagBits::eDeferShadowRays);
+	BDPT_UNSET_FLAG(tmp, BDPTFlagBits::eNEEReservoirReuse);
+	BDPT_UNSET_FLAG(tmp, BDPTFlagBits::eLVCReservoirReuse);
+	mRenderPipelines[eSampleAdaptive]->specialization_constant<uint32_t>("gSpecializationFlags") = tmp;
 
 	const bool reservoir_reuse = BDPT_CHECK_FLAG(sampling_flags, BDPTFlagBits::eLVCReservoirReuse) || BDPT_CHECK_FLAG(sampling_flags, BDPTFlagBits::eNEEReservoirReuse);
 
@@ -559,7 +699,7 @@ void BDPT::render(CommandBuffer& commandBuffer, const Image::View& renderTarget,
 
 			mCurFrame->mPathData["gVisibility"]        = make_shared<Buffer>(commandBuffer.mDevice, "gVisibility",        pixel_count * sizeof(VisibilityInfo),  vk::BufferUsageFlagBits::eStorageBuffer|vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_GPU_ONLY);
 			mCurFrame->mPathData["gDepth"]             = make_shared<Buffer>(commandBuffer.mDevice, "gDepth",             pixel_count * sizeof(DepthInfo),       vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_GPU_ONLY);
-			mCurFrame->mPathData["gLightTraceSamples"] = make_shared<Buffer>(commandBuffer.mDevice, "gLightTraceSamples", pixel_count * sizeof(float4), 		 vk::BufferUsageFlagBits::eStorageBuffer|vk::BufferUsageFlagBits::eTransferDst, VMA_MEMORY_USAGE_GPU_ONLY);
+			mCurFrame->mPathData["gLightTraceSamples"] = make_shared<Buffer>(commandBuffer.mDevice, "gLightTraceSamples", pixel_count * (mLightTraceAtomics == BDPT_LIGHT_TRACE_FIXED_POINT_64 ? 3*sizeof(uint64_t) : sizeof(float4)), vk::BufferUsageFlagBits::eStorageBuffer|vk::BufferUsageFlagBits::eTransferDst, VMA_MEMORY_USAGE_GPU_ONLY);
 			mCurFrame->mFrameNumber = 0;
 
 			mCurFrame->mTonemapMax    = make_shared<Buffer>(commandBuffer.mDevice, "gMax", sizeof(uint4)*3, vk::BufferUsageFlagBits::eStorageBuffer|vk::BufferUsageFlagBits::eTransferDst, VMA_MEMORY_USAGE_GPU_ONLY);
@@ -576,6 +716,17 @@ void BDPT::render(CommandBuffer& commandBuffer, const Image::View& renderTarget,
 		if (!mCurFrame->mPathData.contains("gShadowRays") || mCurFrame->mPathData.at("gShadowRays").size_bytes() < shadow_ray_count * sizeof(ShadowRayData))
 			mCurFrame->mPathData["gShadowRays"] = make_shared<Buffer>(commandBuffer.mDevice, "gShadowRays", shadow_ray_count * sizeof(ShadowRayData), vk::BufferUsageFlagBits::eStorageBuffer|vk::BufferUsageFlagBits::eTransferDst, VMA_MEMORY_USAGE_GPU_ONLY, 32);
 
+		const uint32_t adaptive_pixel_count = adaptive ? pixel_count : 1;
+		if (!mCurFrame->mPathData.contains("gAdaptivePixels") || mCurFrame->mPathData.at("gAdaptivePixels").size_bytes() < adaptive_pixel_count * sizeof(uint32_t)) {
+			mCurFrame->mPathData["gAdaptiveSampleCounts"] = make_shared<Buffer>(commandBuffer.mDevice, "gAdaptiveSampleCounts", adaptive_pixel_count * sizeof(uint32_t), vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_GPU_ONLY);
+			mCurFrame->mPathData["gAdaptivePixels"]       = make_shared<Buffer>(commandBuffer.mDevice, "gAdaptivePixels",       adaptive_pixel_count * sizeof(uint32_t), vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_GPU_ONLY);
+		}
+		const uint32_t adaptive_pass_count = max(1u, push_constants.gAdaptiveMaxSamples);
+		if (!mCurFrame->mPathData.contains("gAdaptiveDispatch") || mCurFrame->mPathData.at("gAdaptiveDispatch").size_bytes() < adaptive_pass_count * sizeof(uint4)) {
+			mCurFrame->mPathData["gAdaptiveCounters"] = make_shared<Buffer>(commandBuffer.mDevice, "gAdaptiveCounters", 2 * adaptive_pass_count * sizeof(uint32_t), vk::BufferUsageFlagBits::eStorageBuffer|vk::BufferUsageFlagBits::eTransferDst, VMA_MEMORY_USAGE_GPU_ONLY);
+			mCurFrame->mPathData["gAdaptiveDispatch"] = make_shared<Buffer>(commandBuffer.mDevice, "gAdaptiveDispatch", adaptive_pass_count * sizeof(uint4), vk::BufferUsageFlagBits::eStorageBuffer|vk::BufferUsageFlagBits::eIndirectBuffer, VMA_MEMORY_USAGE_GPU_ONLY);
+		}
+
 		const uint32_t presampled_light_count = BDPT_CHECK_FLAG(sampling_flags, BDPTFlagBits::ePresampleLights) ? max(1u,push_constants.gLightPresampleTileCount*push_constants.gLightPresampleTileSize) : 1;
 		if (!mCurFrame->mPathData.contains("gPresampledLights") || mCurFrame->mPathData.at("gPresampledLights").size_bytes() < presampled_light_count * sizeof(PresampledLightPoint))
 			mCurFrame->mPathData["gPresampledLights"] = make_shared<Buffer>(commandBuffer.mDevice, "gPresampledLights", presampled_light_count * sizeof(PresampledLightPoint), vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_GPU_ONLY);
@@ -585,6 +736,7 @@ void BDPT::render(CommandBuffer& commandBuffer, const Image::View& renderTarget,
 			mCurFrame->mPathData[name + ".mChecksums"]     = make_shared<Buffer>(commandBuffer.mDevice, name + ".mChecksums"    , bucketCount * sizeof(uint32_t), vk::BufferUsageFlagBits::eStorageBuffer|vk::BufferUsageFlagBits::eTransferDst, VMA_MEMORY_USAGE_GPU_ONLY);
 			mCurFrame->mPathData[name + ".mCounters"]      = make_shared<Buffer>(commandBuffer.mDevice, name + ".mCounters"     , bucketCount * sizeof(uint32_t), vk::BufferUsageFlagBits::eStorageBuffer|vk::BufferUsageFlagBits::eTransferDst, VMA_MEMORY_USAGE_GPU_ONLY);
 			mCurFrame->mPathData[name + ".mIndices"]       = make_shared<Buffer>(commandBuffer.mDevice, name + ".mIndices"      , bucketCount * sizeof(uint32_t), vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_GPU_ONLY);
+			mCurFrame->mPathData[name + ".mGroupOffsets"]  = make_shared<Buffer>(commandBuffer.mDevice, name + ".mGroupOffsets" , (bucketCount + HASHGRID_SCAN_GROUP_SIZE - 1)/HASHGRID_SCAN_GROUP_SIZE * sizeof(uint32_t), vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_GPU_ONLY);
 			mCurFrame->mPathData[name + ".mStats"]         = make_shared<Buffer>(commandBuffer.mDevice, name + ".mStats"        , 4 * sizeof(uint32_t), vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_CPU_ONLY);
 		};
 		auto allocate_hashgrid_data = [&](const string& name, const uint32_t elementSize, const uint32_t elementCount) {
@@ -607,13 +759,16 @@ void BDPT::render(CommandBuffer& commandBuffer, const Image::View& renderTarget,
 	// assign descriptors
 	{
 		ProfilerRegion ps("Assign descriptors", commandBuffer);
-		mCurFrame->mViewDescriptors = make_shared<DescriptorSet>(mDescriptorSetLayouts[1], "bdpt_view_descriptors");
+		// the set persists with the frame resources; only descriptors that changed since this set was last used are written
+		if (!mCurFrame->mViewDescriptors || mCurFrame->mViewDescriptors->layout() != mDescriptorSetLayouts[1])
+			mCurFrame->mViewDescriptors = make_shared<DescriptorSet>(mDescriptorSetLayouts[1], "bdpt_view_descriptors");
 		mCurFrame->mViewDescriptors->insert_or_assign(mDescriptorMap[1].at("gFrameParams.gViews"), mCurFrame->mViews);
 		mCurFrame->mViewDescriptors->insert_or_assign(mDescriptorMap[1].at("gFrameParams.gPrevViews"), (mPrevFrame && mPrevFrame->mViews ? mPrevFrame : mCurFrame)->mViews);
 		mCurFrame->mViewDescriptors->insert_or_assign(mDescriptorMap[1].at("gFrameParams.gViewTransforms"), mCurFrame->mViewTransforms);
 		mCurFrame->mViewDescriptors->insert_or_assign(mDescriptorMap[1].at("gFrameParams.gInverseViewTransforms"), mCurFrame->mViewInverseTransforms);
 		mCurFrame->mViewDescriptors->insert_or_assign(mDescriptorMap[1].at("gFrameParams.gPrevInverseViewTransforms"), (mPrevFrame && mPrevFrame->mViews ? mPrevFrame : mCurFrame)->mViewInverseTransforms);
 		mCurFrame->mViewDescriptors->insert_or_assign(mDescriptorMap[1].at("gFrameParams.gViewMediumInstances"), mCurFrame->mViewMediumIndices);
+		mCurFrame->mViewDescriptors->insert_or_assign(mDescriptorMap[1].at("gFrameParams.gViewIndices"), image_descriptor(mCurFrame->mViewIndices, vk::ImageLayout::eShaderReadOnlyOptimal, vk::AccessFlagBits::eShaderRead));
 		mCurFrame->mViewDescriptors->insert_or_assign(mDescriptorMap[1].at("gFrameParams.gRadiance")  , image_descriptor(mCurFrame->mRadiance, vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderWrite));
 		mCurFrame->mViewDescriptors->insert_or_assign(mDescriptorMap[1].at("gFrameParams.gAlbedo")    , image_descriptor(mCurFrame->mAlbedo, vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderWrite));
 		mCurFrame->mViewDescriptors->insert_or_assign(mDescriptorMap[1].at("gFrameParams.gDebugImage"), image_descriptor(mCurFrame->mDebugImage, vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderWrite));
@@ -627,6 +782,10 @@ void BDPT::render(CommandBuffer& commandBuffer, const Image::View& renderTarget,
 		}
 		for (const auto&[name, buf] : mCurFrame->mPathData)
 			mCurFrame->mViewDescriptors->insert_or_assign(mDescriptorMap[1].at("gFrameParams." + name), buf);
+		if (adaptive) {
+			mCurFrame->mViewDescriptors->insert_or_assign(mDescriptorMap[1].at("gFrameParams.gAccumColor")  , image_descriptor(accum_color, vk::ImageLayout::eShaderReadOnlyOptimal, vk::AccessFlagBits::eShaderRead));
+			mCurFrame->mViewDescriptors->insert_or_assign(mDescriptorMap[1].at("gFrameParams.gAccumMoments"), image_descriptor(accum_moments, vk::ImageLayout::eShaderReadOnlyOptimal, vk::AccessFlagBits::eShaderRead));
+		}
 	}
 
 	auto bind_descriptors_and_push_constants = [&]() {
@@ -638,6 +797,7 @@ void BDPT::render(CommandBuffer& commandBuffer, const Image::View& renderTarget,
 	mCurFrame->mRadiance.transition_barrier(commandBuffer, vk::PipelineStageFlagBits::eComputeShader, vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderWrite);
 	mCurFrame->mAlbedo.transition_barrier(commandBuffer, vk::PipelineStageFlagBits::eComputeShader, vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderWrite);
 	mCurFrame->mPrevUVs.transition_barrier(commandBuffer, vk::PipelineStageFlagBits::eComputeShader, vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderWrite);
+	mCurFrame->mViewIndices.transition_barrier(commandBuffer, vk::PipelineStageFlagBits::eComputeShader, vk::ImageLayout::eShaderReadOnlyOptimal, vk::AccessFlagBits::eShaderRead);
 	mCurFrame->mDebugImage.transition_barrier(commandBuffer, vk::PipelineStageFlagBits::eComputeShader, vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderWrite);
 
 	// presample lights
@@ -689,6 +849,36 @@ void BDPT::render(CommandBuffer& commandBuffer, const Image::View& renderTarget,
 		}
 	}
 
+	// choose each pixel's path count, and sort the pixels that get extra paths by their extra path count
+	if (adaptive) {
+		ProfilerRegion ps("Adaptive sample counts", commandBuffer);
+		commandBuffer.write_timestamp(vk::PipelineStageFlagBits::eComputeShader, "Adaptive sample counts");
+		auto counters = mCurFrame->mPathData.at("gAdaptiveCounters");
+		auto counts   = mCurFrame->mPathData.at("gAdaptiveSampleCounts");
+		auto dispatch = mCurFrame->mPathData.at("gAdaptiveDispatch");
+		auto pixels   = mCurFrame->mPathData.at("gAdaptivePixels");
+		commandBuffer->fillBuffer(**counters.buffer(), counters.offset(), counters.size_bytes(), 0);
+		commandBuffer.barrier({ counters }, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderRead|vk::AccessFlagBits::eShaderWrite);
+		accum_color.transition_barrier(commandBuffer, vk::PipelineStageFlagBits::eComputeShader, vk::ImageLayout::eShaderReadOnlyOptimal, vk::AccessFlagBits::eShaderRead);
+		accum_moments.transition_barrier(commandBuffer, vk::PipelineStageFlagBits::eComputeShader, vk::ImageLayout::eShaderReadOnlyOptimal, vk::AccessFlagBits::eShaderRead);
+
+		commandBuffer.bind_pipeline(mRenderPipelines[eAdaptiveSampleCounts]->get_pipeline(mDescriptorSetLayouts));
+		bind_descriptors_and_push_constants();
+		commandBuffer.dispatch_over(extent);
+		commandBuffer.barrier({ counters, counts }, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderWrite, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderRead|vk::AccessFlagBits::eShaderWrite);
+
+		commandBuffer.bind_pipeline(mRenderPipelines[eAdaptiveDispatchArgs]->get_pipeline(mDescriptorSetLayouts));
+		bind_descriptors_and_push_constants();
+		commandBuffer->dispatch(1, 1, 1);
+		commandBuffer.barrier({ counters }, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderWrite, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderRead|vk::AccessFlagBits::eShaderWrite);
+
+		commandBuffer.bind_pipeline(mRenderPipelines[eAdaptiveCompact]->get_pipeline(mDescriptorSetLayouts));
+		bind_descriptors_and_push_constants();
+		commandBuffer.dispatch_over(extent);
+		commandBuffer.barrier({ pixels }, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderWrite, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderRead);
+		commandBuffer.barrier({ dispatch }, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderWrite, vk::PipelineStageFlagBits::eDrawIndirect|vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eIndirectCommandRead|vk::AccessFlagBits::eShaderRead);
+	}
+
 	// trace view paths
 	{
 		if (BDPT_CHECK_FLAG(sampling_flags, BDPTFlagBits::eConnectToLightPaths))
@@ -727,10 +917,26 @@ void BDPT::render(CommandBuffer& commandBuffer, const Image::View& renderTarget,
 					mCurFrame->mPathData.at("gLVCHashGrid.mCounters"),
 				}, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderWrite, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderRead);
 				ProfilerRegion ps("Compute hash grid indices", commandBuffer);
+				commandBuffer.write_timestamp(vk::PipelineStageFlagBits::eComputeShader, "Compute hash grid indices");
+				const vector<Buffer::View<byte>> scan_buffers = {
+					mCurFrame->mPathData.at("gNEEHashGrid.mIndices"),
+					mCurFrame->mPathData.at("gNEEHashGrid.mGroupOffsets"),
+					mCurFrame->mPathData.at("gLVCHashGrid.mIndices"),
+					mCurFrame->mPathData.at("gLVCHashGrid.mGroupOffsets")
+				};
+
+				// exclusive scan over the bucket counters: within each group, over the group sums, then add the group offsets back
+				commandBuffer.bind_pipeline(mRenderPipelines[eHashGridScanBuckets]->get_pipeline(mDescriptorSetLayouts));
+				bind_descriptors_and_push_constants();
+				commandBuffer.dispatch_over(push_constants.gHashGridBucketCount);
+				commandBuffer.barrier<byte>(scan_buffers, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderWrite, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderRead|vk::AccessFlagBits::eShaderWrite);
+				commandBuffer.bind_pipeline(mRenderPipelines[eHashGridScanGroups]->get_pipeline(mDescriptorSetLayouts));
+				bind_descriptors_and_push_constants();
+				commandBuffer->dispatch(1, 1, 1);
+				commandBuffer.barrier<byte>(scan_buffers, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderWrite, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderRead|vk::AccessFlagBits::eShaderWrite);
 				commandBuffer.bind_pipeline(mRenderPipelines[eHashGridComputeIndices]->get_pipeline(mDescriptorSetLayouts));
 				bind_descriptors_and_push_constants();
-				commandBuffer.write_timestamp(vk::PipelineStageFlagBits::eComputeShader, "Compute hash grid indices");
-				commandBuffer.dispatch_over(extent.width, (push_constants.gHashGridBucketCount + extent.width-1) / extent.width);
+				commandBuffer.dispatch_over(push_constants.gHashGridBucketCount);
 			}
 			{
 				commandBuffer.barrier({
@@ -750,6 +956,29 @@ void BDPT::render(CommandBuffer& commandBuffer, const Image::View& renderTarget,
 		}
 	}
 
+	// trace extra view paths. Pass i covers the pixels with more than i extra paths, which is a prefix of gAdaptivePixels
+	if (adaptive) {
+		ProfilerRegion ps("Sample adaptive", commandBuffer);
+		commandBuffer.write_timestamp(vk::PipelineStageFlagBits::eComputeShader, "Sample adaptive");
+		const Buffer::View<uint4> dispatch = mCurFrame->mPathData.at("gAdaptiveDispatch").cast<uint4>();
+		const uint32_t seed = push_constants.gRandomSeed;
+		commandBuffer.bind_pipeline(mRenderPipelines[eSampleAdaptive]->get_pipeline(mDescriptorSetLayouts));
+		for (uint32_t i = 0; i < push_constants.gAdaptiveMaxSamples; i++) {
+			mCurFrame->mRadiance.transition_barrier(commandBuffer, vk::PipelineStageFlagBits::eComputeShader, vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+			// each pass draws a different sample index, in the high bits so that it doesn't collide with the next frames' seeds
+			push_constants.gRandomSeed = seed + ((i + 1) << 24);
+			push_constants.gAdaptivePass = i;
+			bind_descriptors_and_push_constants();
+			commandBuffer.dispatch_indirect(Buffer::View<uint4>(dispatch, i, 1));
+		}
+		push_constants.gRandomSeed = seed;
+
+		mCurFrame->mRadiance.transition_barrier(commandBuffer, vk::PipelineStageFlagBits::eComputeShader, vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+		commandBuffer.bind_pipeline(mRenderPipelines[eAdaptiveResolve]->get_pipeline(mDescriptorSetLayouts));
+		bind_descriptors_and_push_constants();
+		commandBuffer.dispatch_over(extent);
+	}
+
 	// add light trace
 	if (BDPT_CHECK_FLAG(sampling_flags, BDPTFlagBits::eConnectToViews)) {
 		mCurFrame->mRadiance.transition_barrier(commandBuffer, vk::PipelineStageFlagBits::eComputeShader, vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
@@ -771,6 +1000,7 @@ void BDPT::render(CommandBuffer& commandBuffer, const Image::View& renderTarget,
 			result,
 			mCurFrame->mAlbedo,
 			mCurFrame->mViews,
+			mCurFrame->mViewIndices,
 			mCurFrame->mPathData.at("gVisibility").cast<VisibilityInfo>(),
 			mCurFrame->mPathData.at("gDepth").cast<DepthInfo>(),
 			mCurFrame->mPrevUVs);
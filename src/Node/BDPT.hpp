@@ -16,6 +16,12 @@ public:
 	inline Node& node() const { return mNode; }
 
 	inline Image::View prev_result() { return mPrevFrame ? mPrevFrame->mTonemapResult : Image::View(); }
+	// linear radiance of the previous frame, after accumulation/denoising but before tone mapping
+	inline Image::View prev_radiance() { return mPrevFrame ? (mDenoise && mPrevFrame->mDenoiseResult ? mPrevFrame->mDenoiseResult : mPrevFrame->mRadiance) : Image::View(); }
+	// radiance traced in the previous frame alone. The alpha channel is the number of paths traced for each pixel
+	inline Image::View prev_frame_radiance() { return mPrevFrame ? mPrevFrame->mRadiance : Image::View(); }
+	// whether prev_radiance() is accumulated over frames by the denoiser
+	inline bool denoise() const { return mDenoise; }
 
 	STRATUM_API void create_pipelines();
 
@@ -32,8 +38,15 @@ private:
 		ePresampleLights,
 		eTraceShadows,
 		eAddLightTrace,
+		eHashGridScanBuckets,
+		eHashGridScanGroups,
 		eHashGridComputeIndices,
 		eHashGridSwizzle,
+		eAdaptiveSampleCounts,
+		eAdaptiveDispatchArgs,
+		eAdaptiveCompact,
+		eSampleAdaptive,
+		eAdaptiveResolve,
 		ePipelineCount
 	};
 	array<shared_ptr<ComputePipelineState>, RenderPipelineIndex::ePipelineCount> mRenderPipelines;
@@ -43,6 +56,9 @@ private:
 
 	array<unordered_map<string, uint32_t>, 2> mDescriptorMap;
 	array<shared_ptr<DescriptorSetLayout>, 2> mDescriptorSetLayouts;
+	uint32_t mImageTableSize = 1;
+	uint32_t mVolumeTableSize = 1;
+	void resize_resource_tables(const uint32_t imageCount, const uint32_t volumeCount);
 	BDPTPushConstants mPushConstants;
 
 	bool mHalfColorPrecision = false;
@@ -50,13 +66,17 @@ private:
 	bool mRandomPerFrame = true;
 	bool mForceLambertian = false;
 	bool mDenoise = true;
+	bool mAdaptiveSampling = false; // needs the denoiser's accumulation
 	uint32_t mSamplingFlags = 0;
 	BDPTDebugMode mDebugMode = BDPTDebugMode::eNone;
 	uint32_t mLightTraceQuantization = 65536;
+	uint32_t mLightTraceAtomics = BDPT_LIGHT_TRACE_FIXED_POINT_32;
+	uint32_t mSampler = BDPT_SAMPLER_INDEPENDENT;
+	fs::path mExportPath; // set by the inspector, read back and written on the next update
 
 
 	struct FrameResources {
-		shared_ptr<Fence> mFence;
+		shared_ptr<TimelinePoint> mCompletion;
 
 		shared_ptr<DescriptorSet> mSceneDescriptors;
 		shared_ptr<DescriptorSet> mViewDescriptors;
@@ -67,6 +87,7 @@ private:
 		Buffer::View<TransformData> mViewTransforms;
 		Buffer::View<TransformData> mViewInverseTransforms;
 		Buffer::View<uint32_t> mViewMediumIndices;
+		Image::View mViewIndices;
 		Image::View mRadiance;
 		Image::View mAlbedo;
 		Image::View mPrevUVs;
@@ -0,0 +1,207 @@
+#include "Benchmark.hpp"
+#include "Application.hpp"
+
+namespace stm {
+
+Benchmark::Benchmark(Node& node) : mNode(node) {
+	auto instance = mNode.find_in_ancestor<Instance>();
+
+	fs::path outputPath = "benchmark.csv";
+	if (auto arg = instance->find_argument("benchmark"); arg)                 mReferencePath = *arg;
+	if (auto arg = instance->find_argument("benchmarkOutput"); arg)           outputPath = *arg;
+	if (auto arg = instance->find_argument("benchmarkTime"); arg)             mTimeBudget = atof(arg->c_str());
+	if (auto arg = instance->find_argument("benchmarkSamples"); arg)          mSampleBudget = atoi(arg->c_str());
+	if (auto arg = instance->find_argument("benchmarkIntervalTime"); arg)     { mIntervalTime = atof(arg->c_str()); mIntervalSamples = 0; }
+	if (auto arg = instance->find_argument("benchmarkInterval"); arg)         mIntervalSamples = atoi(arg->c_str());
+	if (auto arg = instance->find_argument("benchmarkQuantization"); arg)     mQuantization = atoi(arg->c_str());
+	if (mTimeBudget <= 0 && mSampleBudget == 0) mSampleBudget = 1024;
+
+	if (mReferencePath.empty() || !fs::exists(mReferencePath))
+		throw runtime_error("Benchmark reference image not found: " + mReferencePath.string());
+
+	mOutput = make_shared<ofstream>(outputPath);
+	if (!*mOutput) throw runtime_error("Failed to open " + outputPath.string());
+	*mOutput << "time,samples";
+	for (const CompareMetric m : gMetrics)
+		*mOutput << "," << to_string(m);
+	*mOutput << endl;
+
+	// runs after OnUpdate, once the renderer has swapped its frame resources, so prev_radiance() is the frame recorded last.
+	// the evaluation only reads the renderer's output, so it is recorded into a secondary command buffer alongside other parallel listeners
+	mNode.find_in_ancestor<Application>()->OnRecordParallel.add_listener(mNode, bind_front(&Benchmark::update, this));
+}
+
+void Benchmark::update(CommandBuffer& commandBuffer, float deltaTime) {
+	ProfilerRegion ps("Benchmark::update", commandBuffer);
+
+	component_ptr<BDPT> renderer = mNode.find<BDPT>();
+	if (!renderer) return;
+	const Image::View image = renderer->prev_radiance();
+	const Image::View frameRadiance = renderer->prev_frame_radiance();
+	if (!image || !frameRadiance) return;
+
+	// without accumulation, prev_radiance() is a single frame, whose error does not fall with the sample count
+	component_ptr<Denoiser> denoiser = mNode.find<Denoiser>();
+	if (!denoiser || !renderer->denoise()) {
+		fprintf_color(ConsoleColor::eRed, stderr, "Benchmark: the renderer's output is not accumulated, enable the denoiser to run the benchmark\n");
+		mNode.find_in_ancestor<Application>()->quit();
+		return;
+	}
+
+	if (!mStarted) {
+		const ImageData pixels = load_image_data(commandBuffer.mDevice, mReferencePath, false, 4);
+		mReference = make_shared<Image>(commandBuffer, mReferencePath.filename().string(), pixels, 1, vk::ImageUsageFlagBits::eSampled);
+
+		if (denoiser->history_limit() > 0)
+			fprintf_color(ConsoleColor::eYellow, stderr, "Benchmark: the denoiser accumulates at most %g samples, so the error stops falling past that\n", denoiser->history_limit());
+
+		// accumulation starts over, so that the clock and sample count start with the first frame rendered from here
+		denoiser->reset_accumulation();
+		mSampleCounter = make_shared<Buffer>(commandBuffer.mDevice, "Benchmark/SampleCounter", 2*sizeof(uint32_t), vk::BufferUsageFlagBits::eStorageBuffer|vk::BufferUsageFlagBits::eTransferSrc|vk::BufferUsageFlagBits::eTransferDst, VMA_MEMORY_USAGE_GPU_ONLY);
+		commandBuffer->fillBuffer(**commandBuffer.hold_resource(mSampleCounter).buffer(), mSampleCounter.offset(), mSampleCounter.size_bytes(), 0);
+		mStartTime = chrono::steady_clock::now();
+		mStarted = true;
+		return;
+	}
+
+	count_samples(commandBuffer, frameRadiance);
+
+	// the budgets and intervals are checked against the CPU clock and the sample count of the last completed frame
+	const float time = chrono::duration<float>(chrono::steady_clock::now() - mStartTime).count();
+	const double samples = mSamples->load(memory_order_relaxed);
+	const bool done = (mTimeBudget > 0 && time >= mTimeBudget) || (mSampleBudget > 0 && samples >= mSampleBudget);
+	if (done ||
+		(mIntervalSamples > 0 && samples - mLastEvaluationSamples >= mIntervalSamples) ||
+		(mIntervalTime > 0 && time - mLastEvaluationTime >= mIntervalTime)) {
+		evaluate(commandBuffer, image);
+		mLastEvaluationTime = time;
+		mLastEvaluationSamples = samples;
+	}
+
+	if (done) mNode.find_in_ancestor<Application>()->quit();
+}
+
+void Benchmark::count_samples(CommandBuffer& commandBuffer, const Image::View& frameRadiance) {
+	if (!mSampleCountPipeline) {
+		if (!mCompareShader) mCompareShader = make_shared<Shader>(commandBuffer.mDevice, "Shaders/image_compare.spv");
+		mSampleCountPipeline = make_shared<ComputePipelineState>("benchmark_samples", mCompareShader);
+		mSampleCountPipeline->specialization_constant<uint32_t>("gMode") = (uint32_t)CompareMetric::eSampleCount;
+		mSampleCountPipeline->specialization_constant<uint32_t>("gQuantization") = mQuantization;
+	}
+
+	// the alpha channel of the frame's radiance is the number of paths traced for each pixel, and its mean is added to the counter
+	commandBuffer.barrier({ mSampleCounter }, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderRead|vk::AccessFlagBits::eShaderWrite);
+	mSampleCountPipeline->descriptor("gImage1") = image_descriptor(frameRadiance, vk::ImageLayout::eShaderReadOnlyOptimal, vk::AccessFlagBits::eShaderRead);
+	mSampleCountPipeline->descriptor("gImage2") = image_descriptor(frameRadiance, vk::ImageLayout::eShaderReadOnlyOptimal, vk::AccessFlagBits::eShaderRead);
+	mSampleCountPipeline->descriptor("gOutput") = mSampleCounter;
+	mSampleCountPipeline->transition_images(commandBuffer);
+	commandBuffer.bind_pipeline(mSampleCountPipeline->get_pipeline());
+	mSampleCountPipeline->bind_descriptor_sets(commandBuffer);
+	commandBuffer.dispatch_over(frameRadiance.extent());
+	commandBuffer.barrier({ mSampleCounter }, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderWrite, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferRead);
+
+	commandBuffer.readback<uint32_t>(mSampleCounter, [samples = mSamples, quantization = mQuantization](const Buffer::View<uint32_t>& data) {
+		samples->store((data[0] | ((uint64_t)data[1] << 32)) / (double)quantization, memory_order_relaxed);
+	});
+}
+
+void Benchmark::evaluate(CommandBuffer& commandBuffer, const Image::View& image) {
+	if (image.extent() != mReference.extent()) {
+		fprintf_color(ConsoleColor::eRed, stderr, "Benchmark: render extent (%ux%u) does not match the reference (%ux%u)\n",
+			image.extent().width, image.extent().height, mReference.extent().width, mReference.extent().height);
+		mNode.find_in_ancestor<Application>()->quit();
+		return;
+	}
+
+	ProfilerRegion ps("Benchmark::evaluate", commandBuffer);
+
+	// two words (a 64-bit fixed-point sum) per metric, followed by the sample counter
+	Buffer::View<uint32_t> results = make_shared<Buffer>(commandBuffer.mDevice, "Benchmark/Results", 2*(gMetrics.size() + 1)*sizeof(uint32_t), vk::BufferUsageFlagBits::eStorageBuffer|vk::BufferUsageFlagBits::eTransferSrc|vk::BufferUsageFlagBits::eTransferDst, VMA_MEMORY_USAGE_GPU_ONLY);
+	commandBuffer->fillBuffer(**commandBuffer.hold_resource(results).buffer(), results.offset(), results.size_bytes(), 0);
+	commandBuffer.barrier({ results }, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite, vk::PipelineStageFlagBits::eComputeShader|vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eShaderRead|vk::AccessFlagBits::eShaderWrite|vk::AccessFlagBits::eTransferWrite);
+	commandBuffer.copy_buffer(mSampleCounter, Buffer::View<uint32_t>(results, 2*gMetrics.size(), 2));
+
+	for (uint32_t i = 0; i < gMetrics.size(); i++) {
+		shared_ptr<ComputePipelineState>& pipeline = mComparePipelines[i];
+		if (!pipeline) {
+			if (!mCompareShader) mCompareShader = make_shared<Shader>(commandBuffer.mDevice, "Shaders/image_compare.spv");
+			pipeline = make_shared<ComputePipelineState>("benchmark_" + to_string(gMetrics[i]), mCompareShader);
+			pipeline->specialization_constant<uint32_t>("gMode") = (uint32_t)gMetrics[i];
+			pipeline->specialization_constant<uint32_t>("gQuantization") = mQuantization;
+		}
+		pipeline->descriptor("gImage1") = image_descriptor(image, vk::ImageLayout::eShaderReadOnlyOptimal, vk::AccessFlagBits::eShaderRead);
+		pipeline->descriptor("gImage2") = image_descriptor(mReference, vk::ImageLayout::eShaderReadOnlyOptimal, vk::AccessFlagBits::eShaderRead);
+		pipeline->descriptor("gOutput") = Buffer::View<uint32_t>(results, 2*i, 2);
+		pipeline->transition_images(commandBuffer);
+		commandBuffer.bind_pipeline(pipeline->get_pipeline());
+		pipeline->bind_descriptor_sets(commandBuffer);
+		commandBuffer.dispatch_over(image.extent());
+	}
+
+	commandBuffer.barrier({ results }, vk::PipelineStageFlagBits::eComputeShader|vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eShaderWrite|vk::AccessFlagBits::eTransferWrite, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferRead);
+	commandBuffer.readback<uint32_t>(results, [output = mOutput, startTime = mStartTime, quantization = mQuantization](const Buffer::View<uint32_t>& data) {
+		// taken once the command buffer is done, rather than when the frame was recorded
+		const float time = chrono::duration<float>(chrono::steady_clock::now() - startTime).count();
+		const auto value = [&](const size_t i) { return (data[2*i] | ((uint64_t)data[2*i + 1] << 32)) / (double)quantization; };
+		*output << time << "," << value(gMetrics.size());
+		for (uint32_t i = 0; i < gMetrics.size(); i++)
+			*output << "," << value(i);
+		*output << endl;
+	});
+}
+
+void benchmark_image_barriers(Device& device, const uint32_t imageCount) {
+	const vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eSampled|vk::ImageUsageFlagBits::eTransferSrc|vk::ImageUsageFlagBits::eTransferDst;
+	vector<shared_ptr<Image>> images(imageCount);
+	for (uint32_t i = 0; i < imageCount; i++) {
+		if (i % 2 == 0)
+			images[i] = make_shared<Image>(device, "barrier_benchmark_" + to_string(i), vk::Extent3D(1024, 1024, 1), vk::Format::eR8G8B8A8Unorm, 1, 0, vk::SampleCountFlagBits::e1, usage);
+		else
+			images[i] = make_shared<Image>(device, "barrier_benchmark_" + to_string(i), vk::Extent3D(256, 256, 1), vk::Format::eR8G8B8A8Unorm, 6, 0, vk::SampleCountFlagBits::e1, usage, VMA_MEMORY_USAGE_GPU_ONLY, vk::ImageCreateFlagBits::eCubeCompatible);
+	}
+
+	shared_ptr<CommandBuffer> commandBuffer = device.get_command_buffer("Barrier benchmark");
+	size_t barrierCount = 0;
+	size_t subresourceCount = 0;
+	const auto t0 = chrono::high_resolution_clock::now();
+	for (const shared_ptr<Image>& image : images) {
+		const uint32_t levels = image->level_count();
+		const uint32_t layers = image->layer_count();
+		// the transitions of an upload followed by generate_mip_maps, then sampling the whole image
+		barrierCount += image->transition_barrier(*commandBuffer, vk::ImageLayout::eTransferDstOptimal);
+		subresourceCount += levels*layers;
+		for (uint32_t level = 1; level < levels; level++) {
+			barrierCount += image->transition_barrier(*commandBuffer, vk::ImageLayout::eTransferSrcOptimal, vk::ImageSubresourceRange(image->aspect(), level - 1, 1, 0, layers));
+			subresourceCount += layers;
+		}
+		barrierCount += image->transition_barrier(*commandBuffer, vk::ImageLayout::eShaderReadOnlyOptimal);
+		subresourceCount += levels*layers;
+		// binding an already transitioned image
+		barrierCount += image->transition_barrier(*commandBuffer, vk::ImageLayout::eShaderReadOnlyOptimal);
+	}
+	const float ms = chrono::duration<float, milli>(chrono::high_resolution_clock::now() - t0).count();
+	device.submit(commandBuffer);
+	device.flush();
+
+	printf("Image barrier benchmark: %u images, %zu barriers recorded for %zu subresource transitions in %.3fms\n", imageCount, barrierCount, subresourceCount, ms);
+}
+
+void benchmark_command_buffers(Device& device, const uint32_t iterations) {
+	for (const uint32_t inFlight : { 0u, 16u, 256u, 4096u }) {
+		for (uint32_t i = 0; i < inFlight; i++)
+			device.submit(device.get_command_buffer("Command buffer benchmark"));
+
+		chrono::duration<double, micro> total(0);
+		for (uint32_t i = 0; i < iterations; i++) {
+			const auto t0 = chrono::high_resolution_clock::now();
+			shared_ptr<CommandBuffer> commandBuffer = device.get_command_buffer("Command buffer benchmark");
+			total += chrono::high_resolution_clock::now() - t0;
+			device.submit(commandBuffer);
+		}
+		device.flush();
+
+		printf("Command buffer benchmark: %u submitted ahead, %.3fus per get_command_buffer (%u calls)\n", inFlight, total.count()/iterations, iterations);
+	}
+}
+
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "BDPT.hpp"
+
+#include <Shaders/image_compare.h>
+
+namespace stm {
+
+// Non-interactive convergence benchmark. Compares the renderer's accumulated output to a reference image at regular intervals,
+// writes the error against time and samples to a CSV file, and quits the application once the time or sample budget is spent.
+// Samples are the mean number of paths traced per pixel, so adaptive sampling is compared fairly. Times are taken when the host sees
+// the evaluated frame complete, so they include its GPU work, and lag behind it by up to one device poll
+class Benchmark {
+public:
+	Node& mNode;
+
+	STRATUM_API Benchmark(Node& node);
+
+private:
+	static constexpr array<CompareMetric, 3> gMetrics = { CompareMetric::eMSE, CompareMetric::eRelMSE, CompareMetric::eSMAPE };
+
+	fs::path mReferencePath;
+	Image::View mReference;
+	shared_ptr<Shader> mCompareShader;
+	array<shared_ptr<ComputePipelineState>, gMetrics.size()> mComparePipelines;
+	uint32_t mQuantization = 0xFFFFFFFF; // fixed-point scale of the mean error. Large, so that per-wave partial sums keep their precision
+
+	float mTimeBudget = 0;       // seconds, 0 for unlimited
+	uint32_t mSampleBudget = 0;  // samples per pixel, 0 for unlimited
+	float mIntervalTime = 0;     // seconds between evaluations, 0 to only use mIntervalSamples
+	uint32_t mIntervalSamples = 16;
+
+	bool mStarted = false;
+	chrono::steady_clock::time_point mStartTime;
+	float mLastEvaluationTime = 0;
+	double mLastEvaluationSamples = 0;
+
+	// 64-bit fixed-point sum of the mean sample count of every frame since the start
+	Buffer::View<uint32_t> mSampleCounter;
+	shared_ptr<ComputePipelineState> mSampleCountPipeline;
+
+	// shared with pending readbacks, which complete after the frame that recorded them
+	shared_ptr<ofstream> mOutput;
+	shared_ptr<atomic<double>> mSamples = make_shared<atomic<double>>(0); // as of the last completed frame
+
+	STRATUM_API void update(CommandBuffer& commandBuffer, float deltaTime);
+	STRATUM_API void count_samples(CommandBuffer& commandBuffer, const Image::View& frameRadiance);
+	STRATUM_API void evaluate(CommandBuffer& commandBuffer, const Image::View& image);
+};
+
+// Records the layout transitions of uploading and sampling imageCount mipped textures and cubemaps, and prints the number of
+// barriers recorded against the number of subresources transitioned, along with the CPU time spent recording them
+STRATUM_API void benchmark_image_barriers(Device& device, uint32_t imageCount);
+// Times Device::get_command_buffer with increasing numbers of command buffers submitted ahead of it, and prints the mean time per call
+STRATUM_API void benchmark_command_buffers(Device& device, uint32_t iterations);
+
+}
@@ -61,11 +61,13 @@ void Denoiser::create_pipelines() {
 	process_shader(mTemporalAccumulationPipeline, "Shaders/temporal_accumulation.spv");
 	process_shader(mEstimateVariancePipeline, "Shaders/estimate_variance.spv");
 	process_shader(mAtrousPipeline, "Shaders/atrous.spv");
+	process_shader(mAtrousFusedPipeline, "Shaders/atrous_main_fused.spv");
 	process_shader(mCopyRGBPipeline, "Shaders/atrous_copy_rgb.spv");
 	/*/
 	process_shader(mTemporalAccumulationPipeline, "../../src/Shaders/kernels/temporal_accumulation.hlsl", "main");
 	process_shader(mEstimateVariancePipeline    , "../../src/Shaders/kernels/estimate_variance.hlsl", "main");
 	process_shader(mAtrousPipeline              , "../../src/Shaders/kernels/atrous.hlsl", "main");
+	process_shader(mAtrousFusedPipeline         , "../../src/Shaders/kernels/atrous.hlsl", "main_fused");
 	process_shader(mCopyRGBPipeline             , "../../src/Shaders/kernels/atrous.hlsl", "copy_rgb");
 	//*/
 	mDescriptorSetLayout = make_shared<DescriptorSetLayout>(instance->device(), "denoiser_descriptor_set_layout", bindings);
@@ -108,6 +110,7 @@ void Denoiser::on_inspector_gui() {
 		Gui::enum_dropdown("Filter", mAtrousPipeline->specialization_constant<uint32_t>("gFilterKernelType"), (uint32_t)FilterKernelType::eFilterKernelTypeCount, [](uint32_t i) { return to_string((FilterKernelType)i); });
 		ImGui::PushItemWidth(40);
 		ImGui::DragScalar("History Tap Iteration", ImGuiDataType_U32, &mHistoryTap, 0.1f);
+		ImGui::Checkbox("Fuse First Iterations", &mFuseAtrousIterations);
 		ImGui::Unindent();
 	}
 	ImGui::PopItemWidth();
@@ -119,6 +122,7 @@ Image::View Denoiser::denoise(
 	const Image::View& radiance,
 	const Image::View& albedo,
 	const Buffer::View<ViewData>& views,
+	const Image::View& view_indices,
 	const Buffer::View<VisibilityInfo>& visibility,
 	const Buffer::View<DepthInfo>& depth,
 	const Image::View& prev_uvs) {
@@ -136,7 +140,7 @@ Image::View Denoiser::denoise(
 
 		// reuse old frame resources
 		for (auto it = mFrameResources.begin(); it != mFrameResources.end(); it++) {
-			if (*it != mPrevFrame && (*it)->mFence->status() == vk::Result::eSuccess) {
+			if (*it != mPrevFrame && (*it)->mCompletion->done()) {
 				mCurFrame = *it;
 				mFrameResources.erase(it);
 				break;
@@ -144,10 +148,11 @@ Image::View Denoiser::denoise(
 		}
 		if (!mCurFrame) mCurFrame = make_shared<FrameResources>();
 
-		mCurFrame->mFence = commandBuffer.fence();
+		mCurFrame->mCompletion = commandBuffer.completion();
 	}
 
 	mCurFrame->mViews = views;
+	mCurFrame->mViewIndices = view_indices;
 	mCurFrame->mRadiance = radiance;
 	mCurFrame->mAlbedo = albedo;
 	mCurFrame->mVisibility = visibility;
@@ -179,6 +184,7 @@ Image::View Denoiser::denoise(
 	if (!mResetAccumulation && mPrevFrame && mPrevFrame->mRadiance && mPrevFrame->mRadiance.extent() == mCurFrame->mRadiance.extent()) {
 		mCurFrame->mDescriptorSet = make_shared<DescriptorSet>(mDescriptorSetLayout, "denoiser_view_descriptors");
 		mCurFrame->mDescriptorSet->insert_or_assign(mDescriptorMap.at("gViews"), mCurFrame->mViews);
+		mCurFrame->mDescriptorSet->insert_or_assign(mDescriptorMap.at("gViewIndices"), image_descriptor(mCurFrame->mViewIndices, vk::ImageLayout::eShaderReadOnlyOptimal, vk::AccessFlagBits::eShaderRead));
 		mCurFrame->mDescriptorSet->insert_or_assign(mDescriptorMap.at("gInstanceIndexMap"), mNode.find_in_ancestor<Scene>()->data()->mInstanceIndexMap);
 		mCurFrame->mDescriptorSet->insert_or_assign(mDescriptorMap.at("gVisibility"), mCurFrame->mVisibility);
 		mCurFrame->mDescriptorSet->insert_or_assign(mDescriptorMap.at("gPrevVisibility"), mPrevFrame->mVisibility);
@@ -229,39 +235,58 @@ Image::View Denoiser::denoise(
 
 			ProfilerRegion ps("Filter image", commandBuffer);
 			mAtrousPipeline->push_constant<uint32_t>("gViewCount") = (uint32_t)views.size();
-			commandBuffer.bind_pipeline(mAtrousPipeline->get_pipeline(mDescriptorSetLayout));
-			commandBuffer.bind_descriptor_set(0, mCurFrame->mDescriptorSet);
-			mAtrousPipeline->push_constants(commandBuffer);
 
-			for (uint32_t i = 0; i < mAtrousIterations; i++) {
+			// the fused kernel runs the first two iterations from groupshared memory in one dispatch,
+			// which is only possible when the history tap doesn't need the first iteration's output
+			const bool fuse = mFuseAtrousIterations && mAtrousIterations >= 2 && mHistoryTap != 1;
+			if (fuse) {
+				mAtrousFusedPipeline->push_constant<uint32_t>("gViewCount") = (uint32_t)views.size();
+				mAtrousFusedPipeline->push_constant<float>("gSigmaLuminanceBoost") = mAtrousPipeline->push_constant<float>("gSigmaLuminanceBoost");
+				mAtrousFusedPipeline->specialization_constant<uint32_t>("gFilterKernelType") = mAtrousPipeline->specialization_constant<uint32_t>("gFilterKernelType");
+			}
+
+			shared_ptr<ComputePipelineState> bound;
+			auto bind_filter_pipeline = [&](const shared_ptr<ComputePipelineState>& pipeline) {
+				if (bound == pipeline) return;
+				commandBuffer.bind_pipeline(pipeline->get_pipeline(mDescriptorSetLayout));
+				commandBuffer.bind_descriptor_set(0, mCurFrame->mDescriptorSet);
+				pipeline->push_constants(commandBuffer);
+				bound = pipeline;
+			};
+
+			// index of the ping-pong image holding the latest result
+			uint32_t cur = 0;
+			for (uint32_t i = 0; i < mAtrousIterations;) {
 				mCurFrame->mTemp[0].transition_barrier(commandBuffer, vk::PipelineStageFlagBits::eComputeShader, vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderRead|vk::AccessFlagBits::eShaderWrite);
 				mCurFrame->mTemp[1].transition_barrier(commandBuffer, vk::PipelineStageFlagBits::eComputeShader, vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderRead|vk::AccessFlagBits::eShaderWrite);
 
+				const bool fused = fuse && i == 0;
+				bind_filter_pipeline(fused ? mAtrousFusedPipeline : mAtrousPipeline);
 				commandBuffer.push_constant<uint32_t>("gIteration", i);
 				commandBuffer.push_constant<uint32_t>("gStepSize", 1 << i);
-				if (i > 0) mAtrousPipeline->transition_images(commandBuffer);
-				commandBuffer.write_timestamp(vk::PipelineStageFlagBits::eComputeShader, "Atrous filter");
+				commandBuffer.push_constant<uint32_t>("gInputIndex", cur);
+				if (i > 0) bound->transition_images(commandBuffer);
+				commandBuffer.write_timestamp(vk::PipelineStageFlagBits::eComputeShader, fused ? "Atrous filter (fused)" : "Atrous filter");
 				commandBuffer.dispatch_over(extent);
+				cur ^= 1;
+				i += fused ? 2 : 1;
 
-				if (i+1 == mHistoryTap) {
+				if (i == mHistoryTap) {
 					// copy rgb (keep w) to AccumColor
 					mCurFrame->mTemp[0].transition_barrier(commandBuffer, vk::PipelineStageFlagBits::eComputeShader, vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderRead|vk::AccessFlagBits::eShaderWrite);
 					mCurFrame->mTemp[1].transition_barrier(commandBuffer, vk::PipelineStageFlagBits::eComputeShader, vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderRead|vk::AccessFlagBits::eShaderWrite);
 
+					// the latest result is in mTemp[cur] whether or not the last dispatch was fused
 					commandBuffer.bind_pipeline(mCopyRGBPipeline->get_pipeline(mDescriptorSetLayout));
 					commandBuffer.bind_descriptor_set(0, mCurFrame->mDescriptorSet);
+					commandBuffer.push_constant<uint32_t>("gInputIndex", cur);
 					mCopyRGBPipeline->transition_images(commandBuffer);
 					commandBuffer.write_timestamp(vk::PipelineStageFlagBits::eComputeShader, "Copy RGB");
 					commandBuffer.dispatch_over(extent);
-
-					if (i+1 < mAtrousIterations) {
-						commandBuffer.bind_pipeline(mAtrousPipeline->get_pipeline(mDescriptorSetLayout));
-						commandBuffer.bind_descriptor_set(0, mCurFrame->mDescriptorSet);
-						mAtrousPipeline->push_constants(commandBuffer);
-					}
+					bound.reset();
 				}
 			}
-			output = mCurFrame->mTemp[mAtrousIterations%2];
+			output = mCurFrame->mTemp[cur];
 		}
 		mAccumulatedFrames++;
 	} else {
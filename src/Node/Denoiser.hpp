@@ -17,11 +17,16 @@ public:
 
 	STRATUM_API void on_inspector_gui();
 
-	STRATUM_API Image::View denoise(CommandBuffer& commandBuffer, const Image::View& radiance, const Image::View& albedo, const Buffer::View<ViewData>& views, const Buffer::View<VisibilityInfo>& visibility, const Buffer::View<DepthInfo>& depths, const Image::View& prev_uvs);
+	STRATUM_API Image::View denoise(CommandBuffer& commandBuffer, const Image::View& radiance, const Image::View& albedo, const Buffer::View<ViewData>& views, const Image::View& view_indices, const Buffer::View<VisibilityInfo>& visibility, const Buffer::View<DepthInfo>& depths, const Image::View& prev_uvs);
 
 	inline void reset_accumulation() { mResetAccumulation = true; mAccumulatedFrames = 0; }
 	inline bool reprojection() const { return mTemporalAccumulationPipeline->specialization_constant<uint32_t>("gReprojection"); }
 	inline bool demodulate_albedo() const { return mTemporalAccumulationPipeline->specialization_constant<uint32_t>("gDemodulateAlbedo"); }
+	inline float history_limit() const { return mTemporalAccumulationPipeline->push_constant<float>("gHistoryLimit"); }
+
+	// accumulation written by the last denoise() call. The alpha channel of the color is the accumulated sample count, which is 0 after a reset
+	inline Image::View accumulated_color() const { return mCurFrame ? mCurFrame->mAccumColor : Image::View(); }
+	inline Image::View accumulated_moments() const { return mCurFrame ? mCurFrame->mAccumMoments : Image::View(); }
 
 private:
 	Node& mNode;
@@ -29,14 +34,16 @@ private:
 	shared_ptr<ComputePipelineState> mTemporalAccumulationPipeline;
 	shared_ptr<ComputePipelineState> mEstimateVariancePipeline;
 	shared_ptr<ComputePipelineState> mAtrousPipeline;
+	shared_ptr<ComputePipelineState> mAtrousFusedPipeline;
 	shared_ptr<ComputePipelineState> mCopyRGBPipeline;
 
 	unordered_map<string, uint32_t> mDescriptorMap;
 	shared_ptr<DescriptorSetLayout> mDescriptorSetLayout;
 
 	struct FrameResources {
-		shared_ptr<Fence> mFence;
+		shared_ptr<TimelinePoint> mCompletion;
 		Buffer::View<ViewData> mViews;
+		Image::View mViewIndices;
 		Image::View mRadiance;
 		Image::View mAlbedo;
 		Buffer::View<VisibilityInfo> mVisibility;
@@ -55,6 +62,7 @@ private:
 	uint32_t mAccumulatedFrames = 0;
 	uint32_t mAtrousIterations = 0;
 	uint32_t mHistoryTap = 0;
+	bool mFuseAtrousIterations = true;
 	DenoiserDebugMode mDebugMode = DenoiserDebugMode::eNone;
 	bool mResetAccumulation = false;
 };
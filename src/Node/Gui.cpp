@@ -159,9 +159,28 @@ void Gui::make_geometry(CommandBuffer& commandBuffer) {
 	ImGui::Render();
 
 	mDrawData = ImGui::GetDrawData();
-	if (mDrawData && mDrawData->TotalVtxCount) {
-		Buffer::View<ImDrawVert> vertices = make_shared<Buffer>(commandBuffer.mDevice, "ImGui Vertices", mDrawData->TotalVtxCount*sizeof(ImDrawVert), vk::BufferUsageFlagBits::eVertexBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
-		Buffer::View<ImDrawIdx>  indices  = make_shared<Buffer>(commandBuffer.mDevice, "ImGui Indices" , mDrawData->TotalIdxCount*sizeof(ImDrawIdx), vk::BufferUsageFlagBits::eIndexBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
+	if (!mDrawData) return;
+
+	// reuse buffers from a frame the GPU is done with
+	if (mCurFrame) mFrameResourcePool.push_back(mCurFrame);
+	mCurFrame.reset();
+	for (auto it = mFrameResourcePool.begin(); it != mFrameResourcePool.end(); it++)
+		if ((*it)->mCompletion->done()) {
+			mCurFrame = *it;
+			mFrameResourcePool.erase(it);
+			break;
+		}
+	if (!mCurFrame) mCurFrame = make_shared<FrameResources>();
+	mCurFrame->mCompletion = commandBuffer.completion();
+
+	if (mDrawData->TotalVtxCount) {
+		// grow geometrically, so that the buffers settle at the largest size the gui needs
+		if (mCurFrame->mVertices.size() < mDrawData->TotalVtxCount)
+			mCurFrame->mVertices = make_shared<Buffer>(commandBuffer.mDevice, "ImGui Vertices", max<size_t>(mDrawData->TotalVtxCount, 2*mCurFrame->mVertices.size())*sizeof(ImDrawVert), vk::BufferUsageFlagBits::eVertexBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
+		if (mCurFrame->mIndices.size() < mDrawData->TotalIdxCount)
+			mCurFrame->mIndices = make_shared<Buffer>(commandBuffer.mDevice, "ImGui Indices", max<size_t>(mDrawData->TotalIdxCount, 2*mCurFrame->mIndices.size())*sizeof(ImDrawIdx), vk::BufferUsageFlagBits::eIndexBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
+		const Buffer::View<ImDrawVert>& vertices = mCurFrame->mVertices;
+		const Buffer::View<ImDrawIdx>& indices = mCurFrame->mIndices;
 		auto dstVertex = vertices.begin();
 		auto dstIndex  = indices.begin();
 		for (const ImDrawList* cmdList : span(mDrawData->CmdLists, mDrawData->CmdListsCount)) {
@@ -197,30 +216,43 @@ void Gui::make_geometry(CommandBuffer& commandBuffer) {
 	}
 }
 void Gui::render(CommandBuffer& commandBuffer, const Image::View& dst) {
-	if (mHidden || !mDrawData || mDrawData->CmdListsCount <= 0 || mDrawData->DisplaySize.x == 0 || mDrawData->DisplaySize.y == 0) return;
+	if (mHidden || !mDrawData || !mCurFrame || mDrawData->CmdListsCount <= 0 || mDrawData->DisplaySize.x == 0 || mDrawData->DisplaySize.y == 0) return;
 
 	ProfilerRegion ps("Gui::render", commandBuffer);
 
 	commandBuffer.write_timestamp(vk::PipelineStageFlagBits::eVertexInput, "Gui::render");
 
-	RenderPass::SubpassDescription subpass {
-		{ "colorBuffer", {
-			AttachmentType::eColor, blend_mode_state(), vk::AttachmentDescription{ {},
-				dst.image()->format(), dst.image()->sample_count(),
-				vk::AttachmentLoadOp::eLoad, vk::AttachmentStoreOp::eStore, vk::AttachmentLoadOp::eDontCare, vk::AttachmentStoreOp::eDontCare,
-				vk::ImageLayout::eColorAttachmentOptimal, vk::ImageLayout::eColorAttachmentOptimal } }
-		}
-	};
-	auto renderPass = make_shared<RenderPass>(dst.image()->mDevice, "Gui RenderPass", ranges::single_view { subpass });
-	auto framebuffer = make_shared<Framebuffer>(*renderPass, "Gui Framebuffer", ranges::single_view { dst });
+	shared_ptr<RenderPass>& renderPass = mRenderPasses[{ dst.image()->format(), dst.image()->sample_count() }];
+	if (!renderPass) {
+		RenderPass::SubpassDescription subpass {
+			{ "colorBuffer", {
+				AttachmentType::eColor, blend_mode_state(), vk::AttachmentDescription{ {},
+					dst.image()->format(), dst.image()->sample_count(),
+					vk::AttachmentLoadOp::eLoad, vk::AttachmentStoreOp::eStore, vk::AttachmentLoadOp::eDontCare, vk::AttachmentStoreOp::eDontCare,
+					vk::ImageLayout::eColorAttachmentOptimal, vk::ImageLayout::eColorAttachmentOptimal } }
+			}
+		};
+		renderPass = make_shared<RenderPass>(dst.image()->mDevice, "Gui RenderPass", ranges::single_view { subpass });
+	}
+
+	// framebuffers are cached per target view, and dropped once the view stops being rendered to (e.g. after a swapchain resize)
+	mFrameCount++;
+	erase_if(mFramebuffers, [&](const auto& p) { return p.second.second + 8 < mFrameCount; });
+	auto&[framebuffer, lastUsed] = mFramebuffers[dst];
+	if (!framebuffer) framebuffer = make_shared<Framebuffer>(*renderPass, "Gui Framebuffer", ranges::single_view { dst });
+	lastUsed = mFrameCount;
 	commandBuffer.begin_render_pass(renderPass, framebuffer, vk::Rect2D{ {}, framebuffer->extent() }, { {} });
 
 	float2 scale = float2::Map(&mDrawData->DisplaySize.x);
 	float2 offset = float2::Map(&mDrawData->DisplayPos.x);
 
-	Buffer::View<TransformData> identity_transform = make_shared<Buffer>(commandBuffer.mDevice, "gCameraTransform", sizeof(TransformData), vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
-	identity_transform[0] = make_transform(float3(0,0,1), quatf_identity(), float3::Ones());
-	Buffer::View<ViewData> views = make_shared<Buffer>(commandBuffer.mDevice, "gCameraData", sizeof(ViewData), vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
+	if (!mCurFrame->mViews) {
+		mCurFrame->mTransform = make_shared<Buffer>(commandBuffer.mDevice, "gCameraTransform", sizeof(TransformData), vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
+		mCurFrame->mTransform[0] = make_transform(float3(0,0,1), quatf_identity(), float3::Ones());
+		mCurFrame->mViews = make_shared<Buffer>(commandBuffer.mDevice, "gCameraData", sizeof(ViewData), vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
+	}
+	const Buffer::View<TransformData>& identity_transform = mCurFrame->mTransform;
+	const Buffer::View<ViewData>& views = mCurFrame->mViews;
 	views[0].projection = make_orthographic(scale, -1 - offset.array()*2/scale.array(), 0, 1);
 	views[0].image_min = { 0, 0 };
 	views[0].image_max = { framebuffer->extent().width, framebuffer->extent().height };
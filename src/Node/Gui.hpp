@@ -115,6 +115,9 @@ inline void imgui_vk_scalar(const char* label, vk::Format format, void* data) {
 	}
 }
 
+struct TransformData;
+struct ViewData;
+
 class Gui {
 public:
 	STRATUM_API Gui(Node& node);
@@ -153,10 +156,24 @@ public:
 	}
 
 private:
+	// geometry and camera buffers, reused once the frame that last used them has finished
+	struct FrameResources {
+		shared_ptr<TimelinePoint> mCompletion;
+		Buffer::View<ImDrawVert> mVertices;
+		Buffer::View<ImDrawIdx> mIndices;
+		Buffer::View<TransformData> mTransform;
+		Buffer::View<ViewData> mViews;
+	};
+
 	Node& mNode;
 	shared_ptr<GraphicsPipelineState> mPipeline;
 	unordered_map<Image::View, uint32_t> mImageMap;
 	Mesh mMesh;
+	list<shared_ptr<FrameResources>> mFrameResourcePool;
+	shared_ptr<FrameResources> mCurFrame;
+	map<pair<vk::Format, vk::SampleCountFlagBits>, shared_ptr<RenderPass>> mRenderPasses;
+	unordered_map<Image::View, pair<shared_ptr<Framebuffer>, size_t/*last used frame*/>> mFramebuffers;
+	size_t mFrameCount = 0;
 	ImGuiContext* mContext;
 	const ImDrawData* mDrawData;
 	ImFont* mFont;
@@ -59,8 +59,10 @@ ImageComparer::ImageComparer(Node& node) : mNode(node) {
 						update = true;
 
 					if (update) {
-						if (!mse)
-							mse = make_shared<Buffer>(commandBuffer.mDevice, "MSE", 2*sizeof(uint32_t), vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_CPU_ONLY);
+						if (!mse) {
+							mse = make_shared<CompareResult>();
+							mse->mBuffer = make_shared<Buffer>(commandBuffer.mDevice, "MSE", 2*sizeof(uint32_t), vk::BufferUsageFlagBits::eStorageBuffer|vk::BufferUsageFlagBits::eTransferSrc|vk::BufferUsageFlagBits::eTransferDst, VMA_MEMORY_USAGE_GPU_ONLY);
+						}
 
 						if (!mImageComparePipeline)
 							mImageComparePipeline = make_shared<ComputePipelineState>("mse", make_shared<Shader>(commandBuffer.mDevice, "Shaders/image_compare.spv"));
@@ -71,21 +73,25 @@ ImageComparer::ImageComparer(Node& node) : mNode(node) {
 							mImageComparePipeline->specialization_constant<uint32_t>("gQuantization") = mMSEQuantization;
 							mImageComparePipeline->descriptor("gImage1") = image_descriptor(mImages.at(*mComparing.begin()).second, vk::ImageLayout::eShaderReadOnlyOptimal, vk::AccessFlagBits::eShaderRead);
 							mImageComparePipeline->descriptor("gImage2") = image_descriptor(mImages.at(*++mComparing.begin()).second, vk::ImageLayout::eShaderReadOnlyOptimal, vk::AccessFlagBits::eShaderRead);
-							mImageComparePipeline->descriptor("gOutput") = mse;
-							mse[0] = 0;
-							mse[1] = 0;
+							mImageComparePipeline->descriptor("gOutput") = mse->mBuffer;
+							commandBuffer->fillBuffer(**commandBuffer.hold_resource(mse->mBuffer).buffer(), mse->mBuffer.offset(), mse->mBuffer.size_bytes(), 0);
+							commandBuffer.barrier({ mse->mBuffer }, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderRead|vk::AccessFlagBits::eShaderWrite);
 							commandBuffer.bind_pipeline(mImageComparePipeline->get_pipeline());
 							mImageComparePipeline->bind_descriptor_sets(commandBuffer);
 							commandBuffer.dispatch_over(mImages.at(*mComparing.begin()).second.extent());
+							commandBuffer.barrier({ mse->mBuffer }, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderWrite, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferRead);
 						}
+
+						commandBuffer.readback<uint32_t>(mse->mBuffer, [result = mse, mode = mMSEMode, quantization = mMSEQuantization](const Buffer::View<uint32_t>& data) {
+							const double value = (data[0] | ((uint64_t)data[1] << 32)) / (double)quantization;
+							result->mValue.store(mode == (uint32_t)CompareMetric::eMSE ? sqrt(value) : value, memory_order_relaxed);
+							result->mValid.store(true, memory_order_release);
+						});
 					}
 
-					if (mse && !mse.buffer()->in_use()) {
+					if (mse && mse->mValid.load(memory_order_acquire)) {
 						ImGui::SameLine();
-						if (mse[1])
-							ImGui::Text("OVERFLOW");
-						else
-							ImGui::Text("%f", mMSEMode == (uint32_t)CompareMetric::eMSE ? sqrt(mse[0]/(float)mMSEQuantization) : mse[0]/(float)mMSEQuantization);
+						ImGui::Text("%f", mse->mValue.load(memory_order_relaxed));
 					}
 				}
 			}
@@ -13,7 +13,14 @@ public:
 
 private:
 	shared_ptr<ComputePipelineState> mImageComparePipeline;
-	unordered_map<string, Buffer::View<uint32_t>> mMSE;
+	struct CompareResult {
+		Buffer::View<uint32_t> mBuffer;
+		// written by the readback, which may run on another thread. mValid is set after mValue with release ordering
+		atomic<float> mValue = 0;
+		atomic<bool> mValid = false;
+	};
+	// results are shared with pending readbacks, which may complete after the comparer is destroyed
+	unordered_map<string, shared_ptr<CompareResult>> mMSE;
 	uint32_t mMSEMode = 0;
 	uint32_t mMSEQuantization = 1024;
 
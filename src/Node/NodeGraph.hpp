@@ -188,6 +188,16 @@ public:
 					++it;
 		}
 
+		// Listeners whose node still exists, in the order operator() would call them
+		inline vector<function_t> listeners() const {
+			vector<function_t> result;
+			result.reserve(mListeners.size());
+			for (const auto&[n, fn, p] : mListeners)
+				if (mNodeGraph->contains(n))
+					result.emplace_back(fn);
+			return result;
+		}
+
 		inline void operator()(Args... args) const {
 			vector<tuple<const Node*, function_t, uint32_t>> tmp(mListeners.size());
 			ranges::copy(mListeners, tmp.begin());
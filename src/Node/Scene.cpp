@@ -116,6 +116,43 @@ TransformData node_to_world(const Node& node) {
 	return transform;
 }
 
+Mesh upload_mesh(CommandBuffer& commandBuffer, const MeshData& data) {
+	vk::BufferUsageFlags bufferUsage = vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer;
+#ifdef VK_KHR_buffer_device_address
+	bufferUsage |= vk::BufferUsageFlagBits::eShaderDeviceAddress;
+	bufferUsage |= vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR;
+#endif
+
+	// staging buffers are typically write-combined, so each one is written with a single memcpy
+	auto upload = [&]<typename T>(const vector<T>& src, const string& name, vk::BufferUsageFlags usage) {
+		Buffer::View<T> tmp = make_shared<Buffer>(commandBuffer.mDevice, "tmp " + name, src.size() * sizeof(T), vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_TO_GPU);
+		memcpy(tmp.data(), src.data(), tmp.size_bytes());
+		Buffer::View<T> dst = make_shared<Buffer>(commandBuffer.mDevice, data.mName + " " + name, tmp.size_bytes(), bufferUsage|usage, VMA_MEMORY_USAGE_GPU_ONLY);
+		commandBuffer.copy_buffer(tmp, dst);
+		return dst;
+	};
+
+	unordered_map<VertexArrayObject::AttributeType, vector<VertexArrayObject::Attribute>> attributes;
+	attributes[VertexArrayObject::AttributeType::ePosition].emplace_back(
+		VertexArrayObject::AttributeDescription{ (uint32_t)sizeof(float3), vk::Format::eR32G32B32Sfloat, 0, vk::VertexInputRate::eVertex },
+		upload(data.mPositions, "positions", vk::BufferUsageFlagBits::eVertexBuffer));
+	if (!data.mNormals.empty())
+		attributes[VertexArrayObject::AttributeType::eNormal].emplace_back(
+			VertexArrayObject::AttributeDescription{ (uint32_t)sizeof(float3), vk::Format::eR32G32B32Sfloat, 0, vk::VertexInputRate::eVertex },
+			upload(data.mNormals, "normals", vk::BufferUsageFlagBits::eVertexBuffer));
+	if (!data.mTexcoords.empty())
+		attributes[VertexArrayObject::AttributeType::eTexcoord].emplace_back(
+			VertexArrayObject::AttributeDescription{ (uint32_t)sizeof(float2), vk::Format::eR32G32Sfloat, 0, vk::VertexInputRate::eVertex },
+			upload(data.mTexcoords, "uvs", vk::BufferUsageFlagBits::eVertexBuffer));
+	if (!data.mColors.empty())
+		attributes[VertexArrayObject::AttributeType::eColor].emplace_back(
+			VertexArrayObject::AttributeDescription{ (uint32_t)sizeof(float3), vk::Format::eR32G32B32Sfloat, 0, vk::VertexInputRate::eVertex },
+			upload(data.mColors, "colors", vk::BufferUsageFlagBits::eVertexBuffer));
+
+	Buffer::View<uint32_t> indexBuffer = upload(data.mIndices, "indices", vk::BufferUsageFlagBits::eIndexBuffer);
+	return Mesh(make_shared<VertexArrayObject>(attributes), indexBuffer, vk::PrimitiveTopology::eTriangleList);
+}
+
 void Scene::load_environment_map(Node& root, CommandBuffer& commandBuffer, const fs::path& filepath) {
 	root.make_component<Environment>(load_environment(commandBuffer, filepath));
 }
@@ -272,6 +309,8 @@ Scene::Scene(Node& node) : mNode(node) {
 	gAnimatedTransform = nullptr;
 
 	mCopyVerticesPipeline 				 = make_shared<ComputePipelineState>("copy_vertices", make_shared<Shader>(app->window().mInstance.device(), "Shaders/copy_vertices.spv"));
+	mComputeVertexBoundsPipeline 		 = make_shared<ComputePipelineState>("copy_vertices_compute_bounds", make_shared<Shader>(app->window().mInstance.device(), "Shaders/copy_vertices_compute_bounds.spv"));
+	mCompactVerticesPipeline 			 = make_shared<ComputePipelineState>("copy_vertices_compact", make_shared<Shader>(app->window().mInstance.device(), "Shaders/copy_vertices_compact.spv"));
 	mConvertDiffuseSpecularPipeline 	 = make_shared<ComputePipelineState>("material_convert_from_diffuse_specular", make_shared<Shader>(app->window().mInstance.device(), "Shaders/material_convert_from_diffuse_specular.spv"));
 	mConvertPbrPipeline 				 = make_shared<ComputePipelineState>("material_convert_from_gltf_pbr", make_shared<Shader>(app->window().mInstance.device(), "Shaders/material_convert_from_gltf_pbr.spv"));
 	mConvertAlphaToRoughnessPipeline 	 = make_shared<ComputePipelineState>("material_convert_alpha_to_roughness", make_shared<Shader>(app->window().mInstance.device(), "Shaders/material_convert_alpha_to_roughness.spv"));
@@ -279,6 +318,8 @@ Scene::Scene(Node& node) : mNode(node) {
 
 	for (const string& arg : app->window().mInstance.find_arguments("scene"))
 		mToLoad.emplace_back(arg);
+
+	mCompactVertices = app->window().mInstance.find_argument("compactVertices").has_value();
 }
 
 void Scene::on_inspector_gui() {
@@ -287,6 +328,8 @@ void Scene::on_inspector_gui() {
 		ImGui::Text("%lu light instances", mSceneData->mLightInstanceMap.size());
 		ImGui::Text("%lu emissive primitives", mSceneData->mEmissivePrimitiveCount);
 		ImGui::Text("%u materials", mSceneData->mMaterialCount);
+		if (mSceneData->mVertices)
+			ImGui::Text("%llu KiB vertex data (%s)", (unsigned long long)mSceneData->mVertices.size_bytes() / 1024, mSceneData->mCompactVertices ? "compact" : "uncompressed");
 	}
 	if (ImGui::Button("Load File")) {
 		auto f = pfd::open_file("Open scene", "", loader_filters());
@@ -346,7 +389,8 @@ void Scene::update(CommandBuffer& commandBuffer, const float deltaTime) {
 
 	mUpdateOnce = loaded && !mAlwaysUpdate;
 
-	uint32_t totalVertexCount = 0;
+	uint32_t totalVertexCount = 0; // in units of vertexStride
+	const uint32_t vertexStride = mCompactVertices ? sizeof(CompactVertexData) : sizeof(PackedVertexData);
 	uint32_t totalIndexBufferSize = 0;
 
 	auto mPrevFrame = mSceneData;
@@ -358,6 +402,7 @@ void Scene::update(CommandBuffer& commandBuffer, const float deltaTime) {
 
 	mSceneData->mEmissivePrimitiveCount = 0;
 	mSceneData->mMaterialCount = 0;
+	mSceneData->mCompactVertices = mCompactVertices;
 	ByteAppendBuffer materialData;
 	materialData.data.reserve(mPrevFrame && mPrevFrame->mMaterialData ? mPrevFrame->mMaterialData.size() / sizeof(uint32_t) : 1);
 	unordered_map<const Material*, uint32_t> materialMap;
@@ -397,13 +442,14 @@ void Scene::update(CommandBuffer& commandBuffer, const float deltaTime) {
 
 	auto process_instance = [&](const component_ptr<void>& prim, const InstanceData& instance, const TransformData& transform, const float emissive_power) {
 		const uint32_t instance_index = (uint32_t)instanceDatas.size();
+		if (instance_index >= MAX_INSTANCE_COUNT) throw runtime_error("Scene has more than " + to_string(MAX_INSTANCE_COUNT) + " instances");
 		instanceDatas.emplace_back(instance);
 		mSceneData->mInstanceNodes.emplace_back(&prim.node());
 
 		uint32_t light_index = INVALID_INSTANCE;
 		if (emissive_power > 0) {
 			light_index = (uint32_t)lightInstanceMap.size();
-			BF_SET(instanceDatas[instance_index].packed[1], lightInstancePowers.size(), 0, 12);
+			instanceDatas[instance_index].packed[0][1] = (uint32_t)lightInstancePowers.size();
 			lightInstanceMap.emplace_back(instance_index);
 			lightInstancePowers.emplace_back(emissive_power);
 		}
@@ -459,29 +505,64 @@ void Scene::update(CommandBuffer& commandBuffer, const float deltaTime) {
 
 				// copy vertex data
 				if (mMeshVertices.find(prim->mMesh.get()) == mMeshVertices.end()) {
-					Buffer::View<PackedVertexData>& vertices = mMeshVertices.emplace(prim->mMesh.get(),
-						make_shared<Buffer>(commandBuffer.mDevice, prim.node().name() + "/PackedVertexData", triangles.maxVertex * sizeof(PackedVertexData), vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eShaderDeviceAddress)).first->second;
-
 					auto positions = prim->mMesh->vertices()->at(VertexArrayObject::AttributeType::ePosition)[0];
 					auto normals = prim->mMesh->vertices()->at(VertexArrayObject::AttributeType::eNormal)[0];
 					auto texcoords = prim->mMesh->vertices()->find(VertexArrayObject::AttributeType::eTexcoord);
 					//auto tangents = prim->mMesh->vertices()->find(VertexArrayObject::AttributeType::eTangent);
 
-					mCopyVerticesPipeline->descriptor("gVertices") = vertices;
-					mCopyVerticesPipeline->descriptor("gPositions") = Buffer::View(positions.second, positions.first.mOffset);
-					mCopyVerticesPipeline->descriptor("gNormals") = Buffer::View(normals.second, normals.first.mOffset);
-					//mCopyVerticesPipeline->descriptor("gTangents") = tangents ? Buffer::View(tangents->second, tangents->first.mOffset) : positions.second;
-					mCopyVerticesPipeline->descriptor("gTexcoords") = texcoords ? Buffer::View(texcoords->second, texcoords->first.mOffset) : positions.second;
-					mCopyVerticesPipeline->push_constant<uint32_t>("gCount") = vertices.size();
-					mCopyVerticesPipeline->push_constant<uint32_t>("gPositionStride") = positions.first.mStride;
-					mCopyVerticesPipeline->push_constant<uint32_t>("gNormalStride") = normals.first.mStride;
-					//mCopyVerticesPipeline->push_constant<uint32_t>("gTangentStride") = tangents ? tangents->first.mStride : 0;
-					mCopyVerticesPipeline->push_constant<uint32_t>("gTexcoordStride") = texcoords ? texcoords->first.mStride : 0;
-					commandBuffer.bind_pipeline(mCopyVerticesPipeline->get_pipeline());
-					mCopyVerticesPipeline->bind_descriptor_sets(commandBuffer);
-					mCopyVerticesPipeline->push_constants(commandBuffer);
-					commandBuffer.dispatch_over(triangles.maxVertex);
-					commandBuffer.barrier({ vertices }, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderWrite, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferRead);
+					if (mCompactVertices) {
+						Buffer::View<CompactVertexData> vertices = make_shared<Buffer>(commandBuffer.mDevice, prim.node().name() + "/CompactVertexData", (COMPACT_VERTEX_BOUNDS_SLOTS + triangles.maxVertex) * sizeof(CompactVertexData), vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eShaderDeviceAddress);
+						mMeshVertices.emplace(prim->mMesh.get(), vertices);
+
+						Buffer::View<uint32_t> bounds = make_shared<Buffer>(commandBuffer.mDevice, prim.node().name() + "/VertexBounds", 6 * sizeof(uint32_t), vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst);
+						commandBuffer->fillBuffer(**bounds.buffer(), bounds.offset(), 3 * sizeof(uint32_t), ~0u);
+						commandBuffer->fillBuffer(**bounds.buffer(), bounds.offset() + 3 * sizeof(uint32_t), 3 * sizeof(uint32_t), 0);
+						commandBuffer.barrier({ bounds }, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+
+						mComputeVertexBoundsPipeline->descriptor("gBounds") = bounds;
+						mComputeVertexBoundsPipeline->descriptor("gPositions") = Buffer::View(positions.second, positions.first.mOffset);
+						mComputeVertexBoundsPipeline->push_constant<uint32_t>("gCount") = triangles.maxVertex;
+						mComputeVertexBoundsPipeline->push_constant<uint32_t>("gPositionStride") = positions.first.mStride;
+						commandBuffer.bind_pipeline(mComputeVertexBoundsPipeline->get_pipeline());
+						mComputeVertexBoundsPipeline->bind_descriptor_sets(commandBuffer);
+						mComputeVertexBoundsPipeline->push_constants(commandBuffer);
+						commandBuffer.dispatch_over(triangles.maxVertex);
+						commandBuffer.barrier({ bounds }, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderWrite, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderRead);
+
+						mCompactVerticesPipeline->descriptor("gCompactVertices") = vertices;
+						mCompactVerticesPipeline->descriptor("gBounds") = bounds;
+						mCompactVerticesPipeline->descriptor("gPositions") = Buffer::View(positions.second, positions.first.mOffset);
+						mCompactVerticesPipeline->descriptor("gNormals") = Buffer::View(normals.second, normals.first.mOffset);
+						mCompactVerticesPipeline->descriptor("gTexcoords") = texcoords ? Buffer::View(texcoords->second, texcoords->first.mOffset) : positions.second;
+						mCompactVerticesPipeline->push_constant<uint32_t>("gCount") = triangles.maxVertex;
+						mCompactVerticesPipeline->push_constant<uint32_t>("gPositionStride") = positions.first.mStride;
+						mCompactVerticesPipeline->push_constant<uint32_t>("gNormalStride") = normals.first.mStride;
+						mCompactVerticesPipeline->push_constant<uint32_t>("gTexcoordStride") = texcoords ? texcoords->first.mStride : 0;
+						commandBuffer.bind_pipeline(mCompactVerticesPipeline->get_pipeline());
+						mCompactVerticesPipeline->bind_descriptor_sets(commandBuffer);
+						mCompactVerticesPipeline->push_constants(commandBuffer);
+						commandBuffer.dispatch_over(triangles.maxVertex);
+						commandBuffer.barrier({ vertices }, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderWrite, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferRead);
+					} else {
+						Buffer::View<PackedVertexData> vertices = make_shared<Buffer>(commandBuffer.mDevice, prim.node().name() + "/PackedVertexData", triangles.maxVertex * sizeof(PackedVertexData), vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eShaderDeviceAddress);
+						mMeshVertices.emplace(prim->mMesh.get(), vertices);
+
+						mCopyVerticesPipeline->descriptor("gVertices") = vertices;
+						mCopyVerticesPipeline->descriptor("gPositions") = Buffer::View(positions.second, positions.first.mOffset);
+						mCopyVerticesPipeline->descriptor("gNormals") = Buffer::View(normals.second, normals.first.mOffset);
+						//mCopyVerticesPipeline->descriptor("gTangents") = tangents ? Buffer::View(tangents->second, tangents->first.mOffset) : positions.second;
+						mCopyVerticesPipeline->descriptor("gTexcoords") = texcoords ? Buffer::View(texcoords->second, texcoords->first.mOffset) : positions.second;
+						mCopyVerticesPipeline->push_constant<uint32_t>("gCount") = vertices.size();
+						mCopyVerticesPipeline->push_constant<uint32_t>("gPositionStride") = positions.first.mStride;
+						mCopyVerticesPipeline->push_constant<uint32_t>("gNormalStride") = normals.first.mStride;
+						//mCopyVerticesPipeline->push_constant<uint32_t>("gTangentStride") = tangents ? tangents->first.mStride : 0;
+						mCopyVerticesPipeline->push_constant<uint32_t>("gTexcoordStride") = texcoords ? texcoords->first.mStride : 0;
+						commandBuffer.bind_pipeline(mCopyVerticesPipeline->get_pipeline());
+						mCopyVerticesPipeline->bind_descriptor_sets(commandBuffer);
+						mCopyVerticesPipeline->push_constants(commandBuffer);
+						commandBuffer.dispatch_over(triangles.maxVertex);
+						commandBuffer.barrier({ vertices }, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderWrite, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferRead);
+					}
 				}
 
 				it = mMeshAccelerationStructures.emplace(key, MeshAS{ as, prim->mMesh->indices() }).first;
@@ -498,12 +579,12 @@ void Scene::update(CommandBuffer& commandBuffer, const float deltaTime) {
 
 			vk::AccelerationStructureInstanceKHR& instance = instancesAS.emplace_back();
 			Eigen::Matrix<float, 3, 4, Eigen::RowMajor>::Map(&instance.transform.matrix[0][0]) = to_float3x4(transform);
-			instance.instanceCustomIndex = process_instance(component_ptr<void>(prim), make_instance_triangles(material_address, triCount, totalVertexCount, totalIndexBufferSize, (uint32_t)it->second.mIndices.stride()), transform, prim->mMaterial->emission() * area);
+			instance.instanceCustomIndex = process_instance(component_ptr<void>(prim), make_instance_triangles(material_address, triCount, totalVertexCount + (mCompactVertices ? COMPACT_VERTEX_BOUNDS_SLOTS : 0), totalIndexBufferSize, (uint32_t)it->second.mIndices.stride()), transform, prim->mMaterial->emission() * area);
 			instance.mask = BVH_FLAG_TRIANGLES;
 			instance.accelerationStructureReference = commandBuffer.mDevice->getAccelerationStructureAddressKHR(*commandBuffer.hold_resource(it->second.mAccelerationStructure));
 
 			meshInstanceIndices.emplace_back(prim.get(), &it->second, (uint32_t)instance.instanceCustomIndex);
-			totalVertexCount += mMeshVertices.at(prim->mMesh.get()).size();
+			totalVertexCount += mMeshVertices.at(prim->mMesh.get()).size_bytes() / vertexStride;
 			totalIndexBufferSize += align_up(it->second.mIndices.size_bytes(), 4);
 		});
 	}
@@ -643,15 +724,18 @@ void Scene::update(CommandBuffer& commandBuffer, const float deltaTime) {
 	{ // copy vertices and indices
 		ProfilerRegion s("Copy vertex data", commandBuffer);
 
-		if (!mSceneData->mVertices || mSceneData->mVertices.size() < totalVertexCount)
-			mSceneData->mVertices = make_shared<Buffer>(commandBuffer.mDevice, "gVertices", max(totalVertexCount, 1u) * sizeof(PackedVertexData), vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_GPU_ONLY, 16);
+		if (!mSceneData->mVertices || mSceneData->mVertices.size_bytes() < totalVertexCount * vertexStride) {
+			mSceneData->mVertices = make_shared<Buffer>(commandBuffer.mDevice, "gVertices", max(totalVertexCount, 1u) * vertexStride, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_GPU_ONLY, 16);
+			cout << "Allocated " << mSceneData->mVertices.size_bytes() / 1024 << " KiB of vertex data (" << (mCompactVertices ? "compact" : "uncompressed") << ")" << endl;
+		}
 		if (!mSceneData->mIndices || mSceneData->mIndices.size() < totalIndexBufferSize)
 			mSceneData->mIndices = make_shared<Buffer>(commandBuffer.mDevice, "gIndices", align_up(max(totalIndexBufferSize, 1u), sizeof(uint32_t)), vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_GPU_ONLY, 4);
 
 		for (const auto& [prim, blas, instanceIndex] : meshInstanceIndices) {
 			const InstanceData& d = instanceDatas[instanceIndex];
-			Buffer::View<PackedVertexData>& meshVertices = mMeshVertices.at(prim->mMesh.get());
-			commandBuffer.copy_buffer(meshVertices, Buffer::View<PackedVertexData>(mSceneData->mVertices.buffer(), d.first_vertex() * sizeof(PackedVertexData), meshVertices.size()));
+			const Buffer::View<byte>& meshVertices = mMeshVertices.at(prim->mMesh.get());
+			const uint32_t firstSlot = d.first_vertex() - (mCompactVertices ? COMPACT_VERTEX_BOUNDS_SLOTS : 0);
+			commandBuffer.copy_buffer(meshVertices, Buffer::View<byte>(mSceneData->mVertices.buffer(), firstSlot * vertexStride, meshVertices.size_bytes()));
 			commandBuffer.copy_buffer(blas->mIndices, Buffer::View<std::byte>(mSceneData->mIndices.buffer(), d.indices_byte_offset(), blas->mIndices.size_bytes()));
 		}
 		commandBuffer.barrier({ mSceneData->mIndices, mSceneData->mVertices }, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderRead);
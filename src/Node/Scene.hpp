@@ -38,8 +38,25 @@ struct SpherePrimitive {
 
 STRATUM_API TransformData node_to_world(const Node& node);
 
-STRATUM_API Mesh load_serialized(CommandBuffer& commandBuffer, const fs::path& filename, int shape_idx = -1);
-STRATUM_API Mesh load_obj(CommandBuffer& commandBuffer, const fs::path& filename);
+// Host-side mesh data. Decoding into a MeshData does not touch a CommandBuffer, so it may run on a worker thread; upload_mesh records the copies
+struct MeshData {
+	string mName;
+	vector<float3> mPositions;
+	vector<float3> mNormals;
+	vector<float2> mTexcoords;
+	vector<float3> mColors;
+	vector<uint32_t> mIndices;
+};
+STRATUM_API Mesh upload_mesh(CommandBuffer& commandBuffer, const MeshData& data);
+
+STRATUM_API MeshData load_serialized_data(const fs::path& filename, int shape_idx = -1);
+STRATUM_API MeshData load_obj_data(const fs::path& filename);
+inline Mesh load_serialized(CommandBuffer& commandBuffer, const fs::path& filename, int shape_idx = -1) { return upload_mesh(commandBuffer, load_serialized_data(filename, shape_idx)); }
+inline Mesh load_obj(CommandBuffer& commandBuffer, const fs::path& filename) {
+	Mesh mesh = upload_mesh(commandBuffer, load_obj_data(filename));
+	cout << "Loaded " << filename << endl;
+	return mesh;
+}
 
 class Scene {
 public:
@@ -50,7 +67,8 @@ public:
 		unordered_map<const void* /* address of component */, pair<TransformData, uint32_t /* instance index */ >> mInstanceTransformMap;
 		vector<Node*> mInstanceNodes;
 
-		Buffer::View<PackedVertexData> mVertices;
+		Buffer::View<byte> mVertices; // PackedVertexData, or CompactVertexData if mCompactVertices is set
+		bool mCompactVertices;
 		Buffer::View<byte> mIndices;
 		Buffer::View<byte> mMaterialData;
 		Buffer::View<InstanceData> mInstances;
@@ -151,12 +169,15 @@ private:
 
 	unordered_map<size_t, shared_ptr<AccelerationStructure>> mAABBs;
 
-	unordered_map<Mesh*, Buffer::View<PackedVertexData>> mMeshVertices;
+	unordered_map<Mesh*, Buffer::View<byte>> mMeshVertices;
+	bool mCompactVertices = false;
 	unordered_map<size_t, MeshAS> mMeshAccelerationStructures;
 
 	shared_ptr<SceneData> mSceneData;
 
 	shared_ptr<ComputePipelineState> mCopyVerticesPipeline;
+	shared_ptr<ComputePipelineState> mComputeVertexBoundsPipeline;
+	shared_ptr<ComputePipelineState> mCompactVerticesPipeline;
 
 	shared_ptr<ComputePipelineState> mConvertAlphaToRoughnessPipeline;
 	shared_ptr<ComputePipelineState> mConvertShininessToRoughnessPipeline;
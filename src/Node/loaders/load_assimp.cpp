@@ -43,17 +43,34 @@ void Scene::load_assimp(Node& root, CommandBuffer& commandBuffer, const fs::path
 	vector<component_ptr<Mesh>> meshes;
 	unordered_map<string, Image::View> images;
 
-	auto get_image = [&](fs::path path, bool srgb) -> Image::View {
+	auto resolve_path = [&](fs::path path) {
 		if (path.is_relative()) {
 			fs::path cur = fs::current_path();
 			fs::current_path(filename.parent_path());
 			path = fs::absolute(path);
 			fs::current_path(cur);
 		}
+		return path;
+	};
+
+	// start decoding every texture before the materials are walked, so that each upload overlaps with the decodes of the textures after it
+	ImageDecoder decoder(device);
+	for (uint32_t i = 0; i < scene->mNumMaterials; i++) {
+		aiMaterial* m = scene->mMaterials[i];
+		for (const auto&[type, srgb] : { pair(aiTextureType_DIFFUSE, true), pair(aiTextureType_SPECULAR, false), pair(aiTextureType_EMISSIVE, true), pair(aiTextureType_NORMALS, false), pair(aiTextureType_HEIGHT, false) }) {
+			if (m->GetTextureCount(type) == 0) continue;
+			if (type == aiTextureType_HEIGHT && m->GetTextureCount(aiTextureType_NORMALS) > 0) continue;
+			aiString aiPath;
+			m->GetTexture(type, 0, &aiPath);
+			decoder.request(resolve_path(aiPath.C_Str()), srgb);
+		}
+	}
+
+	auto get_image = [&](fs::path path, bool srgb) -> Image::View {
+		path = resolve_path(path);
 		auto it = images.find(path.string());
 		if (it != images.end()) return it->second;
-		ImageData pixels = load_image_data(device, path, srgb);
-		auto img = make_shared<Image>(commandBuffer, path.filename().string(), pixels, 1);
+		Image::View img = decoder.load_image(commandBuffer, path, srgb, 0, 1);
 		commandBuffer.hold_resource(img);
 		images.emplace(path.string(), img);
 		return img;
@@ -2,15 +2,75 @@
 
 #define TINYGLTF_USE_CPP14
 #define TINYGLTF_NO_STB_IMAGE_WRITE
+#define TINYGLTF_NO_EXTERNAL_IMAGE // external images are decoded by ImageDecoder
 #define TINYGLTF_IMPLEMENTATION
 #include <tiny_gltf.h>
 
 namespace stm {
 
+// Packs host data for upload into a few large staging buffers, so that uploading a file takes a handful of allocations instead of one per glTF buffer and image
+class StagingArena {
+public:
+	static constexpr vk::DeviceSize ChunkSize = 64*1024*1024;
+
+	// expectedSize is the total the arena is expected to allocate, so that chunks are no larger than what is left of it
+	inline StagingArena(Device& device, const string& name, vk::DeviceSize expectedSize) : mDevice(device), mName(name), mRemaining(expectedSize) {}
+
+	// alignment need not be a power of two, since image copies are aligned to the texel size. Allocations larger than ChunkSize get a buffer of their own
+	inline Buffer::View<byte> allocate(vk::DeviceSize size, vk::DeviceSize alignment) {
+		mRemaining -= min(mRemaining, size);
+		if (size > ChunkSize) {
+			// kept apart from mChunks, so that the next allocation is never placed in it
+			const shared_ptr<Buffer> b = make_shared<Buffer>(mDevice, mName + "/Staging" + to_string(allocation_count()), size, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_ONLY);
+			mDedicated.emplace_back(b);
+			return Buffer::View<byte>(b, 0, size);
+		}
+		vk::DeviceSize offset = (mHead + alignment - 1) / alignment * alignment;
+		if (mChunks.empty() || offset + size > mChunks.back()->size()) {
+			const vk::DeviceSize chunkSize = clamp(size + mRemaining, size, ChunkSize);
+			mChunks.emplace_back(make_shared<Buffer>(mDevice, mName + "/Staging" + to_string(allocation_count()), chunkSize, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_ONLY));
+			offset = 0;
+		}
+		mHead = offset + size;
+		return Buffer::View<byte>(mChunks.back(), offset, size);
+	}
+
+	inline size_t allocation_count() const { return mChunks.size() + mDedicated.size(); }
+	inline vk::DeviceSize size_bytes() const {
+		vk::DeviceSize size = 0;
+		for (const shared_ptr<Buffer>& b : mChunks) size += b->size();
+		for (const shared_ptr<Buffer>& b : mDedicated) size += b->size();
+		return size;
+	}
+
+private:
+	Device& mDevice;
+	string mName;
+	vector<shared_ptr<Buffer>> mChunks; // mHead is the end of the last allocation in mChunks.back()
+	vector<shared_ptr<Buffer>> mDedicated;
+	vk::DeviceSize mHead = 0;
+	vk::DeviceSize mRemaining;
+};
+
+// glTF URIs are percent-encoded (RFC 3986)
+static string uri_decode(const string& uri) {
+	string decoded;
+	decoded.reserve(uri.size());
+	for (size_t i = 0; i < uri.size(); i++) {
+		if (uri[i] == '%' && i + 2 < uri.size() && isxdigit((unsigned char)uri[i+1]) && isxdigit((unsigned char)uri[i+2])) {
+			decoded += (char)stoi(uri.substr(i+1, 2), nullptr, 16);
+			i += 2;
+		} else
+			decoded += uri[i];
+	}
+	return decoded;
+}
+
 void Scene::load_gltf(Node& root, CommandBuffer& commandBuffer, const fs::path& filename) {
 	ProfilerRegion ps("load_gltf", commandBuffer);
 
 	cout << "Loading " << filename << endl;
+	const auto t0 = chrono::high_resolution_clock::now();
 
 	tinygltf::Model model;
 	tinygltf::TinyGLTF loader;
@@ -23,46 +83,37 @@ void Scene::load_gltf(Node& root, CommandBuffer& commandBuffer, const fs::path&
 
 	Device& device = commandBuffer.mDevice;
 
-	vector<shared_ptr<Buffer>> buffers(model.buffers.size());
+	vector<Buffer::View<byte>> buffers(model.buffers.size());
 	vector<Image::View> images(model.images.size());
 	vector<component_ptr<Material>> materials(model.materials.size());
 	vector<vector<component_ptr<Mesh>>> meshes(model.meshes.size());
 
-	auto get_image = [&](const uint32_t texture_index, const bool srgb) -> Image::View {
-		if (texture_index >= model.textures.size()) return {};
-		const uint32_t index = model.textures[texture_index].source;
-		if (index >= images.size()) return {};
-		if (images[index]) return images[index];
-
-		const tinygltf::Image& image = model.images[index];
-		Buffer::View<unsigned char> pixels = make_shared<Buffer>(device, image.name+"/Staging", image.image.size(), vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_ONLY);
-		ranges::uninitialized_copy(image.image, pixels);
-
-		vk::Format fmt;
-		if (srgb) {
-			static const std::array<vk::Format,4> formatMap { vk::Format::eR8Srgb, vk::Format::eR8G8Srgb, vk::Format::eR8G8B8Srgb, vk::Format::eR8G8B8A8Srgb };
-			fmt = formatMap.at(image.component - 1);
-		} else {
-			static const unordered_map<int, std::array<vk::Format,4>> formatMap {
-				{ TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE,  { vk::Format::eR8Unorm, vk::Format::eR8G8Unorm, vk::Format::eR8G8B8Unorm, vk::Format::eR8G8B8A8Unorm } },
-				{ TINYGLTF_COMPONENT_TYPE_BYTE,           { vk::Format::eR8Snorm, vk::Format::eR8G8Snorm, vk::Format::eR8G8B8Snorm, vk::Format::eR8G8B8A8Snorm } },
-				{ TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT, { vk::Format::eR16Unorm, vk::Format::eR16G16Unorm, vk::Format::eR16G16B16Unorm, vk::Format::eR16G16B16A16Unorm } },
-				{ TINYGLTF_COMPONENT_TYPE_SHORT,          { vk::Format::eR16Snorm, vk::Format::eR16G16Snorm, vk::Format::eR16G16B16Snorm, vk::Format::eR16G16B16A16Snorm } },
-				{ TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT,   { vk::Format::eR32Uint, vk::Format::eR32G32Uint, vk::Format::eR32G32B32Uint, vk::Format::eR32G32B32A32Uint } },
-				{ TINYGLTF_COMPONENT_TYPE_INT,            { vk::Format::eR32Sint, vk::Format::eR32G32Sint, vk::Format::eR32G32B32Sint, vk::Format::eR32G32B32A32Sint } },
-				{ TINYGLTF_COMPONENT_TYPE_FLOAT,          { vk::Format::eR32Sfloat, vk::Format::eR32G32Sfloat, vk::Format::eR32G32B32Sfloat, vk::Format::eR32G32B32A32Sfloat } },
-				{ TINYGLTF_COMPONENT_TYPE_DOUBLE,         { vk::Format::eR64Sfloat, vk::Format::eR64G64Sfloat, vk::Format::eR64G64B64Sfloat, vk::Format::eR64G64B64A64Sfloat } }
-			};
-			fmt = formatMap.at(image.pixel_type).at(image.component - 1);
-		}
-
-		commandBuffer.barrier({pixels}, vk::PipelineStageFlagBits::eHost, vk::AccessFlagBits::eHostWrite, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferRead);
-		auto img = make_shared<Image>(device, image.name, vk::Extent3D(image.width, image.height, 1), fmt, 1, 0, vk::SampleCountFlagBits::e1, vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst);
-		commandBuffer.copy_buffer_to_image(pixels, Image::View(img, 0, 1));
-		img->generate_mip_maps(commandBuffer);
-		images[index] = img;
-		return img;
+	// all buffers and embedded images are staged through one arena; external images are staged in the buffers ImageDecoder decodes them into
+	vk::DeviceSize stagingSize = 0;
+	for (const tinygltf::Buffer& buffer : model.buffers)
+		stagingSize += align_up((vk::DeviceSize)buffer.data.size(), 16);
+	for (const tinygltf::Image& image : model.images)
+		if (image.uri.empty()) stagingSize += image.image.size() + 32; // room to align to the texel size
+	StagingArena arena(device, filename.stem().string(), stagingSize);
+
+	const vk::ImageUsageFlags imageUsage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst;
+
+	// external images are decoded on worker threads while the buffers and the other images are uploaded
+	ImageDecoder decoder(device);
+	auto request_image = [&](const int texture_index, const bool srgb) {
+		if (texture_index < 0 || (size_t)texture_index >= model.textures.size()) return;
+		const int index = model.textures[texture_index].source;
+		if (index < 0 || (size_t)index >= model.images.size() || model.images[index].uri.empty()) return;
+		const fs::path uri = filename.parent_path() / uri_decode(model.images[index].uri);
+		if (fs::exists(uri) && !ImageCache::find(ImageCache::make_key(device, uri, srgb, 0, 0, imageUsage)))
+			decoder.request(uri, srgb);
 	};
+	for (const tinygltf::Material& material : model.materials) {
+		request_image(material.emissiveTexture.index, true);
+		request_image(material.pbrMetallicRoughness.baseColorTexture.index, true);
+		request_image(material.pbrMetallicRoughness.metallicRoughnessTexture.index, false);
+		request_image(material.normalTexture.index, false);
+	}
 
 	cout << "Loading buffers..." << endl;
 
@@ -71,25 +122,131 @@ void Scene::load_gltf(Node& root, CommandBuffer& commandBuffer, const fs::path&
 	bufferUsage |= vk::BufferUsageFlagBits::eShaderDeviceAddress;
 	bufferUsage |= vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR;
 	#endif
-	ranges::transform(model.buffers, buffers.begin(), [&](const tinygltf::Buffer& buffer) {
-		Buffer::View<unsigned char> tmp = make_shared<Buffer>(device, buffer.name+"/Staging", buffer.data.size(), vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_ONLY);
-		ranges::copy(buffer.data, tmp.begin());
-		Buffer::View<unsigned char> dst = make_shared<Buffer>(device, buffer.name, buffer.data.size(), bufferUsage, VMA_MEMORY_USAGE_GPU_ONLY, 16);
-		commandBuffer.copy_buffer(tmp, dst);
-		commandBuffer.barrier({dst}, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite, vk::PipelineStageFlagBits::eVertexInput, vk::AccessFlagBits::eVertexAttributeRead|vk::AccessFlagBits::eIndexRead);
-		commandBuffer.barrier({dst}, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderRead);
-		return dst.buffer();
-	});
+	// staging memory is only written before submission, so one barrier covers every copy recorded below
+	commandBuffer.barrier(vk::MemoryBarrier(vk::AccessFlagBits::eHostWrite, vk::AccessFlagBits::eTransferRead), vk::PipelineStageFlagBits::eHost, vk::PipelineStageFlagBits::eTransfer);
+
+	// the glTF buffers are packed into one device buffer, so that uploading them takes one copy per staging chunk
+	vk::DeviceSize bufferSize = 0;
+	for (const tinygltf::Buffer& buffer : model.buffers)
+		bufferSize = align_up(bufferSize, 16) + buffer.data.size();
+	if (bufferSize > 0) {
+		const shared_ptr<Buffer> dst = make_shared<Buffer>(device, filename.stem().string() + "/Buffers", bufferSize, bufferUsage, VMA_MEMORY_USAGE_GPU_ONLY, 16);
+		map<shared_ptr<Buffer>, vector<vk::BufferCopy>> copies;
+		vk::DeviceSize offset = 0;
+		for (size_t i = 0; i < model.buffers.size(); i++) {
+			const vector<unsigned char>& data = model.buffers[i].data;
+			offset = align_up(offset, 16);
+			buffers[i] = Buffer::View<byte>(dst, offset, data.size());
+			if (!data.empty()) {
+				const Buffer::View<byte> staging = arena.allocate(data.size(), 16);
+				memcpy(staging.data(), data.data(), data.size());
+				copies[staging.buffer()].emplace_back(staging.offset(), offset, data.size());
+			}
+			offset += data.size();
+		}
+		for (const auto&[src, regions] : copies)
+			commandBuffer->copyBuffer(*commandBuffer.hold_resource(src), *commandBuffer.hold_resource(dst), regions);
+		commandBuffer.barrier({ Buffer::View<byte>(dst) }, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite,
+			vk::PipelineStageFlagBits::eVertexInput|vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eVertexAttributeRead|vk::AccessFlagBits::eIndexRead|vk::AccessFlagBits::eShaderRead);
+	}
+
+	cout << "Loading images..." << endl;
+
+	// every image is created and its upload recorded before the materials are made, since making a material reads its images on the GPU.
+	// external images are uploaded by the decoder, within its staging budget. For the others, mips are generated once all of the copies are recorded
+	vector<pair<shared_ptr<Image>, Buffer::TexelView>> uploads;
+	size_t decodedImageCount = 0;
+	auto create_image = [&](const int texture_index, const bool srgb) {
+		if (texture_index < 0 || (size_t)texture_index >= model.textures.size()) return;
+		const int index = model.textures[texture_index].source;
+		if (index < 0 || (size_t)index >= images.size() || images[index]) return;
+
+		tinygltf::Image& image = model.images[index];
+
+		// images are shared across files through ImageCache; embedded images are keyed on the glTF file and the image index
+		const fs::path uri = filename.parent_path() / uri_decode(image.uri);
+		const bool external = !image.uri.empty();
+		if (external && !fs::exists(uri)) {
+			fprintf_color(ConsoleColor::eYellow, stderr, "%s: Failed to load image %s\n", filename.string().c_str(), image.uri.c_str());
+			return;
+		}
+		if (external) {
+			try {
+				images[index] = decoder.load_image(commandBuffer, uri, srgb, 0, 0, imageUsage);
+				decodedImageCount++;
+				return;
+			} catch (const exception& e) {
+				// fall back to tinygltf's image loader, as if the file were embedded
+				fprintf_color(ConsoleColor::eYellow, stderr, "%s: %s, decoding %s with tinygltf instead\n", filename.string().c_str(), e.what(), image.uri.c_str());
+				const vector<unsigned char> bytes = read_file<vector<unsigned char>>(uri);
+				string err, warn;
+				if (!tinygltf::LoadImageData(&image, index, &err, &warn, 0, 0, bytes.data(), (int)bytes.size(), nullptr))
+					throw runtime_error(filename.string() + ": Failed to load image " + image.uri + ": " + err);
+			}
+		}
+		const ImageCache::Key key = ImageCache::make_key(device, external ? uri : filename, srgb, 0, 0, imageUsage, external ? "" : "#" + to_string(index));
+		images[index] = ImageCache::find_or_create(key, [&]() {
+			vk::Format fmt;
+			if (srgb) {
+				static const std::array<vk::Format,4> formatMap { vk::Format::eR8Srgb, vk::Format::eR8G8Srgb, vk::Format::eR8G8B8Srgb, vk::Format::eR8G8B8A8Srgb };
+				fmt = formatMap.at(image.component - 1);
+			} else {
+				static const unordered_map<int, std::array<vk::Format,4>> formatMap {
+					{ TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE,  { vk::Format::eR8Unorm, vk::Format::eR8G8Unorm, vk::Format::eR8G8B8Unorm, vk::Format::eR8G8B8A8Unorm } },
+					{ TINYGLTF_COMPONENT_TYPE_BYTE,           { vk::Format::eR8Snorm, vk::Format::eR8G8Snorm, vk::Format::eR8G8B8Snorm, vk::Format::eR8G8B8A8Snorm } },
+					{ TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT, { vk::Format::eR16Unorm, vk::Format::eR16G16Unorm, vk::Format::eR16G16B16Unorm, vk::Format::eR16G16B16A16Unorm } },
+					{ TINYGLTF_COMPONENT_TYPE_SHORT,          { vk::Format::eR16Snorm, vk::Format::eR16G16Snorm, vk::Format::eR16G16B16Snorm, vk::Format::eR16G16B16A16Snorm } },
+					{ TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT,   { vk::Format::eR32Uint, vk::Format::eR32G32Uint, vk::Format::eR32G32B32Uint, vk::Format::eR32G32B32A32Uint } },
+					{ TINYGLTF_COMPONENT_TYPE_INT,            { vk::Format::eR32Sint, vk::Format::eR32G32Sint, vk::Format::eR32G32B32Sint, vk::Format::eR32G32B32A32Sint } },
+					{ TINYGLTF_COMPONENT_TYPE_FLOAT,          { vk::Format::eR32Sfloat, vk::Format::eR32G32Sfloat, vk::Format::eR32G32B32Sfloat, vk::Format::eR32G32B32A32Sfloat } },
+					{ TINYGLTF_COMPONENT_TYPE_DOUBLE,         { vk::Format::eR64Sfloat, vk::Format::eR64G64Sfloat, vk::Format::eR64G64B64Sfloat, vk::Format::eR64G64B64A64Sfloat } }
+				};
+				fmt = formatMap.at(image.pixel_type).at(image.component - 1);
+			}
+			// buffer offsets of image copies must be a multiple of both the texel size and 4
+			const Buffer::View<byte> pixels = arena.allocate(image.image.size(), lcm((vk::DeviceSize)texel_size(fmt), (vk::DeviceSize)4));
+			memcpy(pixels.data(), image.image.data(), image.image.size());
+			const ImageData data{ Buffer::TexelView(pixels, fmt), vk::Extent3D(image.width, image.height, 1) };
+			const auto[mipUsage, mipCreateFlags] = Image::compute_mip_flags(device, data.pixels.format());
+			const shared_ptr<Image> img = make_shared<Image>(device, external ? uri.filename().string() : image.name, data.extent, data.pixels.format(), 1, 0, vk::SampleCountFlagBits::e1,
+				imageUsage|mipUsage, VMA_MEMORY_USAGE_GPU_ONLY, mipCreateFlags);
+			uploads.emplace_back(img, data.pixels);
+			return img;
+		});
+	};
+	for (const tinygltf::Material& material : model.materials) {
+		create_image(material.emissiveTexture.index, true);
+		create_image(material.pbrMetallicRoughness.baseColorTexture.index, true);
+		create_image(material.pbrMetallicRoughness.metallicRoughnessTexture.index, false);
+		create_image(material.normalTexture.index, false);
+	}
+	for (const auto&[img, pixels] : uploads) {
+		img->transition_barrier(commandBuffer, vk::ImageLayout::eTransferDstOptimal);
+		const vk::BufferImageCopy copy(pixels.offset(), 0, 0, vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1), {}, img->extent());
+		commandBuffer->copyBufferToImage(*commandBuffer.hold_resource(pixels.buffer()), **commandBuffer.hold_resource(img), vk::ImageLayout::eTransferDstOptimal, copy);
+	}
+	for (const auto&[img, pixels] : uploads)
+		img->generate_mip_maps(commandBuffer);
+
+	cout << "Staged " << model.buffers.size() << " buffers and " << uploads.size() << " images through " << arena.allocation_count() << " allocations ("
+		<< arena.size_bytes()/(1024*1024) << " MiB, all live until the upload completes), and " << decodedImageCount << " images within the decoder's "
+		<< decoder.staging_budget()/(1024*1024) << " MiB staging budget" << endl;
+
+	auto get_image = [&](const int texture_index) -> Image::View {
+		if (texture_index < 0 || (size_t)texture_index >= model.textures.size()) return {};
+		const int index = model.textures[texture_index].source;
+		return index >= 0 && (size_t)index < images.size() ? images[index] : Image::View();
+	};
 
 	cout << "Loading materials..." << endl;
 	Node& materialsNode = root.make_child("materials");
 	ranges::transform(model.materials, materials.begin(), [&](const tinygltf::Material& material) {
-		ImageValue3 emission = make_image_value3(get_image(material.emissiveTexture.index, true), double3::Map(material.emissiveFactor.data()).cast<float>());
+		ImageValue3 emission = make_image_value3(get_image(material.emissiveTexture.index), double3::Map(material.emissiveFactor.data()).cast<float>());
 		if (material.extras.Has("emissionIntensity"))
 			emission.value *= (float)material.extras.Get("emissionIntensity").GetNumberAsDouble();
 
-		ImageValue3 base_color = make_image_value3(get_image(material.pbrMetallicRoughness.baseColorTexture.index, true), double3::Map(material.pbrMetallicRoughness.baseColorFactor.data()).cast<float>());
-		ImageValue4 metallic_roughness = make_image_value4(get_image(material.pbrMetallicRoughness.metallicRoughnessTexture.index, false), double4(0, material.pbrMetallicRoughness.roughnessFactor, material.pbrMetallicRoughness.metallicFactor, 0).cast<float>());
+		ImageValue3 base_color = make_image_value3(get_image(material.pbrMetallicRoughness.baseColorTexture.index), double3::Map(material.pbrMetallicRoughness.baseColorFactor.data()).cast<float>());
+		ImageValue4 metallic_roughness = make_image_value4(get_image(material.pbrMetallicRoughness.metallicRoughnessTexture.index), double4(0, material.pbrMetallicRoughness.roughnessFactor, material.pbrMetallicRoughness.metallicFactor, 0).cast<float>());
 		float eta = material.extensions.contains("KHR_materials_ior") ? (float)material.extensions.at("KHR_materials_ior").Get("ior").GetNumberAsDouble() : 1.5f;
 		float transmission = material.extensions.contains("KHR_materials_transmission") ? (float)material.extensions.at("KHR_materials_transmission").Get("transmissionFactor").GetNumberAsDouble() : 0;
 
@@ -101,7 +258,7 @@ void Scene::load_gltf(Node& root, CommandBuffer& commandBuffer, const fs::path&
 			m.clearcoat() = (float)v.Get("clearcoatFactor").GetNumberAsDouble();
 		}
 
-		m.bump_image = get_image(material.normalTexture.index, false);
+		m.bump_image = get_image(material.normalTexture.index);
 		m.bump_strength = 1;
 
 		return materialsNode.make_child(material.name).make_component<Material>(m);
@@ -117,7 +274,7 @@ void Scene::load_gltf(Node& root, CommandBuffer& commandBuffer, const fs::path&
 			const auto& indicesAccessor = model.accessors[prim.indices];
 			const auto& indexBufferView = model.bufferViews[indicesAccessor.bufferView];
 			const size_t indexStride = tinygltf::GetComponentSizeInBytes(indicesAccessor.componentType);
-			const Buffer::StrideView indexBuffer = Buffer::StrideView(buffers[indexBufferView.buffer], indexStride, indexBufferView.byteOffset + indicesAccessor.byteOffset, indicesAccessor.count * indexStride);
+			const Buffer::StrideView indexBuffer = Buffer::StrideView(Buffer::View<byte>(buffers[indexBufferView.buffer], indexBufferView.byteOffset + indicesAccessor.byteOffset, indicesAccessor.count * indexStride), indexStride);
 
 			shared_ptr<VertexArrayObject> vertexData = make_shared<VertexArrayObject>();
 
@@ -272,7 +429,7 @@ void Scene::load_gltf(Node& root, CommandBuffer& commandBuffer, const fs::path&
 		for (int c : model.nodes[i].children)
 			nodes[c]->set_parent(*nodes[i]);
 
-	cout << "Loaded " << filename << endl;
+	cout << "Loaded " << filename << " in " << chrono::duration_cast<chrono::duration<float, milli>>(chrono::high_resolution_clock::now() - t0).count() << "ms" << endl;
 }
 
 }
\ No newline at end of file
@@ -1,28 +1,42 @@
 #include "../Scene.hpp"
 #include <Core/PipelineState.hpp>
+#include <Common/thread_pool.hpp>
 
 #include <extern/pugixml.hpp>
-#include <regex>
 
 namespace stm {
 
-vector<string> split_string(const string& str, const regex& delim_regex) {
-	sregex_token_iterator first{ begin(str), end(str), delim_regex, -1 }, last;
-	vector<string> list{ first, last };
+// Mesh files are decoded on worker threads during the XML pass; the Mesh components are uploaded and created once the pass is done
+struct pending_mesh {
+	future<MeshData> mData;
+	vector<pair<Node*, component_ptr<Material>>> mPrimitives;
+};
+
+inline const char* skip_separators(const char* ptr) {
+	while (*ptr == ',' || isspace((unsigned char)*ptr)) ptr++;
+	return ptr;
+}
+
+// Parses a list of numbers separated by commas and/or whitespace
+vector<float> parse_floats(const string& value) {
+	vector<float> list;
+	const char* ptr = skip_separators(value.c_str());
+	while (*ptr != '\0') {
+		char* end;
+		list.emplace_back(strtof(ptr, &end));
+		if (end == ptr) throw runtime_error("Failed to parse number list: " + value);
+		ptr = skip_separators(end);
+	}
 	return list;
 }
 
 float3 parse_vector3(const string& value) {
-	vector<string> list = split_string(value, regex("(,| )+"));
+	vector<float> list = parse_floats(value);
 	float3 v;
 	if (list.size() == 1) {
-		v[0] = stof(list[0]);
-		v[1] = stof(list[0]);
-		v[2] = stof(list[0]);
+		v = float3::Constant(list[0]);
 	} else if (list.size() == 3) {
-		v[0] = stof(list[0]);
-		v[1] = stof(list[1]);
-		v[2] = stof(list[2]);
+		v = float3(list[0], list[1], list[2]);
 	} else {
 		throw runtime_error("parse_vector3 failed");
 	}
@@ -47,26 +61,36 @@ float3 parse_srgb(const string& value) {
 	return srgb;
 }
 
+// Parses either a single uniform value, or a list of wavelength:value pairs
 vector<pair<float, float>> parse_spectrum(const string& value) {
-	vector<string> list = split_string(value, regex("(,| )+"));
 	vector<pair<float, float>> s;
-	if (list.size() == 1 && list[0].find(":") == string::npos) {
-		// a single uniform value for all wavelength
-		s.push_back(make_pair(float(-1), stof(list[0])));
-	} else {
-		for (auto val_str : list) {
-			vector<string> pair = split_string(val_str, regex(":"));
-			if (pair.size() < 2) {
-				throw runtime_error("parse_spectrum failed");
-			}
-			s.push_back(make_pair(float(stof(pair[0])), float(stof(pair[1]))));
+	bool uniform = false;
+	const char* ptr = skip_separators(value.c_str());
+	while (*ptr != '\0') {
+		char* end;
+		const float x = strtof(ptr, &end);
+		if (end == ptr) throw runtime_error("parse_spectrum failed");
+		ptr = end;
+		if (*ptr == ':') {
+			ptr++;
+			const float y = strtof(ptr, &end);
+			if (end == ptr) throw runtime_error("parse_spectrum failed");
+			ptr = end;
+			s.emplace_back(x, y);
+		} else {
+			// a single uniform value for all wavelength
+			uniform = true;
+			s.emplace_back(-1.f, x);
 		}
+		ptr = skip_separators(ptr);
 	}
+	if (uniform && s.size() != 1)
+		throw runtime_error("parse_spectrum failed");
 	return s;
 }
 
 Eigen::Matrix4f parse_matrix4x4(const string& value) {
-	vector<string> list = split_string(value, regex("(,| )+"));
+	vector<float> list = parse_floats(value);
 	if (list.size() != 16)
 		throw runtime_error("parse_matrix4x4 failed");
 
@@ -74,7 +98,7 @@ Eigen::Matrix4f parse_matrix4x4(const string& value) {
 	int k = 0;
 	for (int i = 0; i < 4; i++)
 		for (int j = 0; j < 4; j++)
-			m(i, j) = stof(list[k++]);
+			m(i, j) = list[k++];
 	return m;
 }
 
@@ -162,39 +186,7 @@ float3 parse_color(pugi::xml_node node) {
 	}
 }
 
-Mesh create_mesh(CommandBuffer& commandBuffer, const vector<float3>& vertices, const vector<float3>& normals, const vector<float2>& uvs, const vector<uint32_t>& indices) {
-	vk::BufferUsageFlags bufferUsage = vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer;
-#ifdef VK_KHR_buffer_device_address
-	bufferUsage |= vk::BufferUsageFlagBits::eShaderDeviceAddress;
-	bufferUsage |= vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR;
-#endif
-
-	Buffer::View<float3> positions_tmp = make_shared<Buffer>(commandBuffer.mDevice, "positions_tmp", vertices.size() * sizeof(float3), vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_TO_GPU);
-	Buffer::View<float3> normals_tmp = make_shared<Buffer>(commandBuffer.mDevice, "normals_tmp", normals.size() * sizeof(float3), vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_TO_GPU);
-	Buffer::View<float2> texcoords_tmp = make_shared<Buffer>(commandBuffer.mDevice, "texcoords_tmp", uvs.size() * sizeof(float2), vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_TO_GPU);
-	Buffer::View<uint32_t> indices_tmp = make_shared<Buffer>(commandBuffer.mDevice, "tmp indices", indices.size() * sizeof(uint32_t), vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_TO_GPU);
-	memcpy(positions_tmp.data(), vertices.data(), positions_tmp.size_bytes());
-	memcpy(normals_tmp.data(), vertices.data(), normals_tmp.size_bytes());
-	memcpy(texcoords_tmp.data(), vertices.data(), texcoords_tmp.size_bytes());
-	memcpy(indices_tmp.data(), indices.data(), indices_tmp.size_bytes());
-
-	Buffer::View<float3> positions_buf = make_shared<Buffer>(commandBuffer.mDevice, "positions", positions_tmp.size_bytes(), bufferUsage|vk::BufferUsageFlagBits::eVertexBuffer, VMA_MEMORY_USAGE_GPU_ONLY);
-	Buffer::View<float3> normals_buf = make_shared<Buffer>(commandBuffer.mDevice, "normals", normals_tmp.size_bytes(), bufferUsage|vk::BufferUsageFlagBits::eVertexBuffer, VMA_MEMORY_USAGE_GPU_ONLY);
-	Buffer::View<float2> texcoords_buf = make_shared<Buffer>(commandBuffer.mDevice, "texcoords", texcoords_tmp.size_bytes(), bufferUsage|vk::BufferUsageFlagBits::eVertexBuffer, VMA_MEMORY_USAGE_GPU_ONLY);
-	Buffer::View<uint32_t> indices_buf = make_shared<Buffer>(commandBuffer.mDevice, "indices", indices_tmp.size_bytes(), bufferUsage|vk::BufferUsageFlagBits::eIndexBuffer, VMA_MEMORY_USAGE_GPU_ONLY);
-	commandBuffer.copy_buffer(positions_tmp, positions_buf);
-	commandBuffer.copy_buffer(normals_tmp, normals_buf);
-	commandBuffer.copy_buffer(texcoords_tmp, texcoords_buf);
-	commandBuffer.copy_buffer(indices_tmp, indices_buf);
-
-	unordered_map<VertexArrayObject::AttributeType, vector<VertexArrayObject::Attribute>> attributes;
-	attributes[VertexArrayObject::AttributeType::ePosition].emplace_back(VertexArrayObject::AttributeDescription{ (uint32_t)sizeof(float3), vk::Format::eR32G32B32Sfloat, 0, vk::VertexInputRate::eVertex }, positions_buf);
-	attributes[VertexArrayObject::AttributeType::eNormal].emplace_back(VertexArrayObject::AttributeDescription{ (uint32_t)sizeof(float3), vk::Format::eR32G32B32Sfloat, 0, vk::VertexInputRate::eVertex }, normals_buf);
-	attributes[VertexArrayObject::AttributeType::eTexcoord].emplace_back(VertexArrayObject::AttributeDescription{ (uint32_t)sizeof(float2), vk::Format::eR32G32Sfloat, 0, vk::VertexInputRate::eVertex }, texcoords_buf);
-	return Mesh(make_shared<VertexArrayObject>(attributes), indices_buf, vk::PrimitiveTopology::eTriangleList);
-}
-
-Image::View parse_texture(CommandBuffer& commandBuffer, pugi::xml_node node) {
+Image::View parse_texture(CommandBuffer& commandBuffer, pugi::xml_node node, ImageDecoder& image_data) {
 	string type = node.attribute("type").value();
 	fs::path filename;
 	float3 color0 = float3::Constant(0.4f);
@@ -224,8 +216,8 @@ Image::View parse_texture(CommandBuffer& commandBuffer, pugi::xml_node node) {
 		}
 	}
 	if (type == "bitmap") {
-		ImageData pixels = load_image_data(commandBuffer.mDevice, filename, 0, 4);
-		auto img = make_shared<Image>(commandBuffer, filename.stem().string(), pixels, 0, vk::ImageUsageFlagBits::eTransferDst|vk::ImageUsageFlagBits::eTransferSrc|vk::ImageUsageFlagBits::eSampled|vk::ImageUsageFlagBits::eStorage);
+		const vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eTransferDst|vk::ImageUsageFlagBits::eTransferSrc|vk::ImageUsageFlagBits::eSampled|vk::ImageUsageFlagBits::eStorage;
+		Image::View img = image_data.load_image(commandBuffer, fs::absolute(filename), false, 4, 0, usage);
 		commandBuffer.hold_resource(img);
 		return img;
 	} else if (type == "checkerboard") {
@@ -252,7 +244,7 @@ Image::View parse_texture(CommandBuffer& commandBuffer, pugi::xml_node node) {
 	throw runtime_error("Unsupported texture type: " + type + " for " + node.attribute("name").value());
 }
 
-ImageValue3 parse_spectrum_texture(CommandBuffer& commandBuffer, pugi::xml_node node, unordered_map<string /* name id */, Image::View>& texture_map) {
+ImageValue3 parse_spectrum_texture(CommandBuffer& commandBuffer, pugi::xml_node node, unordered_map<string /* name id */, Image::View>& texture_map, ImageDecoder& image_data) {
 	string type = node.name();
 	if (type == "spectrum") {
 		vector<pair<float, float>> spec =
@@ -279,7 +271,7 @@ ImageValue3 parse_spectrum_texture(CommandBuffer& commandBuffer, pugi::xml_node
 		}
 		return make_image_value3(t_it->second);
 	} else if (type == "texture") {
-		Image::View t = parse_texture(commandBuffer, node);
+		Image::View t = parse_texture(commandBuffer, node, image_data);
 		if (!node.attribute("id").empty()) {
 			string id = node.attribute("id").value();
 			if (texture_map.find(id) != texture_map.end()) throw runtime_error("Duplicate texture ID: " + id);
@@ -291,7 +283,7 @@ ImageValue3 parse_spectrum_texture(CommandBuffer& commandBuffer, pugi::xml_node
 	throw runtime_error("Unsupported spectrum texture type: " + type);
 }
 
-ImageValue1 parse_float_texture(CommandBuffer& commandBuffer, pugi::xml_node node, unordered_map<string /* name id */, Image::View>& texture_map) {
+ImageValue1 parse_float_texture(CommandBuffer& commandBuffer, pugi::xml_node node, unordered_map<string /* name id */, Image::View>& texture_map, ImageDecoder& image_data) {
 	string type = node.name();
 	if (type == "ref") {
 		// referencing a texture
@@ -302,7 +294,7 @@ ImageValue1 parse_float_texture(CommandBuffer& commandBuffer, pugi::xml_node nod
 	} else if (type == "float") {
 		return make_image_value1({}, stof(node.attribute("value").value()));
 	} else if (type == "texture") {
-		Image::View t = parse_texture(commandBuffer, node);
+		Image::View t = parse_texture(commandBuffer, node, image_data);
 		if (!node.attribute("id").empty()) {
 			string id = node.attribute("id").value();
 			if (texture_map.find(id) != texture_map.end()) throw runtime_error("Duplicate texture ID: " + id);
@@ -314,7 +306,7 @@ ImageValue1 parse_float_texture(CommandBuffer& commandBuffer, pugi::xml_node nod
 	throw runtime_error("Unsupported float texture type: " + type);
 }
 
-component_ptr<Material> parse_bsdf(Node& dst, CommandBuffer& commandBuffer, pugi::xml_node node, unordered_map<string /* name id */, component_ptr<Material>>& material_map, unordered_map<string /* name id */, Image::View>& texture_map) {
+component_ptr<Material> parse_bsdf(Node& dst, CommandBuffer& commandBuffer, pugi::xml_node node, unordered_map<string /* name id */, component_ptr<Material>>& material_map, unordered_map<string /* name id */, Image::View>& texture_map, ImageDecoder& image_data) {
 	string type = node.attribute("type").value();
 	unordered_set<string> ids;
 	if (!node.attribute("id").empty()) ids.emplace(node.attribute("id").value());
@@ -332,7 +324,7 @@ component_ptr<Material> parse_bsdf(Node& dst, CommandBuffer& commandBuffer, pugi
 		for (auto child : node.children()) {
 			string name = child.attribute("name").value();
 			if (name == "reflectance")
-				diffuse = parse_spectrum_texture(commandBuffer, child, texture_map);
+				diffuse = parse_spectrum_texture(commandBuffer, child, texture_map, image_data);
 		}
 		auto m = dst.make_child(name).make_component<Material>();
 		m->values[0] = make_image_value4(diffuse.image, float4(diffuse.value[0], diffuse.value[1], diffuse.value[2], 0.f));
@@ -352,9 +344,9 @@ component_ptr<Material> parse_bsdf(Node& dst, CommandBuffer& commandBuffer, pugi
 		for (auto child : node.children()) {
 			string name = child.attribute("name").value();
 			if (name == "diffuseReflectance") {
-				diffuse = parse_spectrum_texture(commandBuffer, child, texture_map);
+				diffuse = parse_spectrum_texture(commandBuffer, child, texture_map, image_data);
 			} else if (name == "specularReflectance") {
-				specular = parse_spectrum_texture(commandBuffer, child, texture_map);
+				specular = parse_spectrum_texture(commandBuffer, child, texture_map, image_data);
 			} else if (name == "alpha") {
 				// Alpha requires special treatment since we need to convert
 				// the values to roughness
@@ -371,7 +363,7 @@ component_ptr<Material> parse_bsdf(Node& dst, CommandBuffer& commandBuffer, pugi
 				} else
 					throw runtime_error("Unsupported float texture type: " + type);
 			} else if (name == "roughness") {
-				roughness = parse_float_texture(commandBuffer, child, texture_map);
+				roughness = parse_float_texture(commandBuffer, child, texture_map, image_data);
 			} else if (name == "intIOR") {
 				intIOR = stof(child.attribute("value").value());
 				eta = intIOR / extIOR;
@@ -395,9 +387,9 @@ component_ptr<Material> parse_bsdf(Node& dst, CommandBuffer& commandBuffer, pugi
 		for (auto child : node.children()) {
 			string name = child.attribute("name").value();
 			if (name == "specularReflectance") {
-				specular = parse_spectrum_texture(commandBuffer, child, texture_map);
+				specular = parse_spectrum_texture(commandBuffer, child, texture_map, image_data);
 			} else if (name == "specularTransmittance") {
-				transmittance = parse_spectrum_texture(commandBuffer, child, texture_map);
+				transmittance = parse_spectrum_texture(commandBuffer, child, texture_map, image_data);
 			} else if (name == "alpha") {
 				string type = child.name();
 				if (type == "ref") {
@@ -411,7 +403,7 @@ component_ptr<Material> parse_bsdf(Node& dst, CommandBuffer& commandBuffer, pugi
 				} else
 					throw runtime_error("Unsupported float texture type: " + type);
 			} else if (name == "roughness") {
-				roughness = parse_float_texture(commandBuffer, child, texture_map);
+				roughness = parse_float_texture(commandBuffer, child, texture_map, image_data);
 			} else if (name == "intIOR") {
 				intIOR = stof(child.attribute("value").value());
 				eta = intIOR / extIOR;
@@ -431,7 +423,7 @@ component_ptr<Material> parse_bsdf(Node& dst, CommandBuffer& commandBuffer, pugi
 	throw runtime_error("Unsupported BSDF type: \"" + type + "\" with IDs " + idstr);
 }
 
-void parse_shape(CommandBuffer& commandBuffer, Node& dst, pugi::xml_node node, unordered_map<string, component_ptr<Material>>& material_map, unordered_map<string, Image::View>& texture_map, unordered_map<string, component_ptr<Mesh>>& obj_map) {
+void parse_shape(CommandBuffer& commandBuffer, Node& dst, pugi::xml_node node, unordered_map<string, component_ptr<Material>>& material_map, unordered_map<string, Image::View>& texture_map, ImageDecoder& image_data, unordered_map<string, size_t>& mesh_map, deque<pending_mesh>& meshes) {
 	component_ptr<Material> material;
 	string filename;
 	int shape_index = -1;
@@ -449,7 +441,7 @@ void parse_shape(CommandBuffer& commandBuffer, Node& dst, pugi::xml_node node, u
 		} else if (name == "bsdf") {
 			optional<float> emission;
 			if (material) emission = material->emission();
-			material = parse_bsdf(dst, commandBuffer, child, material_map, texture_map);
+			material = parse_bsdf(dst, commandBuffer, child, material_map, texture_map, image_data);
 			if (emission) material->emission() = *emission;
 		} else if (name == "emitter") {
 			float3 radiance = float3::Ones();
@@ -501,17 +493,19 @@ void parse_shape(CommandBuffer& commandBuffer, Node& dst, pugi::xml_node node, u
 	}
 
 	string type = node.attribute("type").value();
-	if (type == "obj") {
-		component_ptr<Mesh> m;
-		if (auto m_it = obj_map.find(filename); m_it == obj_map.end()) {
-			m = dst.make_component<Mesh>(load_obj(commandBuffer, filename));
-			obj_map.emplace(filename, m);
-		} else {
-			m = m_it->second;
+	if (type == "obj" || type == "serialized") {
+		const fs::path path = fs::absolute(filename);
+		const string key = type == "obj" ? path.string() : path.string() + "#" + to_string(max(shape_index, 0));
+		auto m_it = mesh_map.find(key);
+		if (m_it == mesh_map.end()) {
+			m_it = mesh_map.emplace(key, meshes.size()).first;
+			pending_mesh& m = meshes.emplace_back();
+			if (type == "obj")
+				m.mData = thread_pool::global().push([=]{ return load_obj_data(path); });
+			else
+				m.mData = thread_pool::global().push([=]{ return load_serialized_data(path, shape_index); });
 		}
-		dst.make_component<MeshPrimitive>(material, m);
-	} else if (type == "serialized") {
-		dst.make_component<MeshPrimitive>(material, dst.make_component<Mesh>(load_serialized(commandBuffer, filename, shape_index)));
+		meshes[m_it->second].mPrimitives.emplace_back(&dst, material);
 	} else if (type == "sphere") {
 		float3 center{ 0, 0, 0 };
 		float radius = 1;
@@ -538,7 +532,7 @@ void parse_shape(CommandBuffer& commandBuffer, Node& dst, pugi::xml_node node, u
 		const vector<float3> normals = { float3(0,0,1), float3(0,0,1), float3(0,0,1), float3(0,0,1) };
 		const vector<float2> uvs = { float2(0,0), float2(0,1), float2(1,0), float2(1,1) };
 		const vector<uint32_t> indices = { 0, 1, 2, 1, 3, 2 };
-		dst.make_component<MeshPrimitive>(material, dst.make_component<Mesh>(create_mesh(commandBuffer, vertices, normals, uvs, indices)));
+		dst.make_component<MeshPrimitive>(material, dst.make_component<Mesh>(upload_mesh(commandBuffer, MeshData{ "rectangle", vertices, normals, uvs, {}, indices })));
 	}/* else if (type == "cube") {
 		vector<float3> vertices(16);
 		vector<float3> normals(16);
@@ -584,7 +578,7 @@ void parse_shape(CommandBuffer& commandBuffer, Node& dst, pugi::xml_node node, u
 			indices[face*6 + 4] = i + 3;
 			indices[face*6 + 5] = i + 2;
 		}
-		dst.make_component<MeshPrimitive>(material, dst.make_component<Mesh>(create_mesh(commandBuffer, vertices, normals, uvs, indices)));
+		dst.make_component<MeshPrimitive>(material, dst.make_component<Mesh>(upload_mesh(commandBuffer, MeshData{ "cube", vertices, normals, uvs, {}, indices })));
 	}*/
 	else throw runtime_error("Unsupported shape: " + type);
 }
@@ -592,18 +586,31 @@ void parse_shape(CommandBuffer& commandBuffer, Node& dst, pugi::xml_node node, u
 void parse_scene(Node& root, CommandBuffer& commandBuffer, pugi::xml_node node) {
 	unordered_map<string /* name id */, component_ptr<Material>> material_map;
 	unordered_map<string /* name id */, Image::View> texture_map;
-	unordered_map<string /* filename */, component_ptr<Mesh>> obj_map;
+	unordered_map<string /* filename */, size_t /* index in meshes */> mesh_map;
+	deque<pending_mesh> meshes;
+
+	// textures are used inline by the BSDFs that reference them, so all bitmaps are collected and decoding is started before the scene is walked
+	ImageDecoder image_data(commandBuffer.mDevice);
+	for (const pugi::xpath_node& t : node.select_nodes(".//texture[@type='bitmap']")) {
+		const string filename = t.node().find_child_by_attribute("name", "filename").attribute("value").value();
+		if (filename.empty()) continue;
+		const fs::path path = fs::absolute(filename);
+		// skip decoding images that are already uploaded
+		if (fs::exists(path) && ImageCache::find(ImageCache::make_key(commandBuffer.mDevice, path, false, 4, 0, vk::ImageUsageFlagBits::eTransferDst|vk::ImageUsageFlagBits::eTransferSrc|vk::ImageUsageFlagBits::eSampled|vk::ImageUsageFlagBits::eStorage))) continue;
+		image_data.request(path, false, 4);
+	}
+
 	int envmap_light_id = -1;
 	for (auto child : node.children()) {
 		string name = child.name();
 		if (name == "bsdf") {
-			parse_bsdf(root, commandBuffer, child, material_map, texture_map);
+			parse_bsdf(root, commandBuffer, child, material_map, texture_map, image_data);
 		} else if (name == "shape") {
-			parse_shape(commandBuffer, root.make_child("shape"), child, material_map, texture_map, obj_map);
+			parse_shape(commandBuffer, root.make_child("shape"), child, material_map, texture_map, image_data, mesh_map, meshes);
 		} else if (name == "texture") {
 			string id = child.attribute("id").value();
 			if (texture_map.find(id) != texture_map.end()) throw runtime_error("Duplicate texture ID: " + id);
-			texture_map[id] = parse_texture(commandBuffer, child);
+			texture_map[id] = parse_texture(commandBuffer, child, image_data);
 		} else if (name == "emitter") {
 			string type = child.attribute("type").value();
 			if (type == "envmap") {
@@ -632,6 +639,14 @@ void parse_scene(Node& root, CommandBuffer& commandBuffer, pugi::xml_node node)
 			}
 		}
 	}
+
+	// record mesh uploads in scene order as the workers finish
+	for (pending_mesh& m : meshes) {
+		if (m.mPrimitives.empty()) continue;
+		component_ptr<Mesh> mesh = m.mPrimitives[0].first->make_component<Mesh>(upload_mesh(commandBuffer, m.mData.get()));
+		for (auto&[dst, material] : m.mPrimitives)
+			dst->make_component<MeshPrimitive>(material, mesh);
+	}
 }
 
 void Scene::load_mitsuba(Node& root, CommandBuffer& commandBuffer, const fs::path& filename) {
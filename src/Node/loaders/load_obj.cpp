@@ -1,5 +1,5 @@
 #include "../Scene.hpp"
-#include <regex>
+#include <sstream>
 
 namespace stm {
 
@@ -24,15 +24,17 @@ static string &trim(string &s) {
 }
 
 static vector<int> split_face_str(const string &s) {
-    regex rgx("/");
-    sregex_token_iterator first{begin(s), end(s), rgx, -1}, last;
-    vector<string> list{first, last};
     vector<int> result;
-    for (auto &i : list) {
+    size_t start = 0;
+    while (true) {
+        const size_t end = s.find('/', start);
+        const string i = s.substr(start, end == string::npos ? string::npos : end - start);
         if (i != "")
             result.push_back(stoi(i));
         else
             result.push_back(0);
+        if (end == string::npos) break;
+        start = end + 1;
     }
     while (result.size() < 3)
         result.push_back(0);
@@ -126,7 +128,7 @@ size_t get_vertex_id(const ObjVertex &vertex,
 }
 
 
-Mesh load_obj(CommandBuffer& commandBuffer, const fs::path &filename) {
+MeshData load_obj_data(const fs::path &filename) {
 
     vector<float3> positions;
     vector<float3> normals;
@@ -227,45 +229,13 @@ Mesh load_obj(CommandBuffer& commandBuffer, const fs::path &filename) {
         normals = compute_normal(positions, indices);
     }
 
-
-	Buffer::View<float3> positions_tmp = make_shared<Buffer>(commandBuffer.mDevice, "tmp vertices", positions.size()*sizeof(float3), vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_TO_GPU);
-	Buffer::View<float3> normals_tmp = make_shared<Buffer>(commandBuffer.mDevice, "tmp normals", normals.size()*sizeof(float3), vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_TO_GPU);
-	Buffer::View<uint32_t> indices_tmp = make_shared<Buffer>(commandBuffer.mDevice, "tmp indices", indices.size()*sizeof(uint32_t), vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_TO_GPU);
-    memcpy(positions_tmp.data(), positions.data(), positions_tmp.size_bytes());
-    memcpy(normals_tmp.data(), normals.data(), normals_tmp.size_bytes());
-    memcpy(indices_tmp.data(), indices.data(), indices_tmp.size_bytes());
-
-	vk::BufferUsageFlags bufferUsage = vk::BufferUsageFlagBits::eTransferSrc|vk::BufferUsageFlagBits::eTransferDst|vk::BufferUsageFlagBits::eStorageBuffer;
-	#ifdef VK_KHR_buffer_device_address
-	bufferUsage |= vk::BufferUsageFlagBits::eShaderDeviceAddress;
-	bufferUsage |= vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR;
-	#endif
-
-    auto vao = make_shared<VertexArrayObject>(unordered_map<VertexArrayObject::AttributeType, vector<VertexArrayObject::Attribute>>{
-        { VertexArrayObject::AttributeType::ePosition, { {
-            VertexArrayObject::AttributeDescription{ (uint32_t)sizeof(float3), vk::Format::eR32G32B32Sfloat, 0, vk::VertexInputRate::eVertex },
-            make_shared<Buffer>(commandBuffer.mDevice, filename.stem().string() + " vertices", positions_tmp.size_bytes(), bufferUsage|vk::BufferUsageFlagBits::eVertexBuffer, VMA_MEMORY_USAGE_GPU_ONLY) } } },
-        { VertexArrayObject::AttributeType::eNormal, { {
-            VertexArrayObject::AttributeDescription{ (uint32_t)sizeof(float3), vk::Format::eR32G32B32Sfloat, 0, vk::VertexInputRate::eVertex },
-            make_shared<Buffer>(commandBuffer.mDevice, filename.stem().string() + " normals", normals_tmp.size_bytes(), bufferUsage|vk::BufferUsageFlagBits::eVertexBuffer, VMA_MEMORY_USAGE_GPU_ONLY) } } },
-    });
-
-	Buffer::View<uint32_t> indexBuffer = make_shared<Buffer>(commandBuffer.mDevice, filename.stem().string() + " indices", indices_tmp.size_bytes(), bufferUsage|vk::BufferUsageFlagBits::eIndexBuffer, VMA_MEMORY_USAGE_GPU_ONLY);
-	commandBuffer.copy_buffer(positions_tmp, vao->at(VertexArrayObject::AttributeType::ePosition)[0].second);
-	commandBuffer.copy_buffer(normals_tmp, vao->at(VertexArrayObject::AttributeType::eNormal)[0].second);
-	commandBuffer.copy_buffer(indices_tmp, indexBuffer);
-
-    if (!uvs.empty()) {
-        Buffer::View<float2> uvs_tmp = make_shared<Buffer>(commandBuffer.mDevice, "tmp uvs", uvs.size()*sizeof(float2), vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_TO_GPU);
-        (*vao)[VertexArrayObject::AttributeType::eTexcoord].emplace_back(
-            VertexArrayObject::AttributeDescription{ (uint32_t)sizeof(float2), vk::Format::eR32G32Sfloat, 0, vk::VertexInputRate::eVertex },
-            make_shared<Buffer>(commandBuffer.mDevice, filename.stem().string() + " uvs", uvs_tmp.size_bytes(), bufferUsage|vk::BufferUsageFlagBits::eVertexBuffer, VMA_MEMORY_USAGE_GPU_ONLY));
-        memcpy(uvs_tmp.data(), uvs.data(), uvs_tmp.size_bytes());
-        commandBuffer.copy_buffer(uvs_tmp, vao->at(VertexArrayObject::AttributeType::eTexcoord)[0].second);
-    }
-
-	cout << "Loaded " << filename << endl;
-	return Mesh(vao, indexBuffer, vk::PrimitiveTopology::eTriangleList);
+    MeshData data;
+    data.mName = filename.stem().string();
+    data.mPositions = move(positions);
+    data.mNormals = move(normals);
+    data.mTexcoords = move(uvs);
+    data.mIndices = move(indices);
+    return data;
 }
 
 }
\ No newline at end of file
@@ -6,11 +6,11 @@
 
 namespace stm {
 
-#define ZSTREAM_BUFSIZE 32768
+#define ZSTREAM_BUFSIZE (1024*1024)
 
 class z_iftream {
 public:
-	inline z_iftream(std::fstream& fs) : fs(fs) {
+	inline z_iftream(std::fstream& fs) : fs(fs), m_inflateBuffer(ZSTREAM_BUFSIZE) {
 		std::streampos pos = fs.tellg();
 		fs.seekg(0, fs.end);
 		fsize = (size_t)fs.tellg();
@@ -37,16 +37,18 @@ public:
 		while (size > 0) {
 			if (m_inflateStream.avail_in == 0) {
 				size_t remaining = fsize - fs.tellg();
-				m_inflateStream.next_in = m_inflateBuffer;
-				m_inflateStream.avail_in = (uint32_t)min(remaining, sizeof(m_inflateBuffer));
+				m_inflateStream.next_in = m_inflateBuffer.data();
+				m_inflateStream.avail_in = (uint32_t)min(remaining, m_inflateBuffer.size());
 				if (m_inflateStream.avail_in == 0) {
 					throw runtime_error("Read less data than expected");
 				}
 
-				fs.read((char*)m_inflateBuffer, m_inflateStream.avail_in);
+				fs.read((char*)m_inflateBuffer.data(), m_inflateStream.avail_in);
 			}
 
-			m_inflateStream.avail_out = (uint32_t)size;
+			// avail_out is 32 bits, so very large reads are inflated in several passes
+			const size_t chunkSize = min<size_t>(size, numeric_limits<uint32_t>::max());
+			m_inflateStream.avail_out = (uint32_t)chunkSize;
 			m_inflateStream.next_out = targetPtr;
 
 			int retval = inflate(&m_inflateStream, Z_NO_FLUSH);
@@ -65,7 +67,7 @@ public:
 			}
 			};
 
-			size_t outputSize = size - (size_t)m_inflateStream.avail_out;
+			size_t outputSize = chunkSize - (size_t)m_inflateStream.avail_out;
 			targetPtr += outputSize;
 			size -= outputSize;
 
@@ -79,32 +81,87 @@ private:
 	std::fstream& fs;
 	size_t fsize;
 	z_stream m_inflateStream;
-	uint8_t m_inflateBuffer[ZSTREAM_BUFSIZE];
+	vector<uint8_t> m_inflateBuffer;
 };
 
-Mesh load_serialized(CommandBuffer& commandBuffer, const fs::path& filename, int shape_index) {
+// Mitsuba scenes reference the same .serialized file once per shape, so the shape offset dictionary at the end of each file is only parsed once.
+// Dictionaries are shared, so a caller's copy stays valid if another thread replaces the entry for a modified file
+class serialized_dictionary_cache {
+public:
+	inline shared_ptr<const vector<size_t>> offsets(std::fstream& stream, const fs::path& filename, short version) {
+		const fs::path key = fs::canonical(filename);
+		const fs::file_time_type writeTime = fs::last_write_time(key);
+
+		scoped_lock l(mMutex);
+		auto it = mDictionaries.find(key.string());
+		if (it != mDictionaries.end() && it->second.first == writeTime)
+			return it->second.second;
+
+		const std::streampos pos = stream.tellg();
+
+		// The dictionary is stored at the end of the file, followed by the shape count
+		stream.seekg(-(std::streamoff)sizeof(uint32_t), stream.end);
+		uint32_t count = 0;
+		stream.read((char*)&count, sizeof(uint32_t));
+
+		vector<size_t> offsets(count);
+		if (version == MTS_FILEFORMAT_VERSION_V4) {
+			static_assert(sizeof(size_t) == sizeof(uint64_t));
+			stream.seekg(-(std::streamoff)(sizeof(uint64_t) * count + sizeof(uint32_t)), stream.end);
+			stream.read((char*)offsets.data(), sizeof(uint64_t) * count);
+		} else { // V3
+			vector<uint32_t> offsets32(count);
+			stream.seekg(-(std::streamoff)(sizeof(uint32_t) * (count + 1)), stream.end);
+			stream.read((char*)offsets32.data(), sizeof(uint32_t) * count);
+			ranges::copy(offsets32, offsets.begin());
+		}
+		stream.seekg(pos, stream.beg);
+
+		auto& entry = mDictionaries[key.string()];
+		entry = make_pair(writeTime, make_shared<const vector<size_t>>(move(offsets)));
+		return entry.second;
+	}
+
+private:
+	mutex mMutex;
+	unordered_map<string, pair<fs::file_time_type, shared_ptr<const vector<size_t>>>> mDictionaries;
+};
+static serialized_dictionary_cache gSerializedDictionaryCache;
+
+// Inflates an entire vertex attribute in one pass, converting from double precision with a vectorized cast if necessary
+template<typename T> requires(same_as<typename T::Scalar, float>)
+inline void read_attribute(z_iftream& zs, vector<T>& dst, size_t count, bool double_precision, vector<double>& scratch) {
+	dst.resize(count);
+	if (count == 0) return;
+	float* host = dst.data()->data();
+	const size_t scalarCount = count * T::SizeAtCompileTime;
+	if (double_precision) {
+		// Convert in fixed-size chunks to bound the scratch allocation
+		const size_t chunkSize = min<size_t>(scalarCount, 1024*1024);
+		scratch.resize(chunkSize);
+		for (size_t i = 0; i < scalarCount; i += chunkSize) {
+			const size_t n = min(chunkSize, scalarCount - i);
+			zs.read(scratch.data(), sizeof(double) * n);
+			Eigen::Map<Eigen::ArrayXf>(host + i, n) = Eigen::Map<const Eigen::ArrayXd>(scratch.data(), n).cast<float>();
+		}
+	} else
+		zs.read(host, sizeof(float) * scalarCount);
+}
+
+MeshData load_serialized_data(const fs::path& filename, int shape_index) {
 	std::fstream fs(filename.c_str(), std::fstream::in | std::fstream::binary);
+	if (!fs.is_open()) throw runtime_error("Failed to open " + filename.string());
 	// Format magic number, ignore it
 	fs.ignore(sizeof(short));
 	// Version number
 	short version = 0;
 	fs.read((char*)&version, sizeof(short));
+	// negative indices (the default) load the first shape
 	if (shape_index > 0) {
-		// Go to the end of the file to see how many components are there
-		fs.seekg(-sizeof(uint32_t), fs.end);
-		uint32_t count = 0;
-		fs.read((char*)&count, sizeof(uint32_t));
-		size_t offset = 0;
-		if (version == MTS_FILEFORMAT_VERSION_V4) {
-			fs.seekg(-sizeof(uint64_t) * (count - shape_index) - sizeof(uint32_t), fs.end);
-			fs.read((char*)&offset, sizeof(size_t));
-		} else {  // V3
-			fs.seekg(-sizeof(uint32_t) * (count - shape_index + 1), fs.end);
-			uint32_t upos = 0;
-			fs.read((char*)&upos, sizeof(unsigned int));
-			offset = upos;
-		}
-		fs.seekg(offset, fs.beg);
+		const shared_ptr<const vector<size_t>> offsets = gSerializedDictionaryCache.offsets(fs, filename, version);
+		if ((size_t)shape_index >= offsets->size())
+			throw runtime_error("Shape index " + to_string(shape_index) + " out of range in " + filename.string());
+		fs.seekg((*offsets)[shape_index], fs.beg);
 		// Skip the header
 		fs.ignore(sizeof(short) * 2);
 	}
@@ -140,88 +197,22 @@ Mesh load_serialized(CommandBuffer& commandBuffer, const fs::path& filename, int
 	bool file_double_precision = flags & EDoublePrecision;
 	// bool face_normals = flags & EFaceNormals;
 
-	vk::BufferUsageFlags bufferUsage = vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer;
-#ifdef VK_KHR_buffer_device_address
-	bufferUsage |= vk::BufferUsageFlagBits::eShaderDeviceAddress;
-	bufferUsage |= vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR;
-#endif
-
-	unordered_map<VertexArrayObject::AttributeType, vector<VertexArrayObject::Attribute>> attributes;
-	Buffer::View<float3> positions_tmp = make_shared<Buffer>(commandBuffer.mDevice, "tmp positions", sizeof(float3) * vertex_count, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_TO_GPU);
-	{
-		if (file_double_precision) {
-			for (uint32_t i = 0; i < vertex_count; i++) {
-				double3 tmp;
-				zs.read(tmp.data(), sizeof(double) * 3);
-				positions_tmp[i] = tmp.cast<float>();
-			}
-		} else {
-			for (uint32_t i = 0; i < vertex_count; i++)
-				zs.read(positions_tmp[i].data(), sizeof(float) * 3);
-		}
-		Buffer::View<float3> positions = make_shared<Buffer>(commandBuffer.mDevice, filename.stem().string() + " positions", positions_tmp.size_bytes(), bufferUsage|vk::BufferUsageFlagBits::eVertexBuffer, VMA_MEMORY_USAGE_GPU_ONLY);
-		commandBuffer.copy_buffer(positions_tmp, positions);
-		attributes[VertexArrayObject::AttributeType::ePosition].emplace_back(VertexArrayObject::AttributeDescription{ (uint32_t)sizeof(float3), vk::Format::eR32G32B32Sfloat, 0, vk::VertexInputRate::eVertex }, positions);
-	}
-
-	if (flags & EHasNormals) {
-		Buffer::View<float3> normals_tmp = make_shared<Buffer>(commandBuffer.mDevice, "tmp normals", sizeof(float3) * vertex_count, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_TO_GPU);
-		if (file_double_precision) {
-			for (uint32_t i = 0; i < vertex_count; i++) {
-				double3 tmp;
-				zs.read(tmp.data(), sizeof(double) * 3);
-				normals_tmp[i] = tmp.cast<float>();
-			}
-		} else {
-			for (uint32_t i = 0; i < vertex_count; i++)
-				zs.read(normals_tmp[i].data(), sizeof(float) * 3);
-		}
-		Buffer::View<float3> normals = make_shared<Buffer>(commandBuffer.mDevice, filename.stem().string() + " normals", normals_tmp.size_bytes(), bufferUsage|vk::BufferUsageFlagBits::eVertexBuffer, VMA_MEMORY_USAGE_GPU_ONLY);
-		commandBuffer.copy_buffer(normals_tmp, normals);
-		attributes[VertexArrayObject::AttributeType::eNormal].emplace_back(VertexArrayObject::AttributeDescription{ (uint32_t)sizeof(float3), vk::Format::eR32G32B32Sfloat, 0, vk::VertexInputRate::eVertex }, normals);
-	}
-
-	if (flags & EHasTexcoords) {
-		Buffer::View<float2> uvs_tmp = make_shared<Buffer>(commandBuffer.mDevice, "tmp uvs", sizeof(float2) * vertex_count, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_TO_GPU);
-		if (file_double_precision) {
-			for (uint32_t i = 0; i < vertex_count; i++) {
-				double2 tmp;
-				zs.read(tmp.data(), sizeof(double) * 2);
-				uvs_tmp[i] = tmp.cast<float>();
-			}
-		} else {
-			for (uint32_t i = 0; i < vertex_count; i++)
-				zs.read(uvs_tmp[i].data(), sizeof(float) * 2);
-		}
-		Buffer::View<float2> uvs = make_shared<Buffer>(commandBuffer.mDevice, filename.stem().string() + " uvs", uvs_tmp.size_bytes(), bufferUsage|vk::BufferUsageFlagBits::eVertexBuffer, VMA_MEMORY_USAGE_GPU_ONLY);
-		commandBuffer.copy_buffer(uvs_tmp, uvs);
-		attributes[VertexArrayObject::AttributeType::eTexcoord].emplace_back(VertexArrayObject::AttributeDescription{ (uint32_t)sizeof(float2), vk::Format::eR32G32Sfloat, 0, vk::VertexInputRate::eVertex }, uvs);
-	}
-
-	if (flags & EHasColors) {
-		Buffer::View<float3> colors_tmp = make_shared<Buffer>(commandBuffer.mDevice, "tmp colors", sizeof(float3) * vertex_count, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_TO_GPU);
-		if (file_double_precision) {
-			for (uint32_t i = 0; i < vertex_count; i++) {
-				double3 tmp;
-				zs.read(tmp.data(), sizeof(double) * 3);
-				colors_tmp[i] = tmp.cast<float>();
-			}
-		} else {
-			for (uint32_t i = 0; i < vertex_count; i++)
-				zs.read(colors_tmp[i].data(), sizeof(float) * 3);
-		}
-		Buffer::View<float2> colors = make_shared<Buffer>(commandBuffer.mDevice, filename.stem().string() + " colors", colors_tmp.size_bytes(), bufferUsage|vk::BufferUsageFlagBits::eVertexBuffer, VMA_MEMORY_USAGE_GPU_ONLY);
-		commandBuffer.copy_buffer(colors_tmp, colors);
-		attributes[VertexArrayObject::AttributeType::eColor].emplace_back(VertexArrayObject::AttributeDescription{ (uint32_t)sizeof(float3), vk::Format::eR32G32B32Sfloat, 0, vk::VertexInputRate::eVertex }, colors);
-	}
+	MeshData data;
+	data.mName = filename.stem().string();
+	vector<double> scratch;
 
-	Buffer::View<uint32_t> indices_tmp = make_shared<Buffer>(commandBuffer.mDevice, "tmp inds", 3 * triangle_count * sizeof(uint32_t), vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_TO_GPU);
-	zs.read(indices_tmp.data(), sizeof(uint32_t) * 3 * triangle_count);
+	read_attribute(zs, data.mPositions, vertex_count, file_double_precision, scratch);
+	if (flags & EHasNormals)
+		read_attribute(zs, data.mNormals, vertex_count, file_double_precision, scratch);
+	if (flags & EHasTexcoords)
+		read_attribute(zs, data.mTexcoords, vertex_count, file_double_precision, scratch);
+	if (flags & EHasColors)
+		read_attribute(zs, data.mColors, vertex_count, file_double_precision, scratch);
 
-	Buffer::View<uint32_t> indexBuffer = make_shared<Buffer>(commandBuffer.mDevice, filename.stem().string() + " indices", indices_tmp.size_bytes(), bufferUsage | vk::BufferUsageFlagBits::eIndexBuffer, VMA_MEMORY_USAGE_GPU_ONLY);
-	commandBuffer.copy_buffer(indices_tmp, indexBuffer);
+	data.mIndices.resize(3 * triangle_count);
+	zs.read(data.mIndices.data(), sizeof(uint32_t) * data.mIndices.size());
 
-	return Mesh(make_shared<VertexArrayObject>(attributes), indexBuffer, vk::PrimitiveTopology::eTriangleList);
+	return data;
 }
 
 }
\ No newline at end of file
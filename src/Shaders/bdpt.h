@@ -47,6 +47,21 @@ enum BDPTFlagBits {
 #define BDPT_FLAG_HAS_EMISSIVES 			BIT(1)
 #define BDPT_FLAG_HAS_MEDIA 				BIT(2)
 #define BDPT_FLAG_TRACE_LIGHT				BIT(3)
+#define BDPT_FLAG_COMPACT_VERTICES			BIT(4)
+#define BDPT_FLAG_ADAPTIVE_SAMPLING			BIT(5)
+
+// How light trace samples are accumulated in gLightTraceSamples
+#define BDPT_LIGHT_TRACE_FIXED_POINT_32		0 // three 32-bit fixed-point sums, which saturate on overflow
+#define BDPT_LIGHT_TRACE_FIXED_POINT_64		1 // three 64-bit fixed-point sums, needs shaderBufferInt64Atomics
+#define BDPT_LIGHT_TRACE_FLOAT				2 // three float sums, needs shaderBufferFloat32AtomicAdd
+
+// Sequence that path sampling dimensions are drawn from
+#define BDPT_SAMPLER_INDEPENDENT			0 // pcg4d white noise
+#define BDPT_SAMPLER_SOBOL					1 // Owen-scrambled Sobol, padded in groups of 4 dimensions and scrambled per pixel
+#define BDPT_SAMPLER_LATTICE				2 // rank-1 lattice, rotated per pixel by a blue-noise-like dither mask
+#define BDPT_SAMPLER_COUNT					3
+
+#define HASHGRID_SCAN_GROUP_SIZE 512 // number of buckets scanned by each group when computing hash grid bucket offsets
 
 struct BDPTPushConstants {
 	uint2 gOutputExtent;
@@ -78,6 +93,12 @@ struct BDPTPushConstants {
 
 	uint gDebugViewPathLength;
 	uint gDebugLightPathLength;
+
+	uint gAdaptiveMaxSamples; // extra view paths a pixel can get per frame
+	float gAdaptiveThreshold; // relative variance of the accumulated mean, below which a pixel is converged
+	uint gAdaptiveStopConverged; // converged pixels trace no paths at all, rather than one
+	uint gAdaptiveMinSamples; // accumulated samples a pixel needs before it can be converged
+	uint gAdaptivePass;
 };
 
 struct ShadowRayData {
@@ -13,6 +13,12 @@
 #ifndef gLightTraceQuantization
 #define gLightTraceQuantization 16384
 #endif
+#ifndef gLightTraceAtomics
+#define gLightTraceAtomics BDPT_LIGHT_TRACE_FIXED_POINT_32
+#endif
+#ifndef gSampler
+#define gSampler BDPT_SAMPLER_INDEPENDENT
+#endif
 #ifndef gCoherentRNG
 #define gCoherentRNG 0
 #endif
@@ -22,6 +28,8 @@
 #define gHasEmissives                  (gSceneFlags & BDPT_FLAG_HAS_EMISSIVES)
 #define gHasMedia                      (gSceneFlags & BDPT_FLAG_HAS_MEDIA)
 #define gTraceLight                    (gSceneFlags & BDPT_FLAG_TRACE_LIGHT)
+#define gCompactVertices               (gSceneFlags & BDPT_FLAG_COMPACT_VERTICES)
+#define gAdaptiveSampling              (gSceneFlags & BDPT_FLAG_ADAPTIVE_SAMPLING)
 
 #define gUsePerformanceCounters        BDPT_CHECK_FLAG(gSpecializationFlags, BDPTFlagBits::ePerformanceCounters)
 #define gRemapThreadIndex              BDPT_CHECK_FLAG(gSpecializationFlags, BDPTFlagBits::eRemapThreads)
@@ -71,7 +79,20 @@
 #define gHashGridBucketCount           gPushConstants.gHashGridBucketCount
 #define gHashGridMinBucketRadius       gPushConstants.gHashGridMinBucketRadius
 #define gHashGridBucketPixelRadius     gPushConstants.gHashGridBucketPixelRadius
-
+#define gAdaptiveMaxSamples            gPushConstants.gAdaptiveMaxSamples
+#define gAdaptiveThreshold             gPushConstants.gAdaptiveThreshold
+#define gAdaptiveStopConverged         gPushConstants.gAdaptiveStopConverged
+#define gAdaptiveMinSamples            gPushConstants.gAdaptiveMinSamples
+#define gAdaptivePass                  gPushConstants.gAdaptivePass
+
+
+// Adds the number of active lanes where condition holds to counter, with one atomic per wave rather than one per lane,
+// so that enabling performance counters doesn't serialize every lane on a single address
+#define PERFORMANCE_COUNTER_COUNT(counter, condition) \
+	do { if (gUsePerformanceCounters) { \
+		const uint _wave_count = WaveActiveCountBits(condition); \
+		if (WaveIsFirstLane() && _wave_count > 0) InterlockedAdd(counter, _wave_count); \
+	} } while (false)
 
 uint map_pixel_coord(const uint2 pixel_coord, const uint2 group_id, const uint group_thread_index) {
 	if (gRemapThreadIndex) {
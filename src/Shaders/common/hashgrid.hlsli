@@ -1,6 +1,32 @@
 #ifndef HASHGRID_H
 #define HASHGRID_H
 
+groupshared uint sHashGridWaveSums[HASHGRID_SCAN_GROUP_SIZE/4];
+groupshared uint sHashGridGroupSum;
+
+// Exclusive prefix sum of value over the group, which must be HASHGRID_SCAN_GROUP_SIZE threads. Must be called from uniform control flow
+uint hashgrid_group_scan(const uint value, const uint group_index, out uint group_sum) {
+	const uint lane_count = WaveGetLaneCount();
+	const uint wave_index = group_index / lane_count;
+	const uint wave_prefix = WavePrefixSum(value);
+	if (WaveGetLaneIndex() == lane_count - 1) sHashGridWaveSums[wave_index] = wave_prefix + value;
+	GroupMemoryBarrierWithGroupSync();
+	if (group_index == 0) {
+		uint sum = 0;
+		for (uint i = 0; i < HASHGRID_SCAN_GROUP_SIZE/lane_count; i++) {
+			const uint s = sHashGridWaveSums[i];
+			sHashGridWaveSums[i] = sum;
+			sum += s;
+		}
+		sHashGridGroupSum = sum;
+	}
+	GroupMemoryBarrierWithGroupSync();
+	const uint prefix = sHashGridWaveSums[wave_index] + wave_prefix;
+	group_sum = sHashGridGroupSum;
+	GroupMemoryBarrierWithGroupSync();
+	return prefix;
+}
+
 float hashgrid_cell_size(const float3 pos) {
 	if (gHashGridBucketPixelRadius < 0)
 		return gHashGridMinBucketRadius;
@@ -24,9 +50,11 @@ struct HashGrid<T> {
 	RWStructuredBuffer<uint>  mCounters;
 	RWStructuredBuffer<uint>  mIndices;
 	RWStructuredBuffer<T>     mData;
-	RWStructuredBuffer<uint2> mAppendIndices;
+	RWStructuredBuffer<uint2> mAppendIndices; // element 0 holds the append count
 	RWStructuredBuffer<T>     mAppendData;
+	RWStructuredBuffer<uint>  mGroupOffsets; // one per HASHGRID_SCAN_GROUP_SIZE buckets
 
+	// 0: failed inserts, 1: inserts displaced from their home bucket, 2: occupied buckets, 3: largest bucket
 	RWStructuredBuffer<uint> mStats;
 
 	uint find(const float3 pos, const float cell_size) {
@@ -45,12 +73,13 @@ struct HashGrid<T> {
 		for (uint i = 0; i < 32; i++) {
 			uint checksum_prev;
 			InterlockedCompareExchange(mChecksums[bucket_index], 0, checksum, checksum_prev);
-			if (checksum_prev == 0 || checksum_prev == checksum)
+			if (checksum_prev == 0 || checksum_prev == checksum) {
+				PERFORMANCE_COUNTER_COUNT(mStats[1], i > 0);
 				return bucket_index;
+			}
 			bucket_index++;
 		}
-		if (gUsePerformanceCounters)
-			InterlockedAdd(mStats[0], 1); // failed inserts
+		PERFORMANCE_COUNTER_COUNT(mStats[0], true); // failed inserts
 		return -1;
 	}
 	void append(const float3 pos, const float cell_size, const T y) {
@@ -59,23 +88,50 @@ struct HashGrid<T> {
 		uint index_in_bucket;
 		InterlockedAdd(mCounters[bucket_index], 1, index_in_bucket);
 
-		if (gUsePerformanceCounters && index_in_bucket == 0)
-			InterlockedAdd(mStats[1], 1); // buckets used
-
+		// reserve append slots for the whole wave with one atomic
+		const uint wave_count = WaveActiveCountBits(true);
 		uint append_index;
-		InterlockedAdd(mAppendIndices[0][0], 1, append_index);
+		if (WaveIsFirstLane())
+			InterlockedAdd(mAppendIndices[0][0], wave_count, append_index);
+		append_index = WaveReadLaneFirst(append_index) + WavePrefixCountBits(true);
 		append_index++; // skip past counter
 		mAppendIndices[append_index] = uint2(bucket_index, index_in_bucket);
 		mAppendData[append_index] = y;
 	}
 
-	void compute_indices(const uint bucket_index) {
-		if (bucket_index >= gHashGridBucketCount) return;
+	// Writes the exclusive prefix sum of mCounters within each group of HASHGRID_SCAN_GROUP_SIZE buckets to mIndices, and the sum of each group to mGroupOffsets.
+	// Must be called from uniform control flow
+	void scan_buckets(const uint group_id, const uint group_index) {
+		const uint bucket_index = group_id*HASHGRID_SCAN_GROUP_SIZE + group_index;
+		const uint count = bucket_index < gHashGridBucketCount ? mCounters[bucket_index] : 0;
 
-		uint offset;
-		InterlockedAdd(mAppendIndices[0][1], mCounters[bucket_index], offset);
+		PERFORMANCE_COUNTER_COUNT(mStats[2], count > 0);
+		if (gUsePerformanceCounters) {
+			const uint max_count = WaveActiveMax(count);
+			if (WaveIsFirstLane() && max_count > 0) InterlockedMax(mStats[3], max_count);
+		}
 
-		mIndices[bucket_index] = offset;
+		uint group_sum;
+		const uint prefix = hashgrid_group_scan(count, group_index, group_sum);
+		if (bucket_index < gHashGridBucketCount) mIndices[bucket_index] = prefix;
+		if (group_index == 0) mGroupOffsets[group_id] = group_sum;
+	}
+	// Replaces mGroupOffsets with its exclusive prefix sum. Must be called from uniform control flow, by a single group
+	void scan_groups(const uint group_index) {
+		const uint group_count = (gHashGridBucketCount + HASHGRID_SCAN_GROUP_SIZE - 1) / HASHGRID_SCAN_GROUP_SIZE;
+		uint offset = 0;
+		for (uint i = 0; i < group_count; i += HASHGRID_SCAN_GROUP_SIZE) {
+			const uint group_id = i + group_index;
+			uint sum;
+			const uint prefix = hashgrid_group_scan(group_id < group_count ? mGroupOffsets[group_id] : 0, group_index, sum);
+			if (group_id < group_count) mGroupOffsets[group_id] = offset + prefix;
+			offset += sum;
+		}
+	}
+	void compute_indices(const uint group_id, const uint group_index) {
+		const uint bucket_index = group_id*HASHGRID_SCAN_GROUP_SIZE + group_index;
+		if (bucket_index >= gHashGridBucketCount) return;
+		mIndices[bucket_index] += mGroupOffsets[group_id];
 	}
 
 	void swizzle(const uint append_index) {
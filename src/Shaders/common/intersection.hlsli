@@ -6,16 +6,17 @@
 
 struct IntersectionVertex {
 	ShadingData sd;
-	uint instance_primitive_index;
+	uint instance;
+	uint primitive;
 	Real shape_pdf;
 	bool shape_pdf_area_measure;
 
-	inline uint instance_index()  { return BF_GET(instance_primitive_index, 0, 16); }
-	inline uint primitive_index() { return BF_GET(instance_primitive_index, 16, 16); }
+	inline uint instance_index()  { return instance; }
+	inline uint primitive_index() { return primitive; }
 	SLANG_MUTATING
-	inline uint set_instance_index(const uint v)  { return BF_SET(instance_primitive_index, v, 0, 16); }
+	inline uint set_instance_index(const uint v)  { return instance = v; }
 	SLANG_MUTATING
-	inline uint set_primitive_index(const uint v) { return BF_SET(instance_primitive_index, v, 16, 16); }
+	inline uint set_primitive_index(const uint v) { return primitive = v; }
 };
 
 float visibility_distance_epsilon(const float dist) { return dist*0.999; }
@@ -63,7 +64,7 @@ float3 ray_offset(const float3 pos, const float3 geometry_normal) {
 }
 
 Real trace_ray(const Vector3 origin, const Vector3 direction, const Real t_max, inout IntersectionVertex _isect, out Vector3 local_hit_pos, const bool accept_first = false) {
-	if (gUsePerformanceCounters) InterlockedAdd(gSceneParams.gRayCount[0], 1);
+	PERFORMANCE_COUNTER_COUNT(gSceneParams.gRayCount[0], true);
 
 	RayQuery<RAY_FLAG_NONE> rayQuery;
 	RayDesc rayDesc;
@@ -118,7 +119,7 @@ Real trace_ray(const Vector3 origin, const Vector3 direction, const Real t_max,
 				if (gAlphaTest) {
 					const InstanceData instance = gSceneParams.gInstances[hit_instance];
 					const uint alpha_mask_index = gSceneParams.gMaterialData.Load<uint>(instance.material_address() + 20*DISNEY_DATA_N); // skip past ImageValue4s
-					if (alpha_mask_index < gImageCount) {
+					if (alpha_mask_index < INVALID_IMAGE_INDEX) {
 						ShadingData sd;
 						TransformData tmp;
 						make_triangle_shading_data(sd, instance, tmp, rayQuery.CandidatePrimitiveIndex(), rayQuery.CandidateTriangleBarycentrics());
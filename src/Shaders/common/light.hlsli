@@ -12,12 +12,13 @@ struct LightSampleRecord {
 	float dist;
 
 	float3 position;
-	uint instance_primitive_index;
+	uint instance;
 	float3 normal;
 	uint material_address;
+	uint primitive;
 
-	inline uint instance_index() { return BF_GET(instance_primitive_index, 0, 16); }
-	inline uint primitive_index() { return BF_GET(instance_primitive_index, 16, 16); }
+	inline uint instance_index() { return instance; }
+	inline uint primitive_index() { return primitive; }
 	inline bool is_environment() { return instance_index() == INVALID_INSTANCE; }
 };
 
@@ -41,13 +42,13 @@ void sample_point_on_light(out LightSampleRecord ls, const float4 rnd, const flo
 		env.load(gEnvironmentMaterialAddress);
 		ls.radiance = env.sample(rnd.xy, ls.to_light, ls.pdf);
 		if (gHasEmissives) ls.pdf *= gEnvironmentSampleProbability;
-		BF_SET(ls.instance_primitive_index, INVALID_INSTANCE, 0, 16);
+		ls.instance = INVALID_INSTANCE;
 		ls.dist = POS_INFINITY;
 		ls.pdf_area_measure = false;
 		ls.material_address = gEnvironmentMaterialAddress;
 	} else if (gHasEmissives) {
 		const uint light_instance_index = sample_light_instance(ls.pdf, gHasEnvironment ? (rnd.w - gEnvironmentSampleProbability) / (1 - gEnvironmentSampleProbability) : rnd.w);
-		BF_SET(ls.instance_primitive_index, light_instance_index, 0, 16);
+		ls.instance = light_instance_index;
 
 		if (gHasEnvironment) ls.pdf *= 1 - gEnvironmentSampleProbability;
 
@@ -56,7 +57,7 @@ void sample_point_on_light(out LightSampleRecord ls, const float4 rnd, const flo
 		ls.material_address = instance.material_address();
 		switch (instance.type()) {
 			case INSTANCE_TYPE_SPHERE: {
-				BF_SET(ls.instance_primitive_index, INVALID_PRIMITIVE, 16, 16);
+				ls.primitive = INVALID_PRIMITIVE;
 				const float r = instance.radius();
 				if (gUniformSphereSampling) {
 					ls.pdf /= 4*M_PI*r*r;
@@ -121,7 +122,7 @@ void sample_point_on_light(out LightSampleRecord ls, const float4 rnd, const flo
 			}
 			case INSTANCE_TYPE_TRIANGLES: {
 				const uint prim_index = min(rnd.z*instance.prim_count(), instance.prim_count() - 1);
-				BF_SET(ls.instance_primitive_index, prim_index, 16, 16);
+				ls.primitive = prim_index;
 				const float a = sqrt(rnd.x);
 				const float2 bary = float2(1 - a, a*rnd.y);
 
@@ -37,9 +37,22 @@ Real connection_dVC(const Real dVC, const Real pdfA_rev, const Real prev_pdfA_fw
 	return ((specular ? 0 : 1) + dVC * mis(pdfA_rev)) / mis(prev_pdfA_fwd);
 }
 
+// bytes per pixel in gLightTraceSamples
+static const uint gLightTraceSampleStride = gLightTraceAtomics == BDPT_LIGHT_TRACE_FIXED_POINT_64 ? 24 : 16;
+
 Spectrum load_light_sample(const uint2 pixel_coord) {
 	const uint idx = pixel_coord.y * gOutputExtent.x + pixel_coord.x;
-	uint4 v = gFrameParams.gLightTraceSamples.Load<uint4>(16*idx);
+	const uint addr = gLightTraceSampleStride*idx;
+	if (gLightTraceAtomics == BDPT_LIGHT_TRACE_FLOAT)
+		return gFrameParams.gLightTraceSamples.Load<float3>(addr);
+	if (gLightTraceAtomics == BDPT_LIGHT_TRACE_FIXED_POINT_64) {
+		// sums are stored as (low, high) pairs
+		const uint2 r = gFrameParams.gLightTraceSamples.Load<uint2>(addr + 0);
+		const uint2 g = gFrameParams.gLightTraceSamples.Load<uint2>(addr + 8);
+		const uint2 b = gFrameParams.gLightTraceSamples.Load<uint2>(addr + 16);
+		return (float3(r.y, g.y, b.y)*4294967296.0 + float3(r.x, g.x, b.x)) / (float)gLightTraceQuantization;
+	}
+	uint4 v = gFrameParams.gLightTraceSamples.Load<uint4>(addr);
 	// handle overflow
 	if (v.w & BIT(0)) v.r = 0xFFFFFFFF;
 	if (v.w & BIT(1)) v.g = 0xFFFFFFFF;
@@ -47,9 +60,27 @@ Spectrum load_light_sample(const uint2 pixel_coord) {
 	return v.rgb / (Real)gLightTraceQuantization;
 }
 void accumulate_light_contribution(const uint output_index, const Spectrum c) {
+	const uint addr = gLightTraceSampleStride*output_index;
+	if (gLightTraceAtomics == BDPT_LIGHT_TRACE_FLOAT) {
+		// float sums keep the full range without quantization, and lanes skip channels they have nothing to add to
+		const float3 cf = max(0, c);
+		float prev;
+		for (uint i = 0; i < 3; i++)
+			if (cf[i] > 0)
+				gFrameParams.gLightTraceSamples.InterlockedAddF32(addr + 4*i, cf[i], prev);
+		return;
+	}
+	if (gLightTraceAtomics == BDPT_LIGHT_TRACE_FIXED_POINT_64) {
+		// 2^63 keeps the conversion defined; at the default quantization a pixel would need 2^47 radiance to reach it
+		const float3 q = min(max(0, c) * gLightTraceQuantization, 9.2e18);
+		uint64_t prev;
+		for (uint i = 0; i < 3; i++)
+			if (q[i] >= 1)
+				gFrameParams.gLightTraceSamples.InterlockedAdd64(addr + 8*i, (uint64_t)q[i], prev);
+		return;
+	}
 	const uint3 ci = max(0,c) * gLightTraceQuantization;
 	if (all(ci == 0)) return;
-	const uint addr = 16*output_index;
 	uint3 ci_p;
 	gFrameParams.gLightTraceSamples.InterlockedAdd(addr + 0 , ci[0], ci_p[0]);
 	gFrameParams.gLightTraceSamples.InterlockedAdd(addr + 4 , ci[1], ci_p[1]);
@@ -1003,7 +1034,7 @@ struct PathIntegrator {
 	void trace() {
 		Real T_dir_pdf = 1;
 		T_nee_pdf = 1;
-		if (gUsePerformanceCounters) InterlockedAdd(gSceneParams.gRayCount[1], 1);
+		PERFORMANCE_COUNTER_COUNT(gSceneParams.gRayCount[1], true);
 		trace_ray(_rng, origin, direction, _medium, _beta, T_dir_pdf, T_nee_pdf, _isect, local_position);
 		if (T_dir_pdf <= 0 || all(_beta <= 0)) { _beta = 0; return; }
 		_beta /= T_dir_pdf;
@@ -40,10 +40,65 @@ float pcg_next_float(inout uint4 v) {
     return asfloat(0x3f800000 | (pcg_next_uint(v) >> 9)) - 1;
 }
 
+// Owen-scrambled Sobol, from "Practical Hash-based Owen Scrambling" (Burley 2020)
+//   Sobol generator matrices for the first 4 dimensions
+static const uint gSobolDirections[4][32] = {
+	{ 0x80000000, 0x40000000, 0x20000000, 0x10000000, 0x08000000, 0x04000000, 0x02000000, 0x01000000, 0x00800000, 0x00400000, 0x00200000, 0x00100000, 0x00080000, 0x00040000, 0x00020000, 0x00010000, 0x00008000, 0x00004000, 0x00002000, 0x00001000, 0x00000800, 0x00000400, 0x00000200, 0x00000100, 0x00000080, 0x00000040, 0x00000020, 0x00000010, 0x00000008, 0x00000004, 0x00000002, 0x00000001 },
+	{ 0x80000000, 0xc0000000, 0xa0000000, 0xf0000000, 0x88000000, 0xcc000000, 0xaa000000, 0xff000000, 0x80800000, 0xc0c00000, 0xa0a00000, 0xf0f00000, 0x88880000, 0xcccc0000, 0xaaaa0000, 0xffff0000, 0x80008000, 0xc000c000, 0xa000a000, 0xf000f000, 0x88008800, 0xcc00cc00, 0xaa00aa00, 0xff00ff00, 0x80808080, 0xc0c0c0c0, 0xa0a0a0a0, 0xf0f0f0f0, 0x88888888, 0xcccccccc, 0xaaaaaaaa, 0xffffffff },
+	{ 0x80000000, 0xc0000000, 0x60000000, 0x90000000, 0xe8000000, 0x5c000000, 0x8e000000, 0xc5000000, 0x68800000, 0x9cc00000, 0xee600000, 0x55900000, 0x80680000, 0xc09c0000, 0x60ee0000, 0x90550000, 0xe8808000, 0x5cc0c000, 0x8e606000, 0xc5909000, 0x6868e800, 0x9c9c5c00, 0xeeee8e00, 0x5555c500, 0x8000e880, 0xc0005cc0, 0x60008e60, 0x9000c590, 0xe8006868, 0x5c009c9c, 0x8e00eeee, 0xc5005555 },
+	{ 0x80000000, 0xc0000000, 0x20000000, 0x50000000, 0xf8000000, 0x74000000, 0xa2000000, 0x93000000, 0xd8800000, 0x25400000, 0x59e00000, 0xe6d00000, 0x78080000, 0xb40c0000, 0x82020000, 0xc3050000, 0x208f8000, 0x51474000, 0xfbea2000, 0x75d93000, 0xa0858800, 0x914e5400, 0xdbe79e00, 0x25db6d00, 0x58800080, 0xe54000c0, 0x79e00020, 0xb6d00050, 0x800800f8, 0xc00c0074, 0x200200a2, 0x50050093 }
+};
+uint sobol(uint index, const uint dim) {
+	uint x = 0;
+	for (uint bit = 0; index != 0; bit++, index >>= 1)
+		if (index & 1) x ^= gSobolDirections[dim][bit];
+	return x;
+}
+uint laine_karras_permutation(uint x, const uint seed) {
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return x;
+}
+uint nested_uniform_scramble(const uint x, const uint seed) {
+	return reversebits(laine_karras_permutation(reversebits(x), seed));
+}
+uint hash_combine(const uint seed, const uint v) {
+	return seed ^ (v + (seed << 6) + (seed >> 2));
+}
+
+// v is (pixel, sample index, dimension). Dimensions are padded in groups of 4, each of which shuffles the sample index
+// with its own seed so that the groups are decorrelated, while keeping the stratification within a group
+uint sobol_next_uint(inout uint4 v) {
+	const uint dim = v.w++;
+	const uint seed = xxhash32(hash_combine(hash_combine(xxhash32(v.x), v.y), dim / 4));
+	const uint index = nested_uniform_scramble(v.z, seed);
+	return nested_uniform_scramble(sobol(index, dim % 4), xxhash32(hash_combine(seed, dim % 4)));
+}
+
+// Kronecker (rank-1 lattice) sequence with the R2 generator (Roberts 2018), in 32-bit fixed point.
+// Each pixel's sequence is rotated by the R2 dither mask of its coordinates, which spreads the error over the image with a blue-noise-like spectrum.
+// Dimensions are paired, and each pair shuffles the sample index to decorrelate it from the others
+uint lattice_next_uint(inout uint4 v) {
+	const uint dim = v.w++;
+	const uint index = nested_uniform_scramble(v.z, xxhash32(dim / 2));
+	const uint2 generator = uint2(0xc13fa9a9, 0x91e10da5);
+	return index*generator[dim % 2] + (v.x*generator[0] + v.y*generator[1]) + xxhash32(dim);
+}
+
 typedef uint4 rng_state_t;
 rng_state_t rng_init(const uint2 pixel, const uint offset = 0) { return uint4(pixel, gRandomSeed, offset); }
 void  rng_skip_next (inout rng_state_t state) { state.w++; }
-uint  rng_next_uint (inout rng_state_t state) { return pcg_next_uint(state); }
-float rng_next_float(inout rng_state_t state) { return pcg_next_float(state); }
+uint  rng_next_uint (inout rng_state_t state) {
+	if (gSampler == BDPT_SAMPLER_SOBOL)
+		return sobol_next_uint(state);
+	else if (gSampler == BDPT_SAMPLER_LATTICE)
+		return lattice_next_uint(state);
+	else
+		return pcg_next_uint(state);
+}
+float rng_next_float(inout rng_state_t state) { return asfloat(0x3f800000 | (rng_next_uint(state) >> 9)) - 1; }
 
 #endif
\ No newline at end of file
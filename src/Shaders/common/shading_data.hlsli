@@ -61,11 +61,24 @@ void make_triangle_shading_data(inout ShadingData r, const TransformData transfo
 		r.mean_curvature = (dot(dNdu, tangent) + dot(dNdv, bitangent)) / 2;
 	}
 }
-void make_triangle_shading_data(out ShadingData r, const InstanceData instance, const TransformData transform, const uint primitive_index, const float2 bary) {
+void load_triangle_vertices(const InstanceData instance, const uint primitive_index, out PackedVertexData v0, out PackedVertexData v1, out PackedVertexData v2) {
 	const uint3 tri = load_tri(gSceneParams.gIndices, instance, primitive_index);
-	const PackedVertexData v0 = gSceneParams.gVertices[tri.x];
-	const PackedVertexData v1 = gSceneParams.gVertices[tri.y];
-	const PackedVertexData v2 = gSceneParams.gVertices[tri.z];
+	if (gCompactVertices) {
+		const uint bounds_address = (instance.first_vertex() - COMPACT_VERTEX_BOUNDS_SLOTS) * 16;
+		const float3 bounds_min    = asfloat(gSceneParams.gVertices.Load3(bounds_address));
+		const float3 bounds_extent = asfloat(gSceneParams.gVertices.Load3(bounds_address + 16));
+		v0 = gSceneParams.gVertices.Load<CompactVertexData>(tri.x * 16).unpack(bounds_min, bounds_extent);
+		v1 = gSceneParams.gVertices.Load<CompactVertexData>(tri.y * 16).unpack(bounds_min, bounds_extent);
+		v2 = gSceneParams.gVertices.Load<CompactVertexData>(tri.z * 16).unpack(bounds_min, bounds_extent);
+	} else {
+		v0 = gSceneParams.gVertices.Load<PackedVertexData>(tri.x * 32);
+		v1 = gSceneParams.gVertices.Load<PackedVertexData>(tri.y * 32);
+		v2 = gSceneParams.gVertices.Load<PackedVertexData>(tri.z * 32);
+	}
+}
+void make_triangle_shading_data(out ShadingData r, const InstanceData instance, const TransformData transform, const uint primitive_index, const float2 bary) {
+	PackedVertexData v0, v1, v2;
+	load_triangle_vertices(instance, primitive_index, v0, v1, v2);
 	const float3 v1v0 = v1.position - v0.position;
 	const float3 v2v0 = v2.position - v0.position;
 	const float3 local_position = v0.position + v1v0*bary.x + v2v0*bary.y;
@@ -74,10 +87,8 @@ void make_triangle_shading_data(out ShadingData r, const InstanceData instance,
 }
 void make_triangle_shading_data_from_position(out ShadingData r, const InstanceData instance, const TransformData transform, const uint primitive_index, const float3 local_position) {
 	r.position = transform.transform_point(local_position);
-	const uint3 tri = load_tri(gSceneParams.gIndices, instance, primitive_index);
-	const PackedVertexData v0 = gSceneParams.gVertices[tri.x];
-	const PackedVertexData v1 = gSceneParams.gVertices[tri.y];
-	const PackedVertexData v2 = gSceneParams.gVertices[tri.z];
+	PackedVertexData v0, v1, v2;
+	load_triangle_vertices(instance, primitive_index, v0, v1, v2);
 
 	const float3 v1v0 = v1.position - v0.position;
 	const float3 v2v0 = v2.position - v0.position;
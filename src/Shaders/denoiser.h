@@ -52,6 +52,7 @@ switch (m) {
 [[vk::binding(14,0)]] Texture2D<float2> gPrevAccumMoments;
 [[vk::binding(15,0)]] SamplerState gStaticSampler;
 [[vk::binding(16,0)]] RWTexture2D<float4> gDebugImage;
+[[vk::binding(17,0)]] Texture2D<uint> gViewIndices;
 
 #endif
 
@@ -9,6 +9,8 @@ enum class CompareMetric {
 	eSMAPE,
 	eMSE,
 	eAverage,
+	eRelMSE, // squared error relative to the squared value of the second image
+	eSampleCount, // mean of the first image's alpha channel, which is the sample count of radiance images
 	eCompareMetricCount
 };
 
@@ -21,6 +23,8 @@ inline string to_string(const stm::CompareMetric& m) {
 		case stm::CompareMetric::eSMAPE: return "SMAPE";
 		case stm::CompareMetric::eMSE: return "MSE";
 		case stm::CompareMetric::eAverage: return "Average";
+		case stm::CompareMetric::eRelMSE: return "relMSE";
+		case stm::CompareMetric::eSampleCount: return "Sample count";
 	}
 };
 }
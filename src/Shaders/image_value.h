@@ -100,7 +100,7 @@ struct ImageValue1 {
 	float value;
 #ifdef __HLSL__
 	uint image_index_channel;
-	bool has_image() { return BF_GET(image_index_channel,0,30) < gImageCount; }
+	bool has_image() { return BF_GET(image_index_channel,0,30) < INVALID_IMAGE_INDEX; }
 	uint channel() { return BF_GET(image_index_channel,30,2); }
 	Texture2D<float4> image() { return gSceneParams.gImages[NonUniformResourceIndex(BF_GET(image_index_channel,0,30))]; }
 	float eval(const float2 uv, const float uv_screen_size) {
@@ -132,7 +132,7 @@ struct ImageValue2 {
 	float2 value;
 #ifdef __HLSL__
 	uint image_index;
-	bool has_image() { return image_index < gImageCount; }
+	bool has_image() { return image_index < INVALID_IMAGE_INDEX; }
 	Texture2D<float4> image() { return gSceneParams.gImages[NonUniformResourceIndex(image_index)]; }
 	SLANG_MUTATING
 	void load(inout uint address) {
@@ -158,7 +158,7 @@ struct ImageValue3 {
 	float3 value;
 #ifdef __HLSL__
 	uint image_index;
-	bool has_image() { return image_index < gImageCount; }
+	bool has_image() { return image_index < INVALID_IMAGE_INDEX; }
 	Texture2D<float4> image() { return gSceneParams.gImages[NonUniformResourceIndex(image_index)]; }
 	SLANG_MUTATING
 	void load(inout uint address) {
@@ -184,7 +184,7 @@ struct ImageValue4 {
 	float4 value;
 #ifdef __HLSL__
 	uint image_index;
-	bool has_image() { return image_index < gImageCount; }
+	bool has_image() { return image_index < INVALID_IMAGE_INDEX; }
 	Texture2D<float4> image() { return gSceneParams.gImages[NonUniformResourceIndex(image_index)]; }
 	SLANG_MUTATING
 	void load(inout uint address) {
@@ -29,6 +29,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 //#pragma compile dxc -spirv -T cs_6_7 -E main
 //#pragma compile dxc -spirv -T cs_6_7 -E copy_rgb
 #pragma compile slangc -profile sm_6_6 -lang slang -entry main
+#pragma compile slangc -profile sm_6_6 -lang slang -entry main_fused
 #pragma compile slangc -profile sm_6_6 -lang slang -entry copy_rgb
 #endif
 
@@ -48,6 +49,7 @@ struct PushConstants {
 	float gSigmaLuminanceBoost;
 	uint gIteration;
 	uint gStepSize;
+	uint gInputIndex;
 };
 
 #ifdef __SLANG__
@@ -60,13 +62,31 @@ struct PushConstants {
 [[vk::push_constant]] const PushConstants gPushConstants;
 #endif
 
-#define gInput gFilterImages[gPushConstants.gIteration%2]
-#define gOutput gFilterImages[(gPushConstants.gIteration+1)%2]
+#define gInput gFilterImages[gPushConstants.gInputIndex]
+#define gOutput gFilterImages[gPushConstants.gInputIndex^1]
 
-struct TapData {
-	uint view_index;
+// Where the filter reads the previous iteration's color and the guide buffers from
+interface FilterSource {
+	float4 color(const int2 p);
+	float3 normal(const int2 p);
+	float depth(const int2 p);
+	float2 depth_gradient(const int2 p);
+};
+
+struct GlobalFilterSource : FilterSource {
 	uint screen_width;
+	inline float4 color(const int2 p) { return gInput[p]; }
+	inline float3 normal(const int2 p) { return gVisibility[p.y*screen_width + p.x].normal(); }
+	inline float depth(const int2 p) { return gDepth[p.y*screen_width + p.x].z; }
+	inline float2 depth_gradient(const int2 p) { return gDepth[p.y*screen_width + p.x].dz_dxy; }
+};
+
+struct TapData<S : FilterSource> {
+	S source;
+	uint view_index;
 	int2 index;
+	uint iteration;
+	uint step_size;
 
 	float3 center_normal;
 	float z_center;
@@ -90,7 +110,7 @@ struct TapData {
 				if (xx == 0 && yy == 0) continue;
 				const int2 p = index + int2(xx, yy);
 				if (!gViews[view_index].test_inside(p)) continue;
-				s += gInput[p].a * kernel[abs(xx)][abs(yy)];
+				s += source.color(p).a * kernel[abs(xx)][abs(yy)];
 			}
 		sigma_l = sqrt(max(s, 0))*gPushConstants.gSigmaLuminanceBoost;
 	}
@@ -100,14 +120,12 @@ struct TapData {
 		const int2 p = index + offset;
 		if (!gViews[view_index].test_inside(p)) return;
 
-		const float4 color_p  = gInput[p];
+		const float4 color_p  = source.color(p);
 		const float l_p = luminance(color_p.rgb);
 		const float w_l = abs(l_p - l_center) / max(sigma_l, 1e-10);
 
-		const VisibilityInfo vis_p = gVisibility[p.y*screen_width + p.x];
-		const DepthInfo depth_p = gDepth[p.y*screen_width + p.x];
-		const float w_z = abs(depth_p.z - z_center) / (length(dz_center * float2(offset * gPushConstants.gStepSize)) + 1e-2);
-		const float w_n = pow(max(0, dot(vis_p.normal(), center_normal)), 256);
+		const float w_z = abs(source.depth(p) - z_center) / (length(dz_center * float2(offset * step_size)) + 1e-2);
+		const float w_n = pow(max(0, dot(source.normal(p), center_normal)), 256);
 
 		const float w = exp(-pow2(w_l) - w_z) * kernel_weight * w_n;
 		if (isinf(w) || isnan(w)) return;
@@ -118,7 +136,7 @@ struct TapData {
 };
 
 
-inline void subsampled(inout TapData t) {
+inline void subsampled<S : FilterSource>(inout TapData<S> t) {
 	/*
 	| | |x| | |
 	| |x| |x| |
@@ -127,7 +145,7 @@ inline void subsampled(inout TapData t) {
 	| | |x| | |
 	*/
 
-	if ((gPushConstants.gIteration & 1) == 0) {
+	if ((t.iteration & 1) == 0) {
 		/*
 		| | | | | |
 		| |x| |x| |
@@ -135,8 +153,8 @@ inline void subsampled(inout TapData t) {
 		| |x| |x| |
 		| | | | | |
 		*/
-		t.tap(int2(-2,  0) * gPushConstants.gStepSize, 1.0);
-		t.tap(int2( 2,  0) * gPushConstants.gStepSize, 1.0);
+		t.tap(int2(-2,  0) * t.step_size, 1.0);
+		t.tap(int2( 2,  0) * t.step_size, 1.0);
 	} else {
 		/*
 		| | |x| | |
@@ -145,84 +163,79 @@ inline void subsampled(inout TapData t) {
 		| |x| |x| |
 		| | |x| | |
 		*/
-		t.tap(int2( 0, -2) * gPushConstants.gStepSize, 1.0);
-		t.tap(int2( 0,  2) * gPushConstants.gStepSize, 1.0);
+		t.tap(int2( 0, -2) * t.step_size, 1.0);
+		t.tap(int2( 0,  2) * t.step_size, 1.0);
 	}
 
-	t.tap(int2(-1,  1) * gPushConstants.gStepSize, 1.0);
-	t.tap(int2( 1,  1) * gPushConstants.gStepSize, 1.0);
+	t.tap(int2(-1,  1) * t.step_size, 1.0);
+	t.tap(int2( 1,  1) * t.step_size, 1.0);
 
-	t.tap(int2(-1, -1) * gPushConstants.gStepSize, 1.0);
-	t.tap(int2( 1, -1) * gPushConstants.gStepSize, 1.0);
+	t.tap(int2(-1, -1) * t.step_size, 1.0);
+	t.tap(int2( 1, -1) * t.step_size, 1.0);
 }
 
-inline void box3(inout TapData t) {
+inline void box3<S : FilterSource>(inout TapData<S> t) {
 	const int r = 1;
 	for (int yy = -r; yy <= r; yy++)
 		for (int xx = -r; xx <= r; xx++)
 			if (xx != 0 || yy != 0)
-				t.tap(int2(xx, yy) * gPushConstants.gStepSize, 1.0);
+				t.tap(int2(xx, yy) * t.step_size, 1.0);
 }
 
-inline void box5(inout TapData t) {
+inline void box5<S : FilterSource>(inout TapData<S> t) {
 	const int r = 2;
 	for(int yy = -r; yy <= r; yy++)
 		for(int xx = -r; xx <= r; xx++)
 			if(xx != 0 || yy != 0)
-				t.tap(int2(xx, yy) * gPushConstants.gStepSize, 1.0);
+				t.tap(int2(xx, yy) * t.step_size, 1.0);
 }
 
-inline void atrous(inout TapData t) {
+inline void atrous<S : FilterSource>(inout TapData<S> t) {
 	const float kernel[3] = { 1.0, 2.0 / 3.0, 1.0 / 6.0 };
 
-	t.tap(int2( 1,  0) * gPushConstants.gStepSize, 2.0 / 3.0);
-	t.tap(int2( 0,  1) * gPushConstants.gStepSize, 2.0 / 3.0);
-	t.tap(int2(-1,  0) * gPushConstants.gStepSize, 2.0 / 3.0);
-	t.tap(int2( 0, -1) * gPushConstants.gStepSize, 2.0 / 3.0);
-
-	t.tap(int2( 2,  0) * gPushConstants.gStepSize, 1.0 / 6.0);
-	t.tap(int2( 0,  2) * gPushConstants.gStepSize, 1.0 / 6.0);
-	t.tap(int2(-2,  0) * gPushConstants.gStepSize, 1.0 / 6.0);
-	t.tap(int2( 0, -2) * gPushConstants.gStepSize, 1.0 / 6.0);
-
-	t.tap(int2( 1,  1) * gPushConstants.gStepSize, 4.0 / 9.0);
-	t.tap(int2(-1,  1) * gPushConstants.gStepSize, 4.0 / 9.0);
-	t.tap(int2(-1, -1) * gPushConstants.gStepSize, 4.0 / 9.0);
-	t.tap(int2( 1, -1) * gPushConstants.gStepSize, 4.0 / 9.0);
-
-	t.tap(int2( 1,  2) * gPushConstants.gStepSize, 1.0 / 9.0);
-	t.tap(int2(-1,  2) * gPushConstants.gStepSize, 1.0 / 9.0);
-	t.tap(int2(-1, -2) * gPushConstants.gStepSize, 1.0 / 9.0);
-	t.tap(int2( 1, -2) * gPushConstants.gStepSize, 1.0 / 9.0);
-
-	t.tap(int2( 2,  1) * gPushConstants.gStepSize, 1.0 / 9.0);
-	t.tap(int2(-2,  1) * gPushConstants.gStepSize, 1.0 / 9.0);
-	t.tap(int2(-2, -1) * gPushConstants.gStepSize, 1.0 / 9.0);
-	t.tap(int2( 2, -1) * gPushConstants.gStepSize, 1.0 / 9.0);
-
-	t.tap(int2( 2,  2) * gPushConstants.gStepSize, 1.0 / 36.0);
-	t.tap(int2(-2,  2) * gPushConstants.gStepSize, 1.0 / 36.0);
-	t.tap(int2(-2, -2) * gPushConstants.gStepSize, 1.0 / 36.0);
-	t.tap(int2( 2, -2) * gPushConstants.gStepSize, 1.0 / 36.0);
+	t.tap(int2( 1,  0) * t.step_size, 2.0 / 3.0);
+	t.tap(int2( 0,  1) * t.step_size, 2.0 / 3.0);
+	t.tap(int2(-1,  0) * t.step_size, 2.0 / 3.0);
+	t.tap(int2( 0, -1) * t.step_size, 2.0 / 3.0);
+
+	t.tap(int2( 2,  0) * t.step_size, 1.0 / 6.0);
+	t.tap(int2( 0,  2) * t.step_size, 1.0 / 6.0);
+	t.tap(int2(-2,  0) * t.step_size, 1.0 / 6.0);
+	t.tap(int2( 0, -2) * t.step_size, 1.0 / 6.0);
+
+	t.tap(int2( 1,  1) * t.step_size, 4.0 / 9.0);
+	t.tap(int2(-1,  1) * t.step_size, 4.0 / 9.0);
+	t.tap(int2(-1, -1) * t.step_size, 4.0 / 9.0);
+	t.tap(int2( 1, -1) * t.step_size, 4.0 / 9.0);
+
+	t.tap(int2( 1,  2) * t.step_size, 1.0 / 9.0);
+	t.tap(int2(-1,  2) * t.step_size, 1.0 / 9.0);
+	t.tap(int2(-1, -2) * t.step_size, 1.0 / 9.0);
+	t.tap(int2( 1, -2) * t.step_size, 1.0 / 9.0);
+
+	t.tap(int2( 2,  1) * t.step_size, 1.0 / 9.0);
+	t.tap(int2(-2,  1) * t.step_size, 1.0 / 9.0);
+	t.tap(int2(-2, -1) * t.step_size, 1.0 / 9.0);
+	t.tap(int2( 2, -1) * t.step_size, 1.0 / 9.0);
+
+	t.tap(int2( 2,  2) * t.step_size, 1.0 / 36.0);
+	t.tap(int2(-2,  2) * t.step_size, 1.0 / 36.0);
+	t.tap(int2(-2, -2) * t.step_size, 1.0 / 36.0);
+	t.tap(int2( 2, -2) * t.step_size, 1.0 / 36.0);
 }
 
-SLANG_SHADER("compute")
-[numthreads(8,8,1)]
-void main(uint3 index : SV_DispatchThreadId) {
-	TapData t;
-	t.view_index = get_view_index(index.xy, gViews, gPushConstants.gViewCount);
-	if (t.view_index == -1) return;
-	uint h;
-	gOutput.GetDimensions(t.screen_width, h);
-
-	const VisibilityInfo vis = gVisibility[index.y*t.screen_width + index.x];
-	const DepthInfo depth = gDepth[index.y*t.screen_width + index.x];
-	t.index = index.xy;
-	t.center_normal = vis.normal();
-	t.z_center = depth.z;
-	t.dz_center = depth.dz_dxy;
+inline float4 filter<S : FilterSource>(const S source, const uint view_index, const int2 index, const uint iteration, const uint step_size) {
+	TapData<S> t;
+	t.source = source;
+	t.view_index = view_index;
+	t.index = index;
+	t.iteration = iteration;
+	t.step_size = step_size;
+	t.center_normal = source.normal(index);
+	t.z_center = source.depth(index);
+	t.dz_center = source.depth_gradient(index);
 	t.sum_weight = 1;
-	t.sum_color = gInput[t.index];
+	t.sum_color = source.color(index);
 	t.l_center = luminance(t.sum_color.rgb);
 
 	t.compute_sigma_luminance();
@@ -243,13 +256,13 @@ void main(uint3 index : SV_DispatchThreadId) {
 			subsampled(t);
 			break;
 		case FilterKernelType::eBox3Subsampled:
-			if (gPushConstants.gStepSize == 1)
+			if (step_size == 1)
 				box3(t);
 			else
 				subsampled(t);
 			break;
 		case FilterKernelType::eBox5Subsampled:
-			if (gPushConstants.gStepSize == 1)
+			if (step_size == 1)
 				box5(t);
 			else
 				subsampled(t);
@@ -258,7 +271,107 @@ void main(uint3 index : SV_DispatchThreadId) {
 	}
 
 	const float inv_w = 1/t.sum_weight;
-	gOutput[t.index] = t.sum_color*float4(inv_w, inv_w, inv_w, pow2(inv_w));
+	return t.sum_color*float4(inv_w, inv_w, inv_w, pow2(inv_w));
+}
+
+SLANG_SHADER("compute")
+[numthreads(8,8,1)]
+void main(uint3 index : SV_DispatchThreadId) {
+	const uint view_index = get_view_index(index.xy, gViewIndices);
+	if (view_index == -1) return;
+	GlobalFilterSource source;
+	uint h;
+	gOutput.GetDimensions(source.screen_width, h);
+	gOutput[index.xy] = filter(source, view_index, index.xy, gPushConstants.gIteration, gPushConstants.gStepSize);
+}
+
+// Fused first two iterations (step sizes 1 and 2). Each group loads its tile plus the combined
+// footprint of both iterations into groupshared memory once, then runs both iterations from there.
+// Every kernel type reaches at most 2*step pixels, so the apron is 2*1 + 2*2 pixels.
+// 8x8 groups keep the tile at 20x20 pixels * 32 bytes = 12.5KB, within the 16KB of groupshared memory every device supports.
+
+#define FUSED_GROUP_SIZE 8
+#define FUSED_RADIUS_0 2
+#define FUSED_RADIUS_1 4
+#define FUSED_APRON (FUSED_RADIUS_0 + FUSED_RADIUS_1)
+#define FUSED_TILE_SIZE (FUSED_GROUP_SIZE + 2*FUSED_APRON)
+// pixels the first iteration must produce for the second one
+#define FUSED_REGION_SIZE (FUSED_GROUP_SIZE + 2*FUSED_RADIUS_1)
+#define FUSED_THREAD_COUNT (FUSED_GROUP_SIZE*FUSED_GROUP_SIZE)
+#define FUSED_REGION_PASSES ((FUSED_REGION_SIZE*FUSED_REGION_SIZE + FUSED_THREAD_COUNT - 1) / FUSED_THREAD_COUNT)
+
+groupshared float4 sColor[FUSED_TILE_SIZE*FUSED_TILE_SIZE];
+groupshared uint sPackedNormal[FUSED_TILE_SIZE*FUSED_TILE_SIZE];
+groupshared float sDepth[FUSED_TILE_SIZE*FUSED_TILE_SIZE];
+groupshared float2 sDepthGradient[FUSED_TILE_SIZE*FUSED_TILE_SIZE];
+
+struct SharedFilterSource : FilterSource {
+	int2 tile_origin;
+	inline uint tile_index(const int2 p) {
+		const int2 l = p - tile_origin;
+		return l.y*FUSED_TILE_SIZE + l.x;
+	}
+	inline float4 color(const int2 p) { return sColor[tile_index(p)]; }
+	inline float3 normal(const int2 p) { return unpack_normal_octahedron(sPackedNormal[tile_index(p)]); }
+	inline float depth(const int2 p) { return sDepth[tile_index(p)]; }
+	inline float2 depth_gradient(const int2 p) { return sDepthGradient[tile_index(p)]; }
+};
+
+SLANG_SHADER("compute")
+[numthreads(FUSED_GROUP_SIZE,FUSED_GROUP_SIZE,1)]
+void main_fused(uint3 group_id : SV_GroupID, uint3 group_thread_id : SV_GroupThreadID, uint group_index : SV_GroupIndex) {
+	uint2 resolution;
+	gInput.GetDimensions(resolution.x, resolution.y);
+
+	SharedFilterSource source;
+	source.tile_origin = int2(group_id.xy*FUSED_GROUP_SIZE) - FUSED_APRON;
+
+	for (uint i = group_index; i < FUSED_TILE_SIZE*FUSED_TILE_SIZE; i += FUSED_THREAD_COUNT) {
+		const int2 p = source.tile_origin + int2(i % FUSED_TILE_SIZE, i / FUSED_TILE_SIZE);
+		if (all(p >= 0) && all(p < int2(resolution))) {
+			const uint addr = p.y*resolution.x + p.x;
+			const DepthInfo depth = gDepth[addr];
+			sColor[i] = gInput[p];
+			sPackedNormal[i] = gVisibility[addr].packed_normal;
+			sDepth[i] = depth.z;
+			sDepthGradient[i] = depth.dz_dxy;
+		} else {
+			// outside of every view, so never tapped
+			sColor[i] = 0;
+			sPackedNormal[i] = 0;
+			sDepth[i] = 0;
+			sDepthGradient[i] = 0;
+		}
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	// first iteration, over the tile and the second iteration's footprint
+	float4 filtered[FUSED_REGION_PASSES];
+	uint view_index[FUSED_REGION_PASSES];
+	[unroll]
+	for (uint j = 0; j < FUSED_REGION_PASSES; j++) {
+		const uint i = group_index + j*FUSED_THREAD_COUNT;
+		view_index[j] = -1;
+		if (i >= FUSED_REGION_SIZE*FUSED_REGION_SIZE) continue;
+		const int2 p = source.tile_origin + FUSED_RADIUS_0 + int2(i % FUSED_REGION_SIZE, i / FUSED_REGION_SIZE);
+		view_index[j] = get_view_index(p, gViewIndices);
+		if (view_index[j] != -1)
+			filtered[j] = filter(source, view_index[j], p, gPushConstants.gIteration, gPushConstants.gStepSize);
+	}
+	GroupMemoryBarrierWithGroupSync();
+	[unroll]
+	for (uint j = 0; j < FUSED_REGION_PASSES; j++) {
+		if (view_index[j] == -1) continue;
+		const uint i = group_index + j*FUSED_THREAD_COUNT;
+		sColor[source.tile_index(source.tile_origin + FUSED_RADIUS_0 + int2(i % FUSED_REGION_SIZE, i / FUSED_REGION_SIZE))] = filtered[j];
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	// second iteration
+	const int2 p = source.tile_origin + FUSED_APRON + int2(group_thread_id.xy);
+	const uint center_view = get_view_index(p, gViewIndices);
+	if (center_view == -1) return;
+	gOutput[p] = filter(source, center_view, p, gPushConstants.gIteration + 1, gPushConstants.gStepSize*2);
 }
 
 SLANG_SHADER("compute")
@@ -267,5 +380,5 @@ void copy_rgb(uint3 index : SV_DispatchThreadID) {
 	uint2 resolution;
 	gAccumColor.GetDimensions(resolution.x, resolution.y);
 	if (any(index.xy >= resolution)) return;
-	gAccumColor[index.xy] = float4(gFilterImages[0][index.xy].rgb, gAccumColor[index.xy].w);
+	gAccumColor[index.xy] = float4(gInput[index.xy].rgb, gAccumColor[index.xy].w);
 }
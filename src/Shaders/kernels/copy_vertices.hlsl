@@ -1,10 +1,14 @@
 #if 0
 #pragma compile dxc -spirv -T cs_6_7 -E main
+#pragma compile dxc -spirv -T cs_6_7 -E compute_bounds
+#pragma compile dxc -spirv -T cs_6_7 -E compact
 #endif
 
 #include "../scene.h"
 
 RWStructuredBuffer<PackedVertexData> gVertices;
+RWStructuredBuffer<CompactVertexData> gCompactVertices;
+RWStructuredBuffer<uint> gBounds; // min and max position, as order-preserving uints
 ByteAddressBuffer gPositions;
 ByteAddressBuffer gNormals;
 ByteAddressBuffer gTangents;
@@ -35,4 +39,55 @@ void main(uint3 index : SV_DispatchThreadId) {
 		//gPushConstants.gTangentStride > 0 ? gTangents.Load<float4>(index.x*gPushConstants.gTangentStride) : 0,
 		gPushConstants.gTexcoordStride > 0 ? gTexcoords.Load<float2>(index.x*gPushConstants.gTexcoordStride) : 0 );
 	gVertices[index.x] = v;
-}
\ No newline at end of file
+}
+
+// maps floats to uints such that the order is preserved, for atomic min/max
+uint float_to_ordered_uint(const float f) {
+	const uint u = asuint(f);
+	return u ^ ((u >> 31) ? 0xFFFFFFFF : 0x80000000);
+}
+float ordered_uint_to_float(const uint u) {
+	return asfloat(u ^ ((u >> 31) ? 0x80000000 : 0xFFFFFFFF));
+}
+
+// gBounds must be initialized to (-1,-1,-1, 0,0,0)
+SLANG_SHADER("compute")
+[numthreads(64,1,1)]
+void compute_bounds(uint3 index : SV_DispatchThreadId) {
+	if (index.x >= gPushConstants.gCount) return;
+	const float3 p = gPositions.Load<float3>(index.x*gPushConstants.gPositionStride);
+	const float3 p_min = WaveActiveMin(p);
+	const float3 p_max = WaveActiveMax(p);
+	if (WaveIsFirstLane()) {
+		for (uint i = 0; i < 3; i++) {
+			InterlockedMin(gBounds[i], float_to_ordered_uint(p_min[i]));
+			InterlockedMax(gBounds[3 + i], float_to_ordered_uint(p_max[i]));
+		}
+	}
+}
+
+// Writes the bounds to the first COMPACT_VERTEX_BOUNDS_SLOTS elements of gCompactVertices, followed by the vertices
+SLANG_SHADER("compute")
+[numthreads(64,1,1)]
+void compact(uint3 index : SV_DispatchThreadId) {
+	const float3 bounds_min = float3(ordered_uint_to_float(gBounds[0]), ordered_uint_to_float(gBounds[1]), ordered_uint_to_float(gBounds[2]));
+	const float3 bounds_max = float3(ordered_uint_to_float(gBounds[3]), ordered_uint_to_float(gBounds[4]), ordered_uint_to_float(gBounds[5]));
+	if (index.x == 0) {
+		CompactVertexData b;
+		b.packed_position = asuint(bounds_min.xy);
+		b.packed_normal = asuint(bounds_min.z);
+		b.packed_uv = 0;
+		gCompactVertices[0] = b;
+		b.packed_position = asuint(bounds_max.xy - bounds_min.xy);
+		b.packed_normal = asuint(bounds_max.z - bounds_min.z);
+		gCompactVertices[1] = b;
+	}
+	if (index.x >= gPushConstants.gCount) return;
+	CompactVertexData v;
+	v.set(
+		gPositions.Load<float3>(index.x*gPushConstants.gPositionStride),
+		gNormals.Load<float3>(index.x*gPushConstants.gNormalStride),
+		gPushConstants.gTexcoordStride > 0 ? gTexcoords.Load<float2>(index.x*gPushConstants.gTexcoordStride) : 0,
+		bounds_min, bounds_max - bounds_min);
+	gCompactVertices[COMPACT_VERTEX_BOUNDS_SLOTS + index.x] = v;
+}
@@ -49,7 +49,7 @@ struct PushConstants {
 SLANG_SHADER("compute")
 [numthreads(8,8,1)]
 void main(uint3 index : SV_DispatchThreadId, uint3 group_index : SV_GroupThreadID) {
-	const uint view_index = get_view_index(index.xy, gViews, gPushConstants.gViewCount);
+	const uint view_index = get_view_index(index.xy, gViewIndices);
 	if (view_index == -1) return;
 
 	uint2 extent;
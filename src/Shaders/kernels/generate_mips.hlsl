@@ -0,0 +1,196 @@
+#pragma compile dxc -spirv -fspv-target-env=vulkan1.2 -T cs_6_7 -E main
+#pragma compile dxc -spirv -fspv-target-env=vulkan1.2 -T cs_6_7 -D STORAGE_FORMAT_RGBA8 -E main_rgba8
+#pragma compile dxc -spirv -fspv-target-env=vulkan1.2 -T cs_6_7 -D STORAGE_FORMAT_RGBA16F -E main_rgba16f
+#pragma compile dxc -spirv -fspv-target-env=vulkan1.2 -T cs_6_7 -D STORAGE_FORMAT_RGBA32F -E main_rgba32f
+
+#include <common.h>
+
+// Single-pass mip chain generation. Each group reduces a 64x64 tile of gSource to mips 1-6 through groupshared memory,
+// then the last group to finish (found with an atomic counter) reduces mip 6, which is at most 64x64, to mips 7-12.
+
+#define GROUP_SIZE 256
+#define TILE_SIZE 64
+#define MAX_MIPS 12
+#define COVERAGE_SEARCH_ITERATIONS 10
+
+[[vk::constant_id(0)]] const bool gSrgb = false; // gMips are UNORM views of an sRGB image, so stores must be encoded manually
+[[vk::constant_id(1)]] const bool gPreserveAlphaCoverage = false;
+
+Texture2D<float4> gSource;
+// the typed variants are used on devices without shaderStorageImageWriteWithoutFormat
+#if defined(STORAGE_FORMAT_RGBA8)
+[[vk::image_format("rgba8")]]
+#elif defined(STORAGE_FORMAT_RGBA16F)
+[[vk::image_format("rgba16f")]]
+#elif defined(STORAGE_FORMAT_RGBA32F)
+[[vk::image_format("rgba32f")]]
+#endif
+RWTexture2D<float4> gMips[MAX_MIPS]; // gMips[i] is level i+1, relative to gSource
+globallycoherent RWStructuredBuffer<uint> gCounters; // 0: finished groups, 1: source texels that pass the alpha test
+globallycoherent RWStructuredBuffer<float4> gIntermediate; // linear copy of mip 6, read by the last group
+
+[[vk::push_constant]] const struct {
+	uint2 gExtent; // extent of gSource
+	uint gMipCount; // number of valid entries in gMips
+	float gAlphaCutoff;
+} gPushConstants;
+
+groupshared float4 sTexels[TILE_SIZE/4][TILE_SIZE/4];
+groupshared uint sCounts[3];
+groupshared uint sIsLastGroup;
+
+static uint gSumIndex = 0;
+
+uint2 mip_extent(const uint level) {
+	return max(gPushConstants.gExtent >> level, 1);
+}
+
+float3 linear_to_srgb(const float3 rgb) {
+	float3 srgb;
+	for (int i = 0; i < 3; i++)
+		srgb[i] = rgb[i] <= 0.0031308 ? rgb[i] * 12.92 : 1.055 * pow(rgb[i], 1/2.4) - 0.055;
+	return srgb;
+}
+
+// Sums value over the group. Must be called from uniform control flow.
+// The counters are triple buffered so that only one barrier is needed per sum
+uint group_sum(const uint value, const uint group_index) {
+	const uint i = gSumIndex % 3;
+	gSumIndex++;
+	if (value > 0) InterlockedAdd(sCounts[i], value);
+	if (group_index == 0) sCounts[(i + 1) % 3] = 0;
+	GroupMemoryBarrierWithGroupSync();
+	return sCounts[i];
+}
+
+// Finds the alpha scale that makes the fraction of valid texels passing the alpha test match target_coverage,
+// by searching for the alpha value that would yield target_coverage if used as the cutoff. Must be called from uniform control flow
+float coverage_scale(const float4 alpha, const float4 valid, const float target_coverage, const uint group_index) {
+	const float count = max(group_sum((uint)dot(valid, 1), group_index), 1);
+	float lo = 0;
+	float hi = 1;
+	float cutoff = gPushConstants.gAlphaCutoff;
+	for (uint i = 0; i < COVERAGE_SEARCH_ITERATIONS; i++) {
+		if (group_sum((uint)dot(valid, (float4)(alpha > cutoff)), group_index) / count > target_coverage)
+			lo = cutoff;
+		else
+			hi = cutoff;
+		cutoff = (lo + hi)/2;
+	}
+	return cutoff > 0 ? gPushConstants.gAlphaCutoff / cutoff : 1;
+}
+
+float4 load_source(const uint base_level, const uint2 p) {
+	const uint2 c = min(p, mip_extent(base_level) - 1);
+	return base_level == 0 ? gSource.Load(int3(c, 0)) : gIntermediate[c.y*TILE_SIZE + c.x];
+}
+
+void store_mip(const uint level, const uint2 p, float4 c, const float alpha_scale) {
+	if (level > gPushConstants.gMipCount || any(p >= mip_extent(level))) return;
+	if (gPreserveAlphaCoverage) c.a = saturate(c.a * alpha_scale);
+	if (gSrgb) c.rgb = linear_to_srgb(c.rgb);
+	gMips[level - 1][p] = c;
+}
+
+// Reduces a 64x64 tile of base_level to the 6 levels below it. Levels are box filtered; when an extent is odd, its last row/column is dropped like a 2x2 linear blit would
+void downsample_tile(const uint base_level, const uint2 tile, const uint group_index, float target_coverage) {
+	// each thread reduces a 4x4 block of base_level to 2x2 texels of the first level and 1 texel of the second
+	const uint2 p2 = tile*(TILE_SIZE/4) + uint2(group_index % (TILE_SIZE/4), group_index / (TILE_SIZE/4));
+	float4 c1[4];
+	float4 alpha1;
+	float4 valid1;
+	uint pass_count = 0;
+	uint valid_count = 0;
+	[unroll]
+	for (uint i = 0; i < 4; i++) {
+		const uint2 p1 = p2*2 + uint2(i & 1, i >> 1);
+		float4 c = 0;
+		[unroll]
+		for (uint j = 0; j < 4; j++) {
+			const uint2 p0 = p1*2 + uint2(j & 1, j >> 1);
+			const float4 t = load_source(base_level, p0);
+			c += t;
+			if (gPreserveAlphaCoverage && all(p0 < mip_extent(base_level))) {
+				valid_count++;
+				if (t.a > gPushConstants.gAlphaCutoff) pass_count++;
+			}
+		}
+		c1[i] = c/4;
+		alpha1[i] = c1[i].a;
+		valid1[i] = all(p1 < mip_extent(base_level + 1));
+	}
+
+	if (gPreserveAlphaCoverage && base_level == 0) {
+		// the first pass targets the coverage of the source tile, and accumulates the coverage of the whole image for the last group
+		const uint tile_pass_count = group_sum(pass_count, group_index);
+		target_coverage = tile_pass_count / (float)max(group_sum(valid_count, group_index), 1);
+		if (group_index == 0) InterlockedAdd(gCounters[1], tile_pass_count);
+	}
+
+	float alpha_scale = 1;
+	if (gPreserveAlphaCoverage && base_level + 1 <= gPushConstants.gMipCount)
+		alpha_scale = coverage_scale(alpha1, valid1, target_coverage, group_index);
+	[unroll]
+	for (uint i = 0; i < 4; i++)
+		store_mip(base_level + 1, p2*2 + uint2(i & 1, i >> 1), c1[i], alpha_scale);
+
+	const float4 c2 = (c1[0] + c1[1] + c1[2] + c1[3])/4;
+	sTexels[group_index / (TILE_SIZE/4)][group_index % (TILE_SIZE/4)] = c2;
+	if (gPreserveAlphaCoverage && base_level + 2 <= gPushConstants.gMipCount)
+		alpha_scale = coverage_scale(float4(c2.a, 0, 0, 0), float4(all(p2 < mip_extent(base_level + 2)), 0, 0, 0), target_coverage, group_index);
+	store_mip(base_level + 2, p2, c2, alpha_scale);
+	GroupMemoryBarrierWithGroupSync();
+
+	for (uint level = 3; level <= 6; level++) {
+		const uint size = TILE_SIZE >> level;
+		const bool active = group_index < size*size;
+		const uint2 lp = uint2(group_index % size, group_index / size);
+		float4 c = 0;
+		if (active)
+			c = (sTexels[2*lp.y][2*lp.x] + sTexels[2*lp.y][2*lp.x + 1] + sTexels[2*lp.y + 1][2*lp.x] + sTexels[2*lp.y + 1][2*lp.x + 1])/4;
+		GroupMemoryBarrierWithGroupSync();
+		if (active) sTexels[lp.y][lp.x] = c;
+
+		const uint2 p = tile*size + lp;
+		if (gPreserveAlphaCoverage && base_level + level <= gPushConstants.gMipCount)
+			alpha_scale = coverage_scale(float4(c.a, 0, 0, 0), float4(active && all(p < mip_extent(base_level + level)), 0, 0, 0), target_coverage, group_index);
+		if (active) {
+			store_mip(base_level + level, p, c, alpha_scale);
+			if (base_level == 0 && level == 6 && gPushConstants.gMipCount > 6)
+				gIntermediate[p.y*TILE_SIZE + p.x] = c;
+		}
+		GroupMemoryBarrierWithGroupSync();
+	}
+}
+
+void generate_mips(const uint3 group_id, const uint group_index) {
+	if (group_index == 0) sCounts[0] = 0;
+	GroupMemoryBarrierWithGroupSync();
+
+	downsample_tile(0, group_id.xy, group_index, 0);
+
+	if (gPushConstants.gMipCount <= 6) return;
+
+	DeviceMemoryBarrierWithGroupSync();
+	if (group_index == 0) {
+		const uint2 group_count = (gPushConstants.gExtent + TILE_SIZE - 1) / TILE_SIZE;
+		uint finished;
+		InterlockedAdd(gCounters[0], 1, finished);
+		sIsLastGroup = finished == group_count.x*group_count.y - 1;
+	}
+	GroupMemoryBarrierWithGroupSync();
+	if (!sIsLastGroup) return;
+
+	// mip 6 is complete once every other group has incremented the counter
+	const float target_coverage = gCounters[1] / (float)(gPushConstants.gExtent.x*gPushConstants.gExtent.y);
+	downsample_tile(6, 0, group_index, target_coverage);
+}
+
+[numthreads(GROUP_SIZE, 1, 1)]
+void main(uint3 group_id : SV_GroupID, uint group_index : SV_GroupIndex) { generate_mips(group_id, group_index); }
+[numthreads(GROUP_SIZE, 1, 1)]
+void main_rgba8(uint3 group_id : SV_GroupID, uint group_index : SV_GroupIndex) { generate_mips(group_id, group_index); }
+[numthreads(GROUP_SIZE, 1, 1)]
+void main_rgba16f(uint3 group_id : SV_GroupID, uint group_index : SV_GroupIndex) { generate_mips(group_id, group_index); }
+[numthreads(GROUP_SIZE, 1, 1)]
+void main_rgba32f(uint3 group_id : SV_GroupID, uint group_index : SV_GroupIndex) { generate_mips(group_id, group_index); }
@@ -8,7 +8,7 @@
 
 Texture2D<float4> gImage1;
 Texture2D<float4> gImage2;
-RWStructuredBuffer<uint> gOutput;
+RWStructuredBuffer<uint> gOutput; // 64-bit fixed-point sum of the error, low word first
 
 [numthreads(8,8,1)]
 void main(uint3 index : SV_DispatchThreadID) {
@@ -16,19 +16,25 @@ void main(uint3 index : SV_DispatchThreadID) {
 	gImage1.GetDimensions(resolution.x, resolution.y);
 	if (any(index.xy >= resolution)) return;
 
-	const float3 c1 = gImage1[index.xy].rgb;
+	const float4 c1 = gImage1[index.xy];
 	const float3 c2 = gImage2[index.xy].rgb;
 
 	float error = 0;
 	switch (gMode) {
 	case (uint)CompareMetric::eSMAPE:
-		error = dot(1, abs(c1 - c2) / (abs(c1) + abs(c2)));
+		error = dot(1, abs(c1.rgb - c2) / (abs(c1.rgb) + abs(c2)));
 		break;
 	case (uint)CompareMetric::eMSE:
-		error = dot(1, pow2(c1 - c2));
+		error = dot(1, pow2(c1.rgb - c2));
 		break;
 	case (uint)CompareMetric::eAverage:
-		error = dot(1, c1 - c2);
+		error = dot(1, c1.rgb - c2);
+		break;
+	case (uint)CompareMetric::eRelMSE:
+		error = dot(1, pow2(c1.rgb - c2) / (pow2(c2) + 1e-2));
+		break;
+	case (uint)CompareMetric::eSampleCount:
+		error = 3*c1.a; // cancels the division by the channel count below
 		break;
 	}
 	error /= 3*resolution.x*resolution.y;
@@ -36,12 +42,14 @@ void main(uint3 index : SV_DispatchThreadID) {
 	error = WaveActiveSum(error);
 
 	if (WaveIsFirstLane()) {
-		uint prev;
+		// each wave's sum is split into 32-bit words, and the carry out of the low word is added to the high word
 		const float valf = error*gQuantization;
-		const uint val = valf;
-		InterlockedAdd(gOutput[0], val, prev);
-		if (valf >= 0xFFFFFFFF || 0xFFFFFFFF - val < prev) {
-			gOutput[1] = 1;
-		}
+		const uint hi = valf / 4294967296.0;
+		const uint lo = valf - hi*4294967296.0;
+		uint prev;
+		InterlockedAdd(gOutput[0], lo, prev);
+		const uint carry = (prev + lo < prev) ? 1 : 0;
+		if (hi + carry > 0)
+			InterlockedAdd(gOutput[1], hi + carry);
 	}
 }
\ No newline at end of file
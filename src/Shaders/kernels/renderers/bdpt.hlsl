@@ -4,8 +4,15 @@
 #pragma compile slangc -capability GL_EXT_ray_tracing -profile sm_6_6 -lang slang -entry trace_shadows
 #pragma compile slangc -profile sm_6_6 -lang slang -entry presample_lights
 #pragma compile slangc -profile sm_6_6 -lang slang -entry add_light_trace
+#pragma compile slangc -profile sm_6_6 -lang slang -entry hashgrid_scan_buckets
+#pragma compile slangc -profile sm_6_6 -lang slang -entry hashgrid_scan_groups
 #pragma compile slangc -profile sm_6_6 -lang slang -entry hashgrid_compute_indices
 #pragma compile slangc -profile sm_6_6 -lang slang -entry hashgrid_swizzle
+#pragma compile slangc -profile sm_6_6 -lang slang -entry adaptive_sample_counts
+#pragma compile slangc -profile sm_6_6 -lang slang -entry adaptive_dispatch_args
+#pragma compile slangc -profile sm_6_6 -lang slang -entry adaptive_compact
+#pragma compile slangc -capability GL_EXT_ray_tracing -profile sm_6_6 -lang slang -entry sample_adaptive
+#pragma compile slangc -profile sm_6_6 -lang slang -entry adaptive_resolve
 #endif
 
 #define GROUPSIZE_X 8
@@ -18,7 +25,7 @@
 
 struct SceneParameters {
 	RaytracingAccelerationStructure gAccelerationStructure;
-	StructuredBuffer<PackedVertexData> gVertices;
+	ByteAddressBuffer gVertices; // PackedVertexData, or CompactVertexData when gCompactVertices is set
 	ByteAddressBuffer gIndices;
 	StructuredBuffer<InstanceData> gInstances;
 	StructuredBuffer<TransformData> gInstanceTransforms;
@@ -29,9 +36,9 @@ struct SceneParameters {
 	StructuredBuffer<float> gDistributions;
 	SamplerState gStaticSampler;
 	RWStructuredBuffer<uint> gRayCount;
-	StructuredBuffer<uint> gVolumes[gVolumeCount];
-	Texture2D<float4> gImages[gImageCount];
-	Texture2D<float> gImage1s[gImageCount];
+	StructuredBuffer<uint> gVolumes[];
+	Texture2D<float4> gImages[];
+	Texture2D<float> gImage1s[];
 };
 struct PerFrameParameters {
 	StructuredBuffer<ViewData> gViews;
@@ -40,6 +47,7 @@ struct PerFrameParameters {
 	StructuredBuffer<TransformData> gInverseViewTransforms;
 	StructuredBuffer<TransformData> gPrevInverseViewTransforms;
 	StructuredBuffer<uint> gViewMediumInstances;
+	Texture2D<uint> gViewIndices;
 	RWTexture2D<float4> gRadiance;
 	RWTexture2D<float4> gAlbedo;
 	RWTexture2D<float4> gDebugImage;
@@ -52,6 +60,13 @@ struct PerFrameParameters {
 	RWStructuredBuffer<PathVertex> gLightPathVertices;
 	RWStructuredBuffer<uint> gLightPathVertexCount;
 
+	Texture2D<float4> gAccumColor; // the denoiser's accumulated radiance from the previous frame, alpha is the sample count
+	Texture2D<float2> gAccumMoments;
+	RWStructuredBuffer<uint> gAdaptiveSampleCounts; // view paths traced per pixel this frame
+	RWStructuredBuffer<uint> gAdaptiveCounters; // pixel count for each extra path count, followed by the write cursors into gAdaptivePixels
+	RWStructuredBuffer<uint4> gAdaptiveDispatch; // per extra pass: indirect dispatch size, and the number of pixels in the pass
+	RWStructuredBuffer<uint> gAdaptivePixels; // packed pixel coordinates, sorted by descending extra path count
+
 	HashGrid<NEEReservoir> gNEEHashGrid;
 	HashGrid<NEEReservoir> gPrevNEEHashGrid;
 	HashGrid<PathVertexReservoir> gLVCHashGrid;
@@ -67,11 +82,22 @@ ParameterBlock<PerFrameParameters> gFrameParams;
 #include "../../common/path.hlsli"
 
 SLANG_SHADER("compute")
-[numthreads(64,1,1)]
-void hashgrid_compute_indices(uint3 index : SV_DispatchThreadID) {
-	const uint bucket_index = index.y * gOutputExtent.x + index.x;
-	if (gUseNEEReservoirReuse) gFrameParams.gNEEHashGrid.compute_indices(bucket_index);
-	if (gUseLVCReservoirReuse) gFrameParams.gLVCHashGrid.compute_indices(bucket_index);
+[numthreads(HASHGRID_SCAN_GROUP_SIZE,1,1)]
+void hashgrid_scan_buckets(uint3 group_id : SV_GroupID, uint group_index : SV_GroupIndex) {
+	if (gUseNEEReservoirReuse) gFrameParams.gNEEHashGrid.scan_buckets(group_id.x, group_index);
+	if (gUseLVCReservoirReuse) gFrameParams.gLVCHashGrid.scan_buckets(group_id.x, group_index);
+}
+SLANG_SHADER("compute")
+[numthreads(HASHGRID_SCAN_GROUP_SIZE,1,1)]
+void hashgrid_scan_groups(uint3 group_id : SV_GroupID, uint group_index : SV_GroupIndex) {
+	if (gUseNEEReservoirReuse) gFrameParams.gNEEHashGrid.scan_groups(group_index);
+	if (gUseLVCReservoirReuse) gFrameParams.gLVCHashGrid.scan_groups(group_index);
+}
+SLANG_SHADER("compute")
+[numthreads(HASHGRID_SCAN_GROUP_SIZE,1,1)]
+void hashgrid_compute_indices(uint3 group_id : SV_GroupID, uint group_index : SV_GroupIndex) {
+	if (gUseNEEReservoirReuse) gFrameParams.gNEEHashGrid.compute_indices(group_id.x, group_index);
+	if (gUseLVCReservoirReuse) gFrameParams.gLVCHashGrid.compute_indices(group_id.x, group_index);
 }
 SLANG_SHADER("compute")
 [numthreads(64,1,1)]
@@ -146,20 +172,23 @@ void sample_photons(uint3 index : SV_DispatchThreadID, uint group_thread_index :
 		path.next_vertex();
 }
 
-SLANG_SHADER("compute")
-[numthreads(GROUPSIZE_X,GROUPSIZE_Y,1)]
-void sample_visibility(uint3 index : SV_DispatchThreadID, uint group_thread_index : SV_GroupIndex, uint3 group_id : SV_GroupID) {
-	const uint path_index = map_pixel_coord(index.xy, group_id.xy, group_thread_index);
-	if (path_index >= gOutputExtent.x*gOutputExtent.y) return;
+// Traces a view path through the center of pixel_coord. The primary path of each pixel also resets gRadiance and writes the
+// visibility, depth, albedo and reprojection data; adaptive sampling traces the extra paths, which only add to gRadiance
+void trace_view_path(const uint2 pixel_coord, const uint path_index, const bool primary) {
+	PathIntegrator path = PathIntegrator(pixel_coord, path_index);
 
-	PathIntegrator path = PathIntegrator(index.xy, path_index);
-
-	const uint view_index = get_view_index(index.xy, gFrameParams.gViews, gViewCount);
+	const uint view_index = get_view_index(pixel_coord, gFrameParams.gViewIndices);
 	if (view_index == -1) return;
 
-	gFrameParams.gRadiance[path.pixel_coord] = float4(0,0,0,1);
-	if ((BDPTDebugMode)gDebugMode == BDPTDebugMode::ePathLengthContribution || (BDPTDebugMode)gDebugMode == BDPTDebugMode::eViewTraceContribution)
-		gFrameParams.gDebugImage[path.pixel_coord] = float4(0,0,0,1);
+	// converged pixels still write the visibility data that the denoiser reprojects with, but don't trace past the first vertex.
+	// Their radiance has a weight of 0, so the accumulated history is kept as-is
+	const uint sample_count = (primary && gAdaptiveSampling) ? gFrameParams.gAdaptiveSampleCounts[pixel_coord.y*gOutputExtent.x + pixel_coord.x] : 1;
+
+	if (primary) {
+		gFrameParams.gRadiance[path.pixel_coord] = float4(0,0,0,sample_count > 0 ? 1 : 0);
+		if ((BDPTDebugMode)gDebugMode == BDPTDebugMode::ePathLengthContribution || (BDPTDebugMode)gDebugMode == BDPTDebugMode::eViewTraceContribution)
+			gFrameParams.gDebugImage[path.pixel_coord] = float4(0,0,0,1);
+	}
 
 	if (gMaxPathVertices < 2) return;
 
@@ -187,7 +216,7 @@ void sample_visibility(uint3 index : SV_DispatchThreadID, uint group_thread_inde
 		path.ray_differential.spread = min(length(dir_dx/dir_dx.z - local_dir_out/local_dir_out.z), length(dir_dy/dir_dy.z - local_dir_out/local_dir_out.z));
 	}
 
-	if ((BDPTDebugMode)gDebugMode == BDPTDebugMode::eEnvironmentSampleTest) {
+	if (primary && (BDPTDebugMode)gDebugMode == BDPTDebugMode::eEnvironmentSampleTest) {
 		Environment env;
 		env.load(gEnvironmentMaterialAddress);
 		for (uint i = 0; i < 8; i++) {
@@ -197,7 +226,7 @@ void sample_visibility(uint3 index : SV_DispatchThreadID, uint group_thread_inde
 			gFrameParams.gDebugImage[path.pixel_coord].rgb += 1024*pow(max(0, dot(dir, path.direction)), 1024);
 		}
 		return;
-	} else if ((BDPTDebugMode)gDebugMode == BDPTDebugMode::eEnvironmentSamplePDF) {
+	} else if (primary && (BDPTDebugMode)gDebugMode == BDPTDebugMode::eEnvironmentSamplePDF) {
 		Environment env;
 		env.load(gEnvironmentMaterialAddress);
 		gFrameParams.gDebugImage[path.pixel_coord].rgb = env.eval_pdf(path.direction);
@@ -219,20 +248,24 @@ void sample_visibility(uint3 index : SV_DispatchThreadID, uint group_thread_inde
 	// dE_1 = N_{0,k} / p_0_fwd
 	path.dVC = 1 / pdfWtoA(path.bsdf_pdf, path.G);
 
-	if      ((BDPTDebugMode)gDebugMode == BDPTDebugMode::eGeometryNormal) gFrameParams.gDebugImage[path.pixel_coord] = float4(path._isect.sd.geometry_normal()*.5+.5, 1);
-	else if ((BDPTDebugMode)gDebugMode == BDPTDebugMode::eShadingNormal)  gFrameParams.gDebugImage[path.pixel_coord] = float4(path._isect.sd.shading_normal() *.5+.5, 1);
+	if (primary) {
+		if      ((BDPTDebugMode)gDebugMode == BDPTDebugMode::eGeometryNormal) gFrameParams.gDebugImage[path.pixel_coord] = float4(path._isect.sd.geometry_normal()*.5+.5, 1);
+		else if ((BDPTDebugMode)gDebugMode == BDPTDebugMode::eShadingNormal)  gFrameParams.gDebugImage[path.pixel_coord] = float4(path._isect.sd.shading_normal() *.5+.5, 1);
+	}
 
 	// store visibility
 	VisibilityInfo vis;
-	vis.instance_primitive_index = path._isect.instance_primitive_index;
+	vis.instance = path._isect.instance_index();
 	vis.packed_normal = path._isect.sd.packed_shading_normal;
 
 	// handle miss
 	if (path._isect.instance_index() == INVALID_INSTANCE) {
-		gFrameParams.gAlbedo[path.pixel_coord] = 1;
-		gFrameParams.gVisibility[path.pixel_coord.y*gOutputExtent.x + path.pixel_coord.x] = vis;
-		gFrameParams.gDepth[path.pixel_coord.y*gOutputExtent.x + path.pixel_coord.x] = { POS_INFINITY, POS_INFINITY, 0 };
-		gFrameParams.gPrevUVs[path.pixel_coord.xy] = uv;
+		if (primary) {
+			gFrameParams.gAlbedo[path.pixel_coord] = 1;
+			gFrameParams.gVisibility[path.pixel_coord.y*gOutputExtent.x + path.pixel_coord.x] = vis;
+			gFrameParams.gDepth[path.pixel_coord.y*gOutputExtent.x + path.pixel_coord.x] = { POS_INFINITY, POS_INFINITY, 0 };
+			gFrameParams.gPrevUVs[path.pixel_coord.xy] = uv;
+		}
 		if (gHasEnvironment) {
 			Environment env;
 			env.load(gEnvironmentMaterialAddress);
@@ -252,53 +285,68 @@ void sample_visibility(uint3 index : SV_DispatchThreadID, uint group_thread_inde
 
 		path.eval_emission(m.Le());
 
-		gFrameParams.gAlbedo[path.pixel_coord] = float4(m.albedo(), 1);
+		if (primary) {
+			gFrameParams.gAlbedo[path.pixel_coord] = float4(m.albedo(), 1);
 
-		if      ((BDPTDebugMode)gDebugMode == BDPTDebugMode::eAlbedo) 		 gFrameParams.gDebugImage[path.pixel_coord] = float4(m.albedo(), 1);
-		else if ((BDPTDebugMode)gDebugMode == BDPTDebugMode::eSpecular) 	 gFrameParams.gDebugImage[path.pixel_coord] = float4(float3(m.is_specular()), 1);
-		else if ((BDPTDebugMode)gDebugMode == BDPTDebugMode::eEmission) 	 gFrameParams.gDebugImage[path.pixel_coord] = float4(m.Le(), 1);
-	    else if ((BDPTDebugMode)gDebugMode == BDPTDebugMode::eShadingNormal) gFrameParams.gDebugImage[path.pixel_coord] = float4(tmp_sd.shading_normal() *.5+.5, 1);
+			if      ((BDPTDebugMode)gDebugMode == BDPTDebugMode::eAlbedo) 		 gFrameParams.gDebugImage[path.pixel_coord] = float4(m.albedo(), 1);
+			else if ((BDPTDebugMode)gDebugMode == BDPTDebugMode::eSpecular) 	 gFrameParams.gDebugImage[path.pixel_coord] = float4(float3(m.is_specular()), 1);
+			else if ((BDPTDebugMode)gDebugMode == BDPTDebugMode::eEmission) 	 gFrameParams.gDebugImage[path.pixel_coord] = float4(m.Le(), 1);
+		    else if ((BDPTDebugMode)gDebugMode == BDPTDebugMode::eShadingNormal) gFrameParams.gDebugImage[path.pixel_coord] = float4(tmp_sd.shading_normal() *.5+.5, 1);
+		}
 	}
-	gFrameParams.gVisibility[path.pixel_coord.y*gOutputExtent.x + path.pixel_coord.x] = vis;
 
-	const Vector3 prev_cam_pos = tmul(gFrameParams.gPrevInverseViewTransforms[view_index], gSceneParams.gInstanceMotionTransforms[path._isect.instance_index()]).transform_point(path._isect.sd.position);
+	if (primary) {
+		gFrameParams.gVisibility[path.pixel_coord.y*gOutputExtent.x + path.pixel_coord.x] = vis;
 
-	// store depth information
-	{
-		DepthInfo depth;
-		depth.z = length(path._isect.sd.position - path.origin);
-		depth.prev_z = length(prev_cam_pos);
+		const Vector3 prev_cam_pos = tmul(gFrameParams.gPrevInverseViewTransforms[view_index], gSceneParams.gInstanceMotionTransforms[path._isect.instance_index()]).transform_point(path._isect.sd.position);
 
-		const ViewData view = gFrameParams.gViews[view_index];
-		const float2 uv_x = (path.pixel_coord + uint2(1,0) + 0.5 - view.image_min)/view.extent();
-		float2 clipPos_x = 2*uv_x - 1;
-		clipPos_x.y = -clipPos_x.y;
-		const Vector3 dir_out_x = normalize(gFrameParams.gViewTransforms[view_index].transform_vector(normalize(view.projection.back_project(clipPos_x))));
-		depth.dz_dxy.x = ray_plane(path.origin - path._isect.sd.position, dir_out_x, path._isect.sd.geometry_normal()) - depth.z;
-
-		const float2 uv_y = (path.pixel_coord + uint2(0,1) + 0.5 - view.image_min)/view.extent();
-		float2 clipPos_y = 2*uv_y - 1;
-		clipPos_y.y = -clipPos_y.y;
-		const Vector3 dir_out_y = normalize(gFrameParams.gViewTransforms[view_index].transform_vector(normalize(view.projection.back_project(clipPos_y))));
-		depth.dz_dxy.y = ray_plane(path.origin - path._isect.sd.position, dir_out_y, path._isect.sd.geometry_normal()) - depth.z;
-
-		gFrameParams.gDepth[path.pixel_coord.y*gOutputExtent.x + path.pixel_coord.x] = depth;
-	}
+		// store depth information
+		{
+			DepthInfo depth;
+			depth.z = length(path._isect.sd.position - path.origin);
+			depth.prev_z = length(prev_cam_pos);
+
+			const ViewData view = gFrameParams.gViews[view_index];
+			const float2 uv_x = (path.pixel_coord + uint2(1,0) + 0.5 - view.image_min)/view.extent();
+			float2 clipPos_x = 2*uv_x - 1;
+			clipPos_x.y = -clipPos_x.y;
+			const Vector3 dir_out_x = normalize(gFrameParams.gViewTransforms[view_index].transform_vector(normalize(view.projection.back_project(clipPos_x))));
+			depth.dz_dxy.x = ray_plane(path.origin - path._isect.sd.position, dir_out_x, path._isect.sd.geometry_normal()) - depth.z;
 
-	// calculate prev uv
-	{
-		float4 prev_clip_pos = gFrameParams.gPrevViews[view_index].projection.project_point(prev_cam_pos);
-		prev_clip_pos.y = -prev_clip_pos.y;
-		prev_clip_pos.xyz /= prev_clip_pos.w;
-		gFrameParams.gPrevUVs[path.pixel_coord.xy] = prev_clip_pos.xy*.5 + .5;
-		if ((BDPTDebugMode)gDebugMode == BDPTDebugMode::ePrevUV)
-			gFrameParams.gDebugImage[path.pixel_coord] = float4(abs(gFrameParams.gPrevUVs[path.pixel_coord.xy] - uv)*gOutputExtent, 0, 1);
+			const float2 uv_y = (path.pixel_coord + uint2(0,1) + 0.5 - view.image_min)/view.extent();
+			float2 clipPos_y = 2*uv_y - 1;
+			clipPos_y.y = -clipPos_y.y;
+			const Vector3 dir_out_y = normalize(gFrameParams.gViewTransforms[view_index].transform_vector(normalize(view.projection.back_project(clipPos_y))));
+			depth.dz_dxy.y = ray_plane(path.origin - path._isect.sd.position, dir_out_y, path._isect.sd.geometry_normal()) - depth.z;
+
+			gFrameParams.gDepth[path.pixel_coord.y*gOutputExtent.x + path.pixel_coord.x] = depth;
+		}
+
+		// calculate prev uv
+		{
+			float4 prev_clip_pos = gFrameParams.gPrevViews[view_index].projection.project_point(prev_cam_pos);
+			prev_clip_pos.y = -prev_clip_pos.y;
+			prev_clip_pos.xyz /= prev_clip_pos.w;
+			gFrameParams.gPrevUVs[path.pixel_coord.xy] = prev_clip_pos.xy*.5 + .5;
+			if ((BDPTDebugMode)gDebugMode == BDPTDebugMode::ePrevUV)
+				gFrameParams.gDebugImage[path.pixel_coord] = float4(abs(gFrameParams.gPrevUVs[path.pixel_coord.xy] - uv)*gOutputExtent, 0, 1);
+		}
 	}
 
+	if (sample_count == 0) return;
+
 	while (any(path._beta > 0) && !any(isnan(path._beta)))
 		path.next_vertex();
 }
 
+SLANG_SHADER("compute")
+[numthreads(GROUPSIZE_X,GROUPSIZE_Y,1)]
+void sample_visibility(uint3 index : SV_DispatchThreadID, uint group_thread_index : SV_GroupIndex, uint3 group_id : SV_GroupID) {
+	const uint path_index = map_pixel_coord(index.xy, group_id.xy, group_thread_index);
+	if (path_index >= gOutputExtent.x*gOutputExtent.y) return;
+	trace_view_path(index.xy, path_index, true);
+}
+
 SLANG_SHADER("compute")
 [numthreads(GROUPSIZE_X,GROUPSIZE_Y,1)]
 void trace_shadows(uint3 index : SV_DispatchThreadID, uint group_thread_index : SV_GroupIndex, uint3 group_id : SV_GroupID) {
@@ -335,4 +383,73 @@ void add_light_trace(uint3 index : SV_DispatchThreadID, uint group_thread_index
 		if ((BDPTDebugMode)gDebugMode == BDPTDebugMode::eLightTraceContribution || ((BDPTDebugMode)gDebugMode == BDPTDebugMode::ePathLengthContribution && gPushConstants.gDebugViewPathLength == 1))
 			gFrameParams.gDebugImage[index.xy] = float4(c, 1);
 	}
-}
\ No newline at end of file
+}
+
+
+// Adaptive sampling. Each pixel traces between 0 and 1 + gAdaptiveMaxSamples view paths per frame, depending on the relative variance of the
+// denoiser's accumulated mean. Pixels with extra paths are sorted by their extra path count into gAdaptivePixels, so that the pixels traced
+// by extra pass i are the first gAdaptiveDispatch[i].w entries, and each pass is an indirect dispatch over them
+
+SLANG_SHADER("compute")
+[numthreads(GROUPSIZE_X,GROUPSIZE_Y,1)]
+void adaptive_sample_counts(uint3 index : SV_DispatchThreadID) {
+	if (any(index.xy >= gOutputExtent)) return;
+
+	uint count = 1;
+	const float4 accum = gFrameParams.gAccumColor[index.xy];
+	if (accum.a > 0 && !any(isnan(accum)) && get_view_index(index.xy, gFrameParams.gViewIndices) != -1) {
+		const float2 m = gFrameParams.gAccumMoments[index.xy];
+		const float rel_variance = max(0, m.y - pow2(m.x)) / (pow2(m.x) + 1e-4) / accum.a;
+		// a history of one sample has no variance, so a pixel only converges once it has gAdaptiveMinSamples
+		if (rel_variance < gAdaptiveThreshold) {
+			if (accum.a >= gAdaptiveMinSamples)
+				count = gAdaptiveStopConverged ? 0 : 1;
+		} else
+			count = 1 + (uint)min((float)gAdaptiveMaxSamples, rel_variance / gAdaptiveThreshold - 1);
+	}
+
+	gFrameParams.gAdaptiveSampleCounts[index.y*gOutputExtent.x + index.x] = count;
+	if (count > 1) InterlockedAdd(gFrameParams.gAdaptiveCounters[count - 2], 1);
+}
+
+SLANG_SHADER("compute")
+[numthreads(1,1,1)]
+void adaptive_dispatch_args() {
+	uint n = 0;
+	for (uint extra = gAdaptiveMaxSamples; extra > 0; extra--) {
+		gFrameParams.gAdaptiveCounters[gAdaptiveMaxSamples + extra - 1] = n;
+		n += gFrameParams.gAdaptiveCounters[extra - 1];
+		// pass extra-1 traces every pixel with at least `extra` extra paths
+		gFrameParams.gAdaptiveDispatch[extra - 1] = uint4((n + 63)/64, 1, 1, n);
+	}
+}
+
+SLANG_SHADER("compute")
+[numthreads(GROUPSIZE_X,GROUPSIZE_Y,1)]
+void adaptive_compact(uint3 index : SV_DispatchThreadID) {
+	if (any(index.xy >= gOutputExtent)) return;
+	const uint count = gFrameParams.gAdaptiveSampleCounts[index.y*gOutputExtent.x + index.x];
+	if (count <= 1) return;
+	uint i;
+	InterlockedAdd(gFrameParams.gAdaptiveCounters[gAdaptiveMaxSamples + count - 2], 1, i);
+	gFrameParams.gAdaptivePixels[i] = (index.y << 16) | index.x;
+}
+
+SLANG_SHADER("compute")
+[numthreads(64,1,1)]
+void sample_adaptive(uint3 index : SV_DispatchThreadID) {
+	if (index.x >= gFrameParams.gAdaptiveDispatch[gAdaptivePass].w) return;
+	const uint packed = gFrameParams.gAdaptivePixels[index.x];
+	const uint2 pixel_coord = uint2(packed & 0xFFFF, packed >> 16);
+	gFrameParams.gRadiance[pixel_coord].a += 1;
+	trace_view_path(pixel_coord, pixel_coord.y*gOutputExtent.x + pixel_coord.x, false);
+}
+
+// gRadiance holds the sum of the view paths, and its alpha the path count. The mean is stored, and the count is kept as the denoiser's accumulation weight
+SLANG_SHADER("compute")
+[numthreads(GROUPSIZE_X,GROUPSIZE_Y,1)]
+void adaptive_resolve(uint3 index : SV_DispatchThreadID) {
+	if (any(index.xy >= gOutputExtent)) return;
+	const float4 c = gFrameParams.gRadiance[index.xy];
+	if (c.a > 1) gFrameParams.gRadiance[index.xy] = float4(c.rgb / c.a, c.a);
+}
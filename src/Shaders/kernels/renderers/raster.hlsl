@@ -8,6 +8,8 @@
 #include <transform.h>
 #include <scene.h>
 
+#define gImageCount 4096
+
 [[vk::constant_id(1)]] const float gAlphaClip = -1; // set below 0 to disable
 
 SamplerState gStaticSampler;
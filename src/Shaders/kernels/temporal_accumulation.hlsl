@@ -58,7 +58,7 @@ struct PushConstants {
 SLANG_SHADER("compute")
 [numthreads(8,8,1)]
 void main(uint3 index : SV_DispatchThreadId) {
-	const uint view_index = get_view_index(index.xy, gViews, gPushConstants.gViewCount);
+	const uint view_index = get_view_index(index.xy, gViewIndices);
 	if (view_index == -1) return;
 
 	float2 extent;
@@ -20,61 +20,69 @@
 #define BVH_FLAG_VOLUME BIT(2)
 #define BVH_FLAG_EMITTER BIT(3)
 
-#define INVALID_INSTANCE 0xFFFF
-#define INVALID_PRIMITIVE 0xFFFF
+// instance indices are stored in the 24-bit instanceCustomIndex of the acceleration structure
+#define MAX_INSTANCE_COUNT BIT(24)
+#define INVALID_INSTANCE 0xFFFFFFFF
+#define INVALID_PRIMITIVE 0xFFFFFFFF
 
-#define gImageCount 4096
-#define gVolumeCount 8
+// image and volume tables are unbounded and sized to the scene. missing images are stored as ~0u, or as all 30 bits where the index is packed with a channel
+#define INVALID_IMAGE_INDEX 0x3FFFFFFF
+
+// view indices are stored per pixel in an R8_UINT image
+#define INVALID_VIEW_INDEX 0xFF
 
 struct InstanceData {
-	uint4 packed;
+	uint4 packed[2];
 
-	inline uint type() CONST_CPP { return BF_GET(packed[0], 0, 4); }
-	inline uint material_address() CONST_CPP { return BF_GET(packed[0], 4, 28); }
-	inline uint light_index() CONST_CPP { return BF_GET(packed[1], 0, 12); }
+	inline uint type() CONST_CPP { return BF_GET(packed[0][0], 0, 4); }
+	inline uint material_address() CONST_CPP { return BF_GET(packed[0][0], 4, 28); }
+	inline uint light_index() CONST_CPP { return packed[0][1]; }
 
 	// mesh
-	inline uint prim_count() CONST_CPP { return BF_GET(packed[1], 12, 16); }
-	inline uint index_stride() CONST_CPP { return BF_GET(packed[1], 28, 4); }
-	inline uint first_vertex() CONST_CPP { return packed[2]; }
-	inline uint indices_byte_offset() CONST_CPP { return packed[3]; }
+	inline uint first_vertex() CONST_CPP { return packed[0][2]; }
+	inline uint indices_byte_offset() CONST_CPP { return packed[0][3]; }
+	inline uint prim_count() CONST_CPP { return packed[1][0]; }
+	inline uint index_stride() CONST_CPP { return packed[1][1]; }
 
 	// sphere
-	inline float radius() CONST_CPP { return asfloat(packed[2]); }
+	inline float radius() CONST_CPP { return asfloat(packed[0][2]); }
 
 	// volume
-	inline uint volume_index() CONST_CPP { return packed[2]; }
+	inline uint volume_index() CONST_CPP { return packed[0][2]; }
 };
 
 inline TransformData make_instance_motion_transform(const TransformData instance_inv_transform, const TransformData prevObjectToWorld) { return tmul(prevObjectToWorld, instance_inv_transform); }
 inline InstanceData make_instance_triangles(const uint materialAddress, const uint primCount, const uint firstVertex, const uint indexByteOffset, const uint indexStride) {
 	InstanceData r;
-	r.packed = 0;
-	BF_SET(r.packed[0], INSTANCE_TYPE_TRIANGLES, 0, 4);
-	BF_SET(r.packed[0], materialAddress, 4, 28);
-	BF_SET(r.packed[1], -1, 0, 12);
-	BF_SET(r.packed[1], primCount, 12, 16);
-	BF_SET(r.packed[1], indexStride, 28, 4);
-	r.packed[2] = firstVertex;
-	r.packed[3] = indexByteOffset;
+	r.packed[0] = 0;
+	r.packed[1] = 0;
+	BF_SET(r.packed[0][0], INSTANCE_TYPE_TRIANGLES, 0, 4);
+	BF_SET(r.packed[0][0], materialAddress, 4, 28);
+	r.packed[0][1] = -1;
+	r.packed[0][2] = firstVertex;
+	r.packed[0][3] = indexByteOffset;
+	r.packed[1][0] = primCount;
+	r.packed[1][1] = indexStride;
 	return r;
 }
 inline InstanceData make_instance_sphere(const uint materialAddress, const float radius) {
 	InstanceData r;
-	r.packed = 0;
-	BF_SET(r.packed[0], INSTANCE_TYPE_SPHERE, 0, 4);
-	BF_SET(r.packed[0], materialAddress, 4, 28);
-	BF_SET(r.packed[1], -1, 0, 12);
-	r.packed[2] = asuint(radius);
+	r.packed[0] = 0;
+	r.packed[1] = 0;
+	BF_SET(r.packed[0][0], INSTANCE_TYPE_SPHERE, 0, 4);
+	BF_SET(r.packed[0][0], materialAddress, 4, 28);
+	r.packed[0][1] = -1;
+	r.packed[0][2] = asuint(radius);
 	return r;
 }
 inline InstanceData make_instance_volume(const uint materialAddress, const uint volume_index) {
 	InstanceData r;
-	r.packed = 0;
-	BF_SET(r.packed[0], INSTANCE_TYPE_VOLUME, 0, 4);
-	BF_SET(r.packed[0], materialAddress, 4, 28);
-	BF_SET(r.packed[1], -1, 0, 12);
-	r.packed[2] = volume_index;
+	r.packed[0] = 0;
+	r.packed[1] = 0;
+	BF_SET(r.packed[0][0], INSTANCE_TYPE_VOLUME, 0, 4);
+	BF_SET(r.packed[0][0], materialAddress, 4, 28);
+	r.packed[0][1] = -1;
+	r.packed[0][2] = volume_index;
 	return r;
 }
 
@@ -93,6 +101,38 @@ struct PackedVertexData {
 	}
 };
 
+// Quantized vertex, half the size of PackedVertexData. Positions are 21-bit fixed point within the mesh's bounding box,
+// which is stored as two float4s (min, extent) in the slots before the mesh's first vertex
+struct CompactVertexData {
+	uint2 packed_position;
+	uint packed_normal; // octahedral, or -1 when the mesh has no normal
+	uint packed_uv; // half2
+
+#ifdef __HLSL__
+	inline PackedVertexData unpack(const float3 bounds_min, const float3 bounds_extent) {
+		const uint3 q = uint3(
+			packed_position[0] & 0x1FFFFF,
+			(packed_position[0] >> 21) | ((packed_position[1] & 0x3FF) << 11),
+			packed_position[1] >> 10);
+		PackedVertexData v;
+		v.set(
+			bounds_min + bounds_extent * (q / (float)0x1FFFFF),
+			packed_normal == -1 ? 0 : unpack_normal_octahedron(packed_normal),
+			unpack_f16_2(packed_uv));
+		return v;
+	}
+	SLANG_MUTATING
+	inline void set(const float3 p, const float3 n, const float2 uv, const float3 bounds_min, const float3 bounds_extent) {
+		const uint3 q = uint3(saturate((p - bounds_min) / max(bounds_extent, 1e-20)) * 0x1FFFFF + 0.5);
+		packed_position[0] = q.x | (q.y << 21);
+		packed_position[1] = (q.y >> 11) | (q.z << 10);
+		packed_normal = any(n != 0) ? pack_normal_octahedron(n) : -1;
+		packed_uv = pack_f16_2(uv);
+	}
+#endif
+};
+#define COMPACT_VERTEX_BOUNDS_SLOTS 2
+
 struct ViewData {
 	ProjectionData projection;
 	int2 image_min;
@@ -111,12 +151,12 @@ struct ViewData {
 #endif
 };
 
+// The primitive index isn't stored, since nothing that reads the visibility buffer needs it
 struct VisibilityInfo {
-	uint instance_primitive_index;
+	uint instance;
 	uint packed_normal;
 
-	inline uint instance_index()  { return BF_GET(instance_primitive_index, 0, 16); }
-	inline uint primitive_index() { return BF_GET(instance_primitive_index, 16, 16); }
+	inline uint instance_index() { return instance; }
 #ifdef __HLSL__
 	inline float3 normal()   { return unpack_normal_octahedron(packed_normal); }
 #endif
@@ -129,11 +169,13 @@ struct DepthInfo {
 
 #ifdef __HLSL__
 
-inline uint get_view_index(const uint2 index, StructuredBuffer<ViewData> views, const uint viewCount) {
-	for (uint i = 0; i < viewCount; i++)
-		if (all(index >= views[i].image_min) && all(index < views[i].image_max))
-			return i;
-	return -1;
+// view_indices is the per-pixel view lookup built by the renderer whenever the views change. returns -1 outside every view
+inline uint get_view_index(const int2 index, Texture2D<uint> view_indices) {
+	uint2 extent;
+	view_indices.GetDimensions(extent.x, extent.y);
+	if (any(index < 0) || any(uint2(index) >= extent)) return -1;
+	const uint view_index = view_indices.Load(int3(index, 0));
+	return view_index == INVALID_VIEW_INDEX ? -1 : view_index;
 }
 
 inline uint3 load_tri_(ByteAddressBuffer indices, uint indexByteOffset, uint indexStride, uint primitiveIndex) {
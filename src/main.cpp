@@ -3,6 +3,7 @@
 #include "Node/XR.hpp"
 #include "Node/FlyCamera.hpp"
 #include "Node/ImageComparer.hpp"
+#include "Node/Benchmark.hpp"
 
 #include "Node/BDPT.hpp"
 
@@ -112,6 +113,14 @@ int main(int argc, char** argv) {
 #endif
 	instance->create_device();
 
+	if (auto barriers = instance->find_argument("benchmarkBarriers"), commandBuffers = instance->find_argument("benchmarkCommandBuffers"); barriers || commandBuffers) {
+		if (barriers) benchmark_image_barriers(instance->device(), barriers->empty() ? 64 : atoi(barriers->c_str()));
+		if (commandBuffers) benchmark_command_buffers(instance->device(), commandBuffers->empty() ? 1000 : atoi(commandBuffers->c_str()));
+		instance->device().flush();
+		gNodeGraph.erase_recurse(root_node);
+		return EXIT_SUCCESS;
+	}
+
 
 	Node& app_node = root_node.make_child("Scene");
 
@@ -144,6 +153,7 @@ int main(int argc, char** argv) {
 
 	renderer_node.make_component<Denoiser>();
 	renderer_node.make_component<ImageComparer>();
+	if (instance->find_argument("benchmark")) renderer_node.make_component<Benchmark>();
 
 	for (const string& plugin_info : instance->find_arguments("plugin"))
 		load_plugins(plugin_info, app.node());